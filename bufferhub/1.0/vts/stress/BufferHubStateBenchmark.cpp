@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LocalBufferHub.h"
+
+#include <android/hardware_buffer.h>
+#include <benchmark/benchmark.h>
+
+#include <sched.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+using namespace ::android::frameworks::bufferhub::vts;
+
+namespace {
+
+const AHardwareBuffer_Desc kDesc = {
+    /*width=*/64UL,  /*height=*/64UL,
+    /*layers=*/1,    /*format=*/AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM,
+    /*usage=*/0ULL,  /*stride=*/0UL,
+    /*rfu0=*/0UL,    /*rfu1=*/0ULL};
+
+// User metadata shared between the producer and consumer processes.
+struct BenchmarkMetadata {
+    std::atomic<uint32_t> readyCount;
+    std::atomic<uint32_t> stop;
+    std::atomic<int64_t> postTimeNs;
+    std::atomic<int64_t> totalWakeNs;
+    std::atomic<int64_t> wakeCount;
+};
+
+int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// A buffer, its producer and helpers to run consumers in other processes.
+class Harness {
+   public:
+    Harness() {
+        HardwareBufferDescription desc;
+        memcpy(&desc, &kDesc, sizeof(HardwareBufferDescription));
+        mBufferHub.allocateBuffer(desc, sizeof(BenchmarkMetadata), &mTraits);
+        mProducer.reset(new LocalBufferClient(mTraits));
+        if (mProducer->isValid()) {
+            mMetadata = static_cast<BenchmarkMetadata*>(mProducer->userMetadata());
+        }
+    }
+
+    ~Harness() {
+        if (mMetadata == nullptr) {
+            return;
+        }
+        mMetadata->stop.store(1);
+        // Consumers blocked on the event fd need a wake up to see stop.
+        for (size_t i = 0; i < mConsumers.size(); ++i) {
+            mProducer->signal();
+        }
+        for (pid_t pid : mConsumers) {
+            waitpid(pid, nullptr, 0);
+        }
+    }
+
+    std::unique_ptr<LocalBufferClient> importClient() {
+        BufferTraits traits;
+        if (LocalBufferHub::importBuffer(mTraits, &traits) != BufferHubStatus::NO_ERROR) {
+            return nullptr;
+        }
+        return std::make_unique<LocalBufferClient>(traits);
+    }
+
+    // Starts a consumer process that acquires and releases each posted
+    // buffer, spinning or blocking on the event fd in between.
+    void forkConsumer(bool blocking) {
+        const pid_t pid = fork();
+        if (pid != 0) {
+            mConsumers.push_back(pid);
+            return;
+        }
+
+        {
+            std::unique_ptr<LocalBufferClient> consumer = importClient();
+            mMetadata->readyCount.fetch_add(1);
+            while (consumer != nullptr && mMetadata->stop.load() == 0) {
+                if (blocking && !consumer->wait(/*timeoutMs=*/100)) {
+                    continue;
+                }
+                if (consumer->acquire() != 0) {
+                    if (!blocking) {
+                        sched_yield();
+                    }
+                    continue;
+                }
+                if (blocking) {
+                    mMetadata->totalWakeNs.fetch_add(nowNs() - mMetadata->postTimeNs.load());
+                    mMetadata->wakeCount.fetch_add(1);
+                }
+                consumer->release();
+            }
+        }
+        _exit(0);
+    }
+
+    bool waitForConsumers() {
+        if (mMetadata == nullptr) {
+            return false;
+        }
+        while (mMetadata->readyCount.load() < mConsumers.size()) {
+            sched_yield();
+        }
+        return mProducer->isValid();
+    }
+
+    void waitUntilReleased() {
+        while (mProducer->bufferState() != 0U) {
+            sched_yield();
+        }
+    }
+
+    LocalBufferClient* producer() { return mProducer.get(); }
+    BenchmarkMetadata* metadata() { return mMetadata; }
+
+   private:
+    LocalBufferHub mBufferHub;
+    BufferTraits mTraits;
+    std::unique_ptr<LocalBufferClient> mProducer;
+    BenchmarkMetadata* mMetadata = nullptr;
+    std::vector<pid_t> mConsumers;
+};
+
+// A producer cycling the buffer through gain and post, with no consumers.
+void BM_GainPost(benchmark::State& state) {
+    Harness harness;
+    if (!harness.waitForConsumers()) {
+        state.SkipWithError("setup failed");
+        return;
+    }
+    LocalBufferClient* producer = harness.producer();
+
+    for (auto _ : state) {
+        producer->gain();
+        producer->post();
+    }
+
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_GainPost);
+
+// Every transition of a round, with all the clients in this process. Items
+// are transitions, so the rate gives the uncontended cost of each.
+void BM_TransitionRound(benchmark::State& state) {
+    Harness harness;
+    if (!harness.waitForConsumers()) {
+        state.SkipWithError("setup failed");
+        return;
+    }
+    LocalBufferClient* producer = harness.producer();
+    std::vector<std::unique_ptr<LocalBufferClient>> consumers;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        consumers.push_back(harness.importClient());
+    }
+
+    for (auto _ : state) {
+        producer->gain();
+        producer->post();
+        for (const auto& consumer : consumers) {
+            consumer->acquire();
+        }
+        for (const auto& consumer : consumers) {
+            consumer->release();
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * (2 + 2 * state.range(0)));
+}
+BENCHMARK(BM_TransitionRound)->Arg(1)->Arg(3)->Arg(7)->Arg(kMaxNumberOfClients - 1);
+
+// Rounds with consumers spinning in their own processes, up to the most
+// clients a buffer can have, so transitions contend on the buffer state.
+void BM_ContendedRound(benchmark::State& state) {
+    Harness harness;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        harness.forkConsumer(/*blocking=*/false);
+    }
+    if (!harness.waitForConsumers()) {
+        state.SkipWithError("setup failed");
+        return;
+    }
+    LocalBufferClient* producer = harness.producer();
+
+    for (auto _ : state) {
+        producer->gain();
+        producer->post();
+        harness.waitUntilReleased();
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ContendedRound)
+        ->Arg(1)
+        ->Arg(3)
+        ->Arg(7)
+        ->Arg(kMaxNumberOfClients - 1)
+        ->UseRealTime();
+
+// A round with a consumer blocked on the event fd. The wakeLatencyNs counter
+// is the time from the signal to the consumer running.
+void BM_EventFdWake(benchmark::State& state) {
+    Harness harness;
+    harness.forkConsumer(/*blocking=*/true);
+    if (!harness.waitForConsumers()) {
+        state.SkipWithError("setup failed");
+        return;
+    }
+    LocalBufferClient* producer = harness.producer();
+    BenchmarkMetadata* metadata = harness.metadata();
+
+    for (auto _ : state) {
+        producer->gain();
+        producer->post();
+        metadata->postTimeNs.store(nowNs());
+        producer->signal();
+        harness.waitUntilReleased();
+    }
+
+    const int64_t wakeCount = metadata->wakeCount.load();
+    if (wakeCount > 0) {
+        state.counters["wakeLatencyNs"] =
+                static_cast<double>(metadata->totalWakeNs.load()) / wakeCount;
+    }
+}
+BENCHMARK(BM_EventFdWake)->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LocalBufferHub.h"
+
+#include <android/hardware_buffer.h>
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace android {
+namespace frameworks {
+namespace bufferhub {
+namespace vts {
+
+using Clock = std::chrono::steady_clock;
+
+const AHardwareBuffer_Desc kDesc = {
+    /*width=*/64UL,  /*height=*/64UL,
+    /*layers=*/1,    /*format=*/AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM,
+    /*usage=*/0ULL,  /*stride=*/0UL,
+    /*rfu0=*/0UL,    /*rfu1=*/0ULL};
+constexpr auto kTimeout = std::chrono::seconds(10);
+constexpr size_t kPayloadWords = 14;
+
+// User metadata shared by the clients of a stress test.
+struct StressMetadata {
+    std::atomic<uint32_t> nextIndex;
+    std::atomic<uint32_t> readyCount;
+    uint32_t clientStateMasks[kMaxNumberOfClients];
+    uint64_t payload[kPayloadWords];
+};
+
+// Spins on |condition| until it holds or kTimeout passes.
+template <typename Condition>
+bool spinUntil(Condition condition) {
+    const auto deadline = Clock::now() + kTimeout;
+    while (!condition()) {
+        if (Clock::now() > deadline) {
+            return false;
+        }
+        sched_yield();
+    }
+    return true;
+}
+
+class BufferHubStateStressTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        HardwareBufferDescription desc;
+        memcpy(&desc, &kDesc, sizeof(HardwareBufferDescription));
+        ASSERT_EQ(BufferHubStatus::NO_ERROR,
+                  mBufferHub.allocateBuffer(desc, sizeof(StressMetadata), &mTraits));
+        mProducer.reset(new LocalBufferClient(mTraits));
+        ASSERT_TRUE(mProducer->isValid());
+        mMetadata = static_cast<StressMetadata*>(mProducer->userMetadata());
+    }
+
+    std::unique_ptr<LocalBufferClient> importClient() {
+        BufferTraits traits;
+        if (LocalBufferHub::importBuffer(mTraits, &traits) != BufferHubStatus::NO_ERROR) {
+            return nullptr;
+        }
+        return std::make_unique<LocalBufferClient>(traits);
+    }
+
+    // Runs |rounds| rounds as a consumer in a child process, checking that
+    // each sees the payload of its round and that no client gains the buffer
+    // while it is acquired.
+    pid_t forkConsumer(uint64_t rounds) {
+        const pid_t pid = fork();
+        if (pid != 0) {
+            return pid;
+        }
+
+        int failures = 0;
+        {
+            std::unique_ptr<LocalBufferClient> consumer = importClient();
+            if (consumer == nullptr || !consumer->isValid()) {
+                _exit(2);
+            }
+            const uint32_t index = mMetadata->nextIndex.fetch_add(1);
+            mMetadata->clientStateMasks[index % kMaxNumberOfClients] = consumer->clientStateMask();
+            mMetadata->readyCount.fetch_add(1, std::memory_order_release);
+
+            for (uint64_t round = 1; round <= rounds; ++round) {
+                if (!spinUntil([&] { return consumer->acquire() == 0; })) {
+                    _exit(3);
+                }
+                for (size_t i = 0; i < kPayloadWords; ++i) {
+                    failures += mMetadata->payload[i] != round ? 1 : 0;
+                }
+                failures += isAnyClientGained(consumer->bufferState()) ? 1 : 0;
+                consumer->release();
+            }
+        }
+        _exit(failures == 0 ? 0 : 1);
+    }
+
+    LocalBufferHub mBufferHub;
+    BufferTraits mTraits;
+    std::unique_ptr<LocalBufferClient> mProducer;
+    StressMetadata* mMetadata = nullptr;
+};
+
+TEST_F(BufferHubStateStressTest, Transitions) {
+    std::unique_ptr<LocalBufferClient> consumer = importClient();
+    ASSERT_NE(nullptr, consumer);
+    const uint32_t producerMask = mProducer->clientStateMask();
+    const uint32_t consumerMask = consumer->clientStateMask();
+
+    EXPECT_EQ(0U, mProducer->bufferState());
+    EXPECT_EQ(-EBUSY, mProducer->post());
+    EXPECT_EQ(-EBUSY, consumer->acquire());
+
+    ASSERT_EQ(0, mProducer->gain());
+    EXPECT_TRUE(isClientGained(mProducer->bufferState(), producerMask));
+    EXPECT_EQ(-EBUSY, consumer->gain());
+
+    ASSERT_EQ(0, mProducer->post());
+    EXPECT_TRUE(isClientPosted(mProducer->bufferState(), consumerMask));
+    EXPECT_TRUE(isClientReleased(mProducer->bufferState(), producerMask));
+
+    ASSERT_EQ(0, consumer->acquire());
+    EXPECT_TRUE(isClientAcquired(mProducer->bufferState(), consumerMask));
+    EXPECT_EQ(-EBUSY, mProducer->gain());
+
+    ASSERT_EQ(0, consumer->release());
+    EXPECT_EQ(0U, mProducer->bufferState());
+    EXPECT_EQ(0, mProducer->gain());
+}
+
+TEST_F(BufferHubStateStressTest, ImportUpToMaxClients) {
+    std::vector<std::unique_ptr<LocalBufferClient>> clients;
+    uint32_t unionMask = mProducer->clientStateMask();
+    for (uint32_t i = 1; i < kMaxNumberOfClients; ++i) {
+        clients.push_back(importClient());
+        ASSERT_NE(nullptr, clients.back());
+        EXPECT_EQ(0U, unionMask & clients.back()->clientStateMask());
+        unionMask |= clients.back()->clientStateMask();
+    }
+    EXPECT_EQ(~0U, unionMask);
+
+    BufferTraits traits;
+    EXPECT_EQ(BufferHubStatus::MAX_CLIENT, LocalBufferHub::importBuffer(mTraits, &traits));
+
+    // Closing a client frees its slot.
+    const uint32_t freedMask = clients[3]->clientStateMask();
+    clients[3].reset();
+    std::unique_ptr<LocalBufferClient> client = importClient();
+    ASSERT_NE(nullptr, client);
+    EXPECT_EQ(freedMask, client->clientStateMask());
+}
+
+// One producer and the most consumers a buffer can have, each in its own
+// process, cycle the buffer through all of its states.
+TEST_F(BufferHubStateStressTest, MaxClientsAcrossProcesses) {
+    constexpr uint32_t kConsumerCount = kMaxNumberOfClients - 1;
+    constexpr uint64_t kRounds = 20000;
+
+    std::vector<pid_t> consumers;
+    for (uint32_t i = 0; i < kConsumerCount; ++i) {
+        const pid_t pid = forkConsumer(kRounds);
+        ASSERT_GT(pid, 0);
+        consumers.push_back(pid);
+    }
+    ASSERT_TRUE(spinUntil([&] { return mMetadata->readyCount.load() == kConsumerCount; }));
+
+    // Imports racing across processes still get a slot each.
+    uint32_t unionMask = mProducer->clientStateMask();
+    for (uint32_t i = 0; i < kConsumerCount; ++i) {
+        EXPECT_EQ(0U, unionMask & mMetadata->clientStateMasks[i]);
+        unionMask |= mMetadata->clientStateMasks[i];
+    }
+    BufferTraits traits;
+    EXPECT_EQ(BufferHubStatus::MAX_CLIENT, LocalBufferHub::importBuffer(mTraits, &traits));
+
+    for (uint64_t round = 1; round <= kRounds; ++round) {
+        ASSERT_TRUE(spinUntil([&] { return mProducer->bufferState() == 0U; })) << round;
+        ASSERT_EQ(0, mProducer->gain());
+        for (size_t i = 0; i < kPayloadWords; ++i) {
+            mMetadata->payload[i] = round;
+        }
+        ASSERT_EQ(0, mProducer->post());
+    }
+
+    for (pid_t pid : consumers) {
+        int status;
+        ASSERT_EQ(pid, waitpid(pid, &status, 0));
+        EXPECT_TRUE(WIFEXITED(status));
+        EXPECT_EQ(0, WEXITSTATUS(status));
+    }
+}
+
+}  // namespace vts
+}  // namespace bufferhub
+}  // namespace frameworks
+}  // namespace android
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LocalBufferHub"
+
+#include "LocalBufferHub.h"
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+#include <cutils/native_handle.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <new>
+
+namespace android {
+namespace frameworks {
+namespace bufferhub {
+namespace vts {
+
+using ::android::base::unique_fd;
+
+namespace {
+
+// The stand-in buffers are plain memory, sized as 4 bytes per pixel.
+constexpr size_t kBytesPerPixel = 4;
+
+unique_fd createMemfd(const char* name, size_t size) {
+    unique_fd fd(static_cast<int>(syscall(__NR_memfd_create, name, 0)));
+    if (fd.get() < 0 || ftruncate(fd.get(), size) != 0) {
+        PLOG(ERROR) << "Failed to create " << name;
+        return unique_fd();
+    }
+    return fd;
+}
+
+MetadataHeader* mapMetadata(int fd, size_t size) {
+    void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        PLOG(ERROR) << "Failed to map buffer metadata";
+        return nullptr;
+    }
+    return static_cast<MetadataHeader*>(address);
+}
+
+bool isValidBufferInfo(const native_handle_t* bufferInfo) {
+    return bufferInfo != nullptr && bufferInfo->numFds == 2 && bufferInfo->numInts == 3;
+}
+
+}  // namespace
+
+BufferHubStatus LocalBufferHub::allocateBuffer(const HardwareBufferDescription& description,
+                                               uint32_t userMetadataSize,
+                                               BufferTraits* outTraits) {
+    const uint32_t width = description[0];
+    const uint32_t height = description[1];
+    const uint32_t layers = description[2];
+    if (width == 0 || height == 0 || layers == 0) {
+        return BufferHubStatus::ALLOCATION_FAILED;
+    }
+
+    const size_t metadataSize = sizeof(MetadataHeader) + userMetadataSize;
+    unique_fd bufferFd = createMemfd("bufferhub_buffer", kBytesPerPixel * width * height * layers);
+    unique_fd metadataFd = createMemfd("bufferhub_metadata", metadataSize);
+    unique_fd eventFd(eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE));
+    if (bufferFd.get() < 0 || metadataFd.get() < 0 || eventFd.get() < 0) {
+        return BufferHubStatus::ALLOCATION_FAILED;
+    }
+
+    MetadataHeader* header = mapMetadata(metadataFd.get(), metadataSize);
+    if (header == nullptr) {
+        return BufferHubStatus::ALLOCATION_FAILED;
+    }
+    new (header) MetadataHeader();
+    header->bufferState.store(0U);
+    header->fenceState.store(0U);
+    header->activeClientsBitMask.store(kFirstClientBitMask);
+    header->queueIndex = 0;
+    munmap(header, metadataSize);
+
+    int bufferId;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        bufferId = mNextBufferId++;
+    }
+
+    native_handle_t* bufferHandle = native_handle_create(/*numFds=*/1, /*numInts=*/0);
+    bufferHandle->data[0] = bufferFd.release();
+
+    native_handle_t* bufferInfo = native_handle_create(/*numFds=*/2, /*numInts=*/3);
+    bufferInfo->data[kMetadataFdIndex] = metadataFd.release();
+    bufferInfo->data[kEventFdIndex] = eventFd.release();
+    bufferInfo->data[kBufferIdIndex] = bufferId;
+    bufferInfo->data[kClientStateMaskIndex] = static_cast<int>(kFirstClientBitMask);
+    bufferInfo->data[kUserMetadataSizeIndex] = static_cast<int>(userMetadataSize);
+
+    outTraits->bufferDesc = description;
+    outTraits->bufferHandle.setTo(bufferHandle, /*shouldOwn=*/true);
+    outTraits->bufferInfo.setTo(bufferInfo, /*shouldOwn=*/true);
+    return BufferHubStatus::NO_ERROR;
+}
+
+// static
+BufferHubStatus LocalBufferHub::importBuffer(const BufferTraits& traits,
+                                             BufferTraits* outTraits) {
+    const native_handle_t* bufferInfo = traits.bufferInfo.getNativeHandle();
+    if (!isValidBufferInfo(bufferInfo)) {
+        return BufferHubStatus::INVALID_TOKEN;
+    }
+
+    MetadataHeader* header = mapMetadata(bufferInfo->data[kMetadataFdIndex],
+                                         sizeof(MetadataHeader));
+    if (header == nullptr) {
+        return BufferHubStatus::BUFFER_FREED;
+    }
+
+    uint32_t activeClients = header->activeClientsBitMask.load(std::memory_order_acquire);
+    uint32_t clientStateMask;
+    do {
+        clientStateMask = findNextAvailableClientStateMask(activeClients);
+        if (clientStateMask == 0U) {
+            munmap(header, sizeof(MetadataHeader));
+            return BufferHubStatus::MAX_CLIENT;
+        }
+    } while (!header->activeClientsBitMask.compare_exchange_weak(
+            activeClients, activeClients | clientStateMask, std::memory_order_acq_rel,
+            std::memory_order_acquire));
+    munmap(header, sizeof(MetadataHeader));
+
+    native_handle_t* newBufferInfo = native_handle_clone(bufferInfo);
+    newBufferInfo->data[kClientStateMaskIndex] = static_cast<int>(clientStateMask);
+
+    outTraits->bufferDesc = traits.bufferDesc;
+    outTraits->bufferHandle = traits.bufferHandle;
+    outTraits->bufferInfo.setTo(newBufferInfo, /*shouldOwn=*/true);
+    return BufferHubStatus::NO_ERROR;
+}
+
+LocalBufferClient::LocalBufferClient(const BufferTraits& traits) {
+    const native_handle_t* bufferInfo = traits.bufferInfo.getNativeHandle();
+    if (!isValidBufferInfo(bufferInfo)) {
+        return;
+    }
+
+    mMetadataSize = sizeof(MetadataHeader) +
+                    static_cast<uint32_t>(bufferInfo->data[kUserMetadataSizeIndex]);
+    mHeader = mapMetadata(bufferInfo->data[kMetadataFdIndex], mMetadataSize);
+    mEventFd = dup(bufferInfo->data[kEventFdIndex]);
+    mClientStateMask = static_cast<uint32_t>(bufferInfo->data[kClientStateMaskIndex]);
+}
+
+LocalBufferClient::~LocalBufferClient() {
+    if (mHeader != nullptr) {
+        mHeader->bufferState.fetch_and(~mClientStateMask, std::memory_order_acq_rel);
+        mHeader->activeClientsBitMask.fetch_and(~mClientStateMask, std::memory_order_acq_rel);
+        munmap(mHeader, mMetadataSize);
+    }
+    if (mEventFd >= 0) {
+        close(mEventFd);
+    }
+}
+
+int LocalBufferClient::gain() {
+    uint32_t current = mHeader->bufferState.load(std::memory_order_acquire);
+    if (isClientGained(current, mClientStateMask)) {
+        return 0;
+    }
+    do {
+        if (isAnyClientGained(current & ~mClientStateMask) || isAnyClientAcquired(current)) {
+            return -EBUSY;
+        }
+    } while (!mHeader->bufferState.compare_exchange_weak(
+            current, mClientStateMask, std::memory_order_acq_rel, std::memory_order_acquire));
+    return 0;
+}
+
+int LocalBufferClient::post() {
+    uint32_t current = mHeader->bufferState.load(std::memory_order_acquire);
+    uint32_t posted;
+    do {
+        if (!isClientGained(current, mClientStateMask)) {
+            return -EBUSY;
+        }
+        posted = mHeader->activeClientsBitMask.load(std::memory_order_acquire) &
+                 ~mClientStateMask & kHighBitsMask;
+    } while (!mHeader->bufferState.compare_exchange_weak(
+            current, posted, std::memory_order_acq_rel, std::memory_order_acquire));
+    return 0;
+}
+
+int LocalBufferClient::acquire() {
+    uint32_t current = mHeader->bufferState.load(std::memory_order_acquire);
+    if (isClientAcquired(current, mClientStateMask)) {
+        return 0;
+    }
+    do {
+        if (!isClientPosted(current, mClientStateMask)) {
+            return -EBUSY;
+        }
+    } while (!mHeader->bufferState.compare_exchange_weak(current, current ^ mClientStateMask,
+                                                         std::memory_order_acq_rel,
+                                                         std::memory_order_acquire));
+    return 0;
+}
+
+int LocalBufferClient::release() {
+    uint32_t current = mHeader->bufferState.load(std::memory_order_acquire);
+    while (!isClientReleased(current, mClientStateMask)) {
+        if (mHeader->bufferState.compare_exchange_weak(current, current & ~mClientStateMask,
+                                                       std::memory_order_acq_rel,
+                                                       std::memory_order_acquire)) {
+            break;
+        }
+    }
+    return 0;
+}
+
+void LocalBufferClient::signal() {
+    const uint64_t one = 1;
+    if (write(mEventFd, &one, sizeof(one)) != sizeof(one)) {
+        PLOG(ERROR) << "Failed to signal buffer event";
+    }
+}
+
+bool LocalBufferClient::wait(int timeoutMs) {
+    struct pollfd pfd = {mEventFd, POLLIN, 0};
+    for (;;) {
+        const int ret = poll(&pfd, 1, timeoutMs);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+
+        // Another waiter may have taken the event between poll and read.
+        uint64_t count;
+        if (read(mEventFd, &count, sizeof(count)) == sizeof(count)) {
+            return true;
+        }
+        if (errno != EAGAIN) {
+            return false;
+        }
+    }
+}
+
+}  // namespace vts
+}  // namespace bufferhub
+}  // namespace frameworks
+}  // namespace android
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FRAMEWORKS_BUFFERHUB_VTS_LOCAL_BUFFER_HUB_H
+#define ANDROID_FRAMEWORKS_BUFFERHUB_VTS_LOCAL_BUFFER_HUB_H
+
+#include <android/frameworks/bufferhub/1.0/types.h>
+
+#include <atomic>
+#include <mutex>
+
+namespace android {
+namespace frameworks {
+namespace bufferhub {
+namespace vts {
+
+using ::android::frameworks::bufferhub::V1_0::BufferHubStatus;
+using ::android::frameworks::bufferhub::V1_0::BufferTraits;
+using ::android::hardware::graphics::common::V1_2::HardwareBufferDescription;
+
+// The shared memory protocol of BufferHub clients, as in ui/BufferHubDefs.h.
+//
+// Each client takes two bits of the buffer state, one in the low and one in
+// the high half: gained is 11, posted 10, acquired 01 and released 00.
+constexpr uint32_t kMaxNumberOfClients = 16;
+constexpr uint32_t kLowbitsMask = (1U << kMaxNumberOfClients) - 1U;
+constexpr uint32_t kHighBitsMask = ~kLowbitsMask;
+constexpr uint32_t kFirstClientBitMask = (1U << kMaxNumberOfClients) + 1U;
+
+// Indices into BufferTraits.bufferInfo.
+constexpr int kMetadataFdIndex = 0;
+constexpr int kEventFdIndex = 1;
+constexpr int kBufferIdIndex = 2;
+constexpr int kClientStateMaskIndex = 3;
+constexpr int kUserMetadataSizeIndex = 4;
+
+// Start of the metadata memory, followed by the user metadata. Padded to the
+// size of the real header, which also holds a DvrNativeBufferMetadata.
+struct __attribute__((aligned(8))) MetadataHeader {
+    std::atomic<uint32_t> bufferState;
+    std::atomic<uint32_t> fenceState;
+    std::atomic<uint32_t> activeClientsBitMask;
+    uint32_t queueIndex;
+    uint8_t reserved[112];
+};
+
+static_assert(sizeof(MetadataHeader) == 128, "MetadataHeader must match ui/BufferHubDefs.h");
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "buffer state must be usable across processes");
+
+inline bool isAnyClientGained(uint32_t state) {
+    const uint32_t highBits = state >> kMaxNumberOfClients;
+    const uint32_t lowBits = state & kLowbitsMask;
+    return highBits == lowBits && lowBits != 0U;
+}
+
+inline bool isClientGained(uint32_t state, uint32_t clientBitMask) {
+    return state == clientBitMask;
+}
+
+inline bool isAnyClientAcquired(uint32_t state) {
+    const uint32_t highBits = state >> kMaxNumberOfClients;
+    const uint32_t lowBits = state & kLowbitsMask;
+    return ((highBits ^ lowBits) & lowBits) != 0U;
+}
+
+inline bool isClientPosted(uint32_t state, uint32_t clientBitMask) {
+    const uint32_t clientBits = state & clientBitMask;
+    return clientBits != 0U && (clientBits & kLowbitsMask) == 0U;
+}
+
+inline bool isClientAcquired(uint32_t state, uint32_t clientBitMask) {
+    const uint32_t clientBits = state & clientBitMask;
+    return clientBits != 0U && (clientBits & kHighBitsMask) == 0U;
+}
+
+inline bool isClientReleased(uint32_t state, uint32_t clientBitMask) {
+    return (state & clientBitMask) == 0U;
+}
+
+// Returns the bits of the lowest free client slot, or 0 if all are taken.
+inline uint32_t findNextAvailableClientStateMask(uint32_t activeClients) {
+    const uint32_t lowUnion = activeClients & kLowbitsMask;
+    if (lowUnion == kLowbitsMask) {
+        return 0U;
+    }
+    const uint32_t newLowBit = ~lowUnion & (lowUnion + 1U);
+    return (newLowBit << kMaxNumberOfClients) | newLowBit;
+}
+
+// A stand-in for the BufferHub service, backed by memfds instead of gralloc
+// buffers and running in the calling process instead of behind binder.
+// BufferTraits it returns have the layout of real ones, so clients cannot
+// tell the difference.
+class LocalBufferHub {
+   public:
+    LocalBufferHub() = default;
+
+    // Allocates a released buffer with its first client.
+    BufferHubStatus allocateBuffer(const HardwareBufferDescription& description,
+                                   uint32_t userMetadataSize, BufferTraits* outTraits);
+
+    // Adds a client to the buffer of |traits|, as importing a token of it
+    // would. Works in any process holding the fds of |traits|.
+    static BufferHubStatus importBuffer(const BufferTraits& traits, BufferTraits* outTraits);
+
+   private:
+    std::mutex mLock;
+    int mNextBufferId = 0;
+
+    LocalBufferHub(const LocalBufferHub&) = delete;
+    LocalBufferHub& operator=(const LocalBufferHub&) = delete;
+};
+
+// One client of a buffer, driving its state through the shared metadata.
+// Transitions return 0, or -EBUSY if the buffer is not in a state that
+// allows them.
+class LocalBufferClient {
+   public:
+    explicit LocalBufferClient(const BufferTraits& traits);
+
+    // Also gives up the client slot, as IBufferClient::close would.
+    ~LocalBufferClient();
+
+    bool isValid() const { return mHeader != nullptr; }
+
+    uint32_t clientStateMask() const { return mClientStateMask; }
+    uint32_t bufferState() const {
+        return mHeader->bufferState.load(std::memory_order_acquire);
+    }
+    void* userMetadata() const { return mHeader + 1; }
+
+    // Producer side. post() hands the buffer to every other client.
+    int gain();
+    int post();
+
+    // Consumer side.
+    int acquire();
+    int release();
+
+    // Wakes or waits for the other clients through the event fd. wait()
+    // returns false on timeout.
+    void signal();
+    bool wait(int timeoutMs);
+
+   private:
+    MetadataHeader* mHeader = nullptr;
+    size_t mMetadataSize = 0;
+    int mEventFd = -1;
+    uint32_t mClientStateMask = 0;
+
+    LocalBufferClient(const LocalBufferClient&) = delete;
+    LocalBufferClient& operator=(const LocalBufferClient&) = delete;
+};
+
+}  // namespace vts
+}  // namespace bufferhub
+}  // namespace frameworks
+}  // namespace android
+
+#endif  // ANDROID_FRAMEWORKS_BUFFERHUB_VTS_LOCAL_BUFFER_HUB_H
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BufferHubFrameMetadata"
+
+#include <bufferhub/FrameMetadata.h>
+
+#include <errno.h>
+#include <log/log.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <atomic>
+
+namespace android {
+namespace frameworks {
+namespace bufferhub {
+namespace V1_1 {
+namespace utils {
+
+namespace {
+
+// Indices into BufferTraits.bufferInfo, see ui/BufferHubDefs.h.
+constexpr int kMetadataFdIndex = 0;
+constexpr int kUserMetadataSizeIndex = 4;
+
+// Readers give up after this many torn copies in a row.
+constexpr int kMaxReadAttempts = 1000;
+
+constexpr size_t kMetadataWords = sizeof(FrameMetadata) / sizeof(uint32_t);
+static_assert(sizeof(FrameMetadata) % sizeof(uint32_t) == 0, "metadata must be whole words");
+
+// The metadata is copied a word at a time with relaxed atomics, so that the
+// copy racing a write is defined behavior. The sequence checks discard it.
+void copyWords(uint32_t* dst, const uint32_t* src) {
+    for (size_t i = 0; i < kMetadataWords; ++i) {
+        __atomic_store_n(&dst[i], __atomic_load_n(&src[i], __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    }
+}
+
+}  // namespace
+
+void writeFrameMetadata(FrameMetadataSlot* slot, const FrameMetadata& metadata) {
+    const uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    copyWords(reinterpret_cast<uint32_t*>(&slot->metadata),
+              reinterpret_cast<const uint32_t*>(&metadata));
+
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+bool readFrameMetadata(const FrameMetadataSlot* slot, FrameMetadata* outMetadata) {
+    for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+        const uint32_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1U) {
+            sched_yield();
+            continue;
+        }
+
+        copyWords(reinterpret_cast<uint32_t*>(outMetadata),
+                  reinterpret_cast<const uint32_t*>(&slot->metadata));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// static
+std::unique_ptr<FrameMetadataMapping> FrameMetadataMapping::create(
+        const V1_0::BufferTraits& bufferTraits) {
+    const native_handle_t* bufferInfo = bufferTraits.bufferInfo.getNativeHandle();
+    if (bufferInfo == nullptr || bufferInfo->numFds < 1 ||
+        bufferInfo->numFds + bufferInfo->numInts <= kUserMetadataSizeIndex) {
+        ALOGE("Invalid buffer info");
+        return nullptr;
+    }
+
+    const uint32_t userMetadataSize =
+            static_cast<uint32_t>(bufferInfo->data[kUserMetadataSizeIndex]);
+    if (userMetadataSize < sizeof(FrameMetadataSlot)) {
+        return nullptr;
+    }
+
+    const size_t size = kMetadataHeaderSize + userMetadataSize;
+    void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         bufferInfo->data[kMetadataFdIndex], 0);
+    if (address == MAP_FAILED) {
+        ALOGE("Failed to map buffer metadata: %s", strerror(errno));
+        return nullptr;
+    }
+    return std::unique_ptr<FrameMetadataMapping>(new FrameMetadataMapping(address, size));
+}
+
+FrameMetadataMapping::FrameMetadataMapping(void* address, size_t size)
+    : mAddress(address),
+      mSize(size),
+      mSlot(reinterpret_cast<FrameMetadataSlot*>(static_cast<uint8_t*>(address) +
+                                                 kMetadataHeaderSize)) {}
+
+FrameMetadataMapping::~FrameMetadataMapping() {
+    munmap(mAddress, mSize);
+}
+
+}  // namespace utils
+}  // namespace V1_1
+}  // namespace bufferhub
+}  // namespace frameworks
+}  // namespace android
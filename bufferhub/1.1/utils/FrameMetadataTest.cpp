@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LocalBufferHub.h"
+
+#include <android/hardware_buffer.h>
+#include <bufferhub/FrameMetadata.h>
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+
+namespace android {
+namespace frameworks {
+namespace bufferhub {
+namespace vts {
+
+using ::android::frameworks::bufferhub::V1_1::FrameMetadata;
+using ::android::frameworks::bufferhub::V1_1::FrameMetadataSlot;
+using ::android::frameworks::bufferhub::V1_1::HdrMetadataType;
+using ::android::frameworks::bufferhub::V1_1::utils::FrameMetadataMapping;
+using ::android::frameworks::bufferhub::V1_1::utils::kMetadataHeaderSize;
+using ::android::hardware::graphics::common::V1_2::Dataspace;
+
+const AHardwareBuffer_Desc kDesc = {
+    /*width=*/64UL,  /*height=*/64UL,
+    /*layers=*/1,    /*format=*/AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM,
+    /*usage=*/0ULL,  /*stride=*/0UL,
+    /*rfu0=*/0UL,    /*rfu1=*/0ULL};
+
+static_assert(sizeof(MetadataHeader) == kMetadataHeaderSize,
+              "the stand-in must lay out metadata like the service");
+
+// Metadata of frame |frameNumber|, with every field derived from it so that
+// a torn copy does not match any frame.
+FrameMetadata makeFrameMetadata(uint64_t frameNumber) {
+    const int32_t n = static_cast<int32_t>(frameNumber);
+    const float f = static_cast<float>(n);
+
+    FrameMetadata metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    metadata.timestamp = static_cast<int64_t>(frameNumber) * 16666667;
+    metadata.frameNumber = frameNumber;
+    metadata.cropLeft = n;
+    metadata.cropTop = n + 1;
+    metadata.cropRight = n + 1920;
+    metadata.cropBottom = n + 1080;
+    metadata.dataspace = static_cast<Dataspace>(n);
+    metadata.transform = static_cast<uint32_t>(n) * 3;
+    metadata.hdrMetadataTypes = HdrMetadataType::SMPTE2086 | HdrMetadataType::CTA861_3;
+    metadata.smpte2086.displayPrimaryRed = {f, f + 1};
+    metadata.smpte2086.displayPrimaryGreen = {f + 2, f + 3};
+    metadata.smpte2086.displayPrimaryBlue = {f + 4, f + 5};
+    metadata.smpte2086.whitePoint = {f + 6, f + 7};
+    metadata.smpte2086.maxLuminance = f + 8;
+    metadata.smpte2086.minLuminance = f + 9;
+    metadata.cta8613.maxContentLightLevel = f + 10;
+    metadata.cta8613.maxFrameAverageLightLevel = f + 11;
+    return metadata;
+}
+
+class FrameMetadataTest : public ::testing::Test {
+   protected:
+    void allocate(uint32_t userMetadataSize) {
+        HardwareBufferDescription desc;
+        memcpy(&desc, &kDesc, sizeof(HardwareBufferDescription));
+        ASSERT_EQ(BufferHubStatus::NO_ERROR,
+                  mBufferHub.allocateBuffer(desc, userMetadataSize, &mTraits));
+    }
+
+    LocalBufferHub mBufferHub;
+    BufferTraits mTraits;
+};
+
+TEST_F(FrameMetadataTest, NoSlotWithoutRoom) {
+    allocate(sizeof(FrameMetadataSlot) - 1);
+    EXPECT_EQ(nullptr, FrameMetadataMapping::create(mTraits));
+}
+
+TEST_F(FrameMetadataTest, ConsumerReadsProducerWrite) {
+    allocate(sizeof(FrameMetadataSlot));
+    BufferTraits consumerTraits;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, LocalBufferHub::importBuffer(mTraits, &consumerTraits));
+
+    std::unique_ptr<FrameMetadataMapping> producer = FrameMetadataMapping::create(mTraits);
+    std::unique_ptr<FrameMetadataMapping> consumer = FrameMetadataMapping::create(consumerTraits);
+    ASSERT_NE(nullptr, producer);
+    ASSERT_NE(nullptr, consumer);
+
+    // The slot is the start of the user metadata.
+    LocalBufferClient client(consumerTraits);
+    ASSERT_TRUE(client.isValid());
+    EXPECT_EQ(0, memcmp(client.userMetadata(), consumer->slot(), sizeof(FrameMetadataSlot)));
+
+    for (uint64_t frameNumber = 1; frameNumber <= 3; ++frameNumber) {
+        const FrameMetadata expected = makeFrameMetadata(frameNumber);
+        producer->write(expected);
+        EXPECT_EQ(frameNumber * 2, consumer->slot()->sequence);
+
+        FrameMetadata metadata;
+        ASSERT_TRUE(consumer->read(&metadata));
+        EXPECT_EQ(0, memcmp(&expected, &metadata, sizeof(metadata)));
+    }
+}
+
+// A producer process writes frames as fast as it can while this process
+// reads them. Every copy read must be the metadata of a single frame.
+TEST_F(FrameMetadataTest, NoTornReadsAcrossProcesses) {
+    constexpr uint64_t kFrameCount = 200000;
+
+    allocate(sizeof(FrameMetadataSlot));
+    std::unique_ptr<FrameMetadataMapping> consumer = FrameMetadataMapping::create(mTraits);
+    ASSERT_NE(nullptr, consumer);
+
+    const pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        {
+            std::unique_ptr<FrameMetadataMapping> producer = FrameMetadataMapping::create(mTraits);
+            for (uint64_t frameNumber = 1; producer != nullptr && frameNumber <= kFrameCount;
+                 ++frameNumber) {
+                producer->write(makeFrameMetadata(frameNumber));
+            }
+        }
+        _exit(0);
+    }
+
+    uint64_t lastFrameNumber = 0;
+    size_t readCount = 0;
+    bool exited = false;
+    int status = 0;
+    while (lastFrameNumber < kFrameCount) {
+        // The last frame stays in the slot, so the read following the exit
+        // of the producer sees it unless the producer failed or died.
+        ASSERT_FALSE(exited) << "producer stopped after frame " << lastFrameNumber;
+        exited = waitpid(pid, &status, WNOHANG) == pid;
+
+        FrameMetadata metadata;
+        // Frame 0 is the slot before the first write.
+        if (!consumer->read(&metadata) || metadata.frameNumber == 0) {
+            continue;
+        }
+        ++readCount;
+        const FrameMetadata expected = makeFrameMetadata(metadata.frameNumber);
+        ASSERT_EQ(0, memcmp(&expected, &metadata, sizeof(metadata))) << metadata.frameNumber;
+        ASSERT_GE(metadata.frameNumber, lastFrameNumber);
+        lastFrameNumber = metadata.frameNumber;
+    }
+    EXPECT_GT(readCount, 0U);
+
+    if (!exited) {
+        ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    }
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+}  // namespace vts
+}  // namespace bufferhub
+}  // namespace frameworks
+}  // namespace android
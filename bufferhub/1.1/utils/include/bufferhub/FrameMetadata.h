@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FRAMEWORKS_BUFFERHUB_V1_1_FRAME_METADATA_H
+#define ANDROID_FRAMEWORKS_BUFFERHUB_V1_1_FRAME_METADATA_H
+
+#include <android/frameworks/bufferhub/1.0/types.h>
+#include <android/frameworks/bufferhub/1.1/types.h>
+
+#include <stddef.h>
+
+#include <memory>
+
+namespace android {
+namespace frameworks {
+namespace bufferhub {
+namespace V1_1 {
+namespace utils {
+
+// Size of the header the service keeps at the start of the metadata of each
+// buffer, before the user metadata. See MetadataHeader in ui/BufferHubDefs.h.
+constexpr size_t kMetadataHeaderSize = 128;
+
+// Writes |metadata| to |slot|. Must only be called by the client holding the
+// buffer gained.
+void writeFrameMetadata(FrameMetadataSlot* slot, const FrameMetadata& metadata);
+
+// Copies the metadata of |slot| to |outMetadata|. Returns false if no
+// consistent copy could be taken, e.g. because the writer died mid-write.
+bool readFrameMetadata(const FrameMetadataSlot* slot, FrameMetadata* outMetadata);
+
+// The frame metadata slot of a buffer, mapped into this process. Reads and
+// writes go straight to the shared memory.
+class FrameMetadataMapping {
+   public:
+    // Maps the slot of the buffer described by |bufferTraits|. Returns
+    // nullptr if its user metadata has no room for a slot.
+    static std::unique_ptr<FrameMetadataMapping> create(const V1_0::BufferTraits& bufferTraits);
+
+    ~FrameMetadataMapping();
+
+    FrameMetadataSlot* slot() const { return mSlot; }
+
+    void write(const FrameMetadata& metadata) { writeFrameMetadata(mSlot, metadata); }
+    bool read(FrameMetadata* outMetadata) const { return readFrameMetadata(mSlot, outMetadata); }
+
+   private:
+    FrameMetadataMapping(void* address, size_t size);
+
+    void* mAddress;
+    size_t mSize;
+    FrameMetadataSlot* mSlot;
+
+    FrameMetadataMapping(const FrameMetadataMapping&) = delete;
+    FrameMetadataMapping& operator=(const FrameMetadataMapping&) = delete;
+};
+
+}  // namespace utils
+}  // namespace V1_1
+}  // namespace bufferhub
+}  // namespace frameworks
+}  // namespace android
+
+#endif  // ANDROID_FRAMEWORKS_BUFFERHUB_V1_1_FRAME_METADATA_H
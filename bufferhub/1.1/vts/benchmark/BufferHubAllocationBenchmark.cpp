@@ -0,0 +1,388 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android/frameworks/bufferhub/1.1/IBufferClient.h>
+#include <android/frameworks/bufferhub/1.1/IBufferHub.h>
+#include <android/frameworks/bufferhub/1.1/IBufferPool.h>
+#include <android/hardware_buffer.h>
+#include <benchmark/benchmark.h>
+
+#include <string.h>
+
+#include <vector>
+
+using ::android::sp;
+using ::android::frameworks::bufferhub::V1_0::IBufferClient;
+using ::android::frameworks::bufferhub::V1_1::BufferHubStatus;
+using ::android::frameworks::bufferhub::V1_1::IBufferHub;
+using ::android::frameworks::bufferhub::V1_1::IBufferPool;
+using ::android::frameworks::bufferhub::V1_1::ReclaimStats;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::graphics::common::V1_2::HardwareBufferDescription;
+
+using V1_0_BufferHubStatus = ::android::frameworks::bufferhub::V1_0::BufferHubStatus;
+using V1_1_IBufferClient = ::android::frameworks::bufferhub::V1_1::IBufferClient;
+
+namespace {
+
+// A 1080p frame, as churned through by video and camera pipelines.
+const AHardwareBuffer_Desc kDesc = {
+    /*width=*/1920UL, /*height=*/1080UL,
+    /*layers=*/1,     /*format=*/AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM,
+    /*usage=*/AHARDWAREBUFFER_USAGE_CPU_READ_RARELY | AHARDWAREBUFFER_USAGE_CPU_WRITE_RARELY,
+    /*stride=*/0UL,   /*rfu0=*/0UL, /*rfu1=*/0ULL};
+const uint32_t kUserMetadataSize = 64;
+
+HardwareBufferDescription makeDescription() {
+    HardwareBufferDescription desc;
+    memcpy(&desc, &kDesc, sizeof(HardwareBufferDescription));
+    return desc;
+}
+
+sp<IBufferHub> getBufferHub(benchmark::State& state) {
+    sp<IBufferHub> bufferHub = IBufferHub::getService();
+    if (bufferHub == nullptr) {
+        state.SkipWithError("IBufferHub@1.1 service not available");
+    }
+    return bufferHub;
+}
+
+// Each iteration allocates a buffer and frees it, as without a pool.
+void BM_AllocateAndClose(benchmark::State& state) {
+    sp<IBufferHub> bufferHub = getBufferHub(state);
+    if (bufferHub == nullptr) {
+        return;
+    }
+    const HardwareBufferDescription desc = makeDescription();
+
+    for (auto _ : state) {
+        sp<IBufferClient> client;
+        bufferHub->allocateBuffer(desc, kUserMetadataSize,
+                                  [&](const auto& status, const auto& outClient,
+                                      const auto& /*traits*/) {
+                                      if (status == V1_0_BufferHubStatus::NO_ERROR) {
+                                          client = outClient;
+                                      }
+                                  });
+        if (client == nullptr) {
+            state.SkipWithError("allocateBuffer failed");
+            break;
+        }
+        client->close();
+    }
+}
+BENCHMARK(BM_AllocateAndClose);
+
+// Each iteration takes a buffer from a pool and gives it back.
+void BM_AcquireAndRelease(benchmark::State& state) {
+    sp<IBufferHub> bufferHub = getBufferHub(state);
+    if (bufferHub == nullptr) {
+        return;
+    }
+
+    sp<IBufferPool> pool;
+    bufferHub->createBufferPool(makeDescription(), kUserMetadataSize, /*minCount=*/2,
+                                /*maxCount=*/4,
+                                [&](const auto& status, const auto& outPool) {
+                                    if (status == BufferHubStatus::NO_ERROR) {
+                                        pool = outPool;
+                                    }
+                                });
+    if (pool == nullptr) {
+        state.SkipWithError("createBufferPool failed");
+        return;
+    }
+
+    for (auto _ : state) {
+        sp<IBufferClient> client;
+        pool->acquire([&](const auto& status, const auto& outClient, const auto& /*traits*/) {
+            if (status == BufferHubStatus::NO_ERROR) {
+                client = outClient;
+            }
+        });
+        if (client == nullptr) {
+            state.SkipWithError("acquire failed");
+            break;
+        }
+        pool->release(client);
+    }
+
+    pool->close();
+}
+BENCHMARK(BM_AcquireAndRelease);
+
+// Allocates a buffer outside of the timed region, for the close benchmarks.
+sp<V1_1_IBufferClient> allocateUntimed(benchmark::State& state, const sp<IBufferHub>& bufferHub,
+                                       const HardwareBufferDescription& desc) {
+    state.PauseTiming();
+    sp<IBufferClient> client;
+    bufferHub->allocateBuffer(desc, kUserMetadataSize,
+                              [&](const auto& status, const auto& outClient,
+                                  const auto& /*traits*/) {
+                                  if (status == V1_0_BufferHubStatus::NO_ERROR) {
+                                      client = outClient;
+                                  }
+                              });
+    state.ResumeTiming();
+    return client == nullptr ? nullptr : V1_1_IBufferClient::castFrom(client);
+}
+
+// Time the caller spends in close, which frees the buffer before returning.
+void BM_Close(benchmark::State& state) {
+    sp<IBufferHub> bufferHub = getBufferHub(state);
+    if (bufferHub == nullptr) {
+        return;
+    }
+    const HardwareBufferDescription desc = makeDescription();
+
+    for (auto _ : state) {
+        sp<V1_1_IBufferClient> client = allocateUntimed(state, bufferHub, desc);
+        if (client == nullptr) {
+            state.SkipWithError("allocateBuffer failed");
+            break;
+        }
+        client->close();
+    }
+}
+BENCHMARK(BM_Close);
+
+// Time the caller spends in closeDeferred, which leaves freeing the buffer
+// to the service. The pendingFreeBytes counter is the memory still waiting
+// to be freed when the run ends.
+void BM_CloseDeferred(benchmark::State& state) {
+    sp<IBufferHub> bufferHub = getBufferHub(state);
+    if (bufferHub == nullptr) {
+        return;
+    }
+    const HardwareBufferDescription desc = makeDescription();
+
+    for (auto _ : state) {
+        sp<V1_1_IBufferClient> client = allocateUntimed(state, bufferHub, desc);
+        if (client == nullptr) {
+            state.SkipWithError("allocateBuffer failed");
+            break;
+        }
+        client->closeDeferred();
+    }
+
+    ReclaimStats stats = {};
+    bufferHub->getReclaimStats([&](const auto& outStats) { stats = outStats; });
+    state.counters["pendingFreeBytes"] = static_cast<double>(stats.pendingFreeBytes);
+}
+BENCHMARK(BM_CloseDeferred);
+
+// Closes |clients| outside of the timed region.
+template <typename Clients>
+void closeUntimed(benchmark::State& state, Clients* clients) {
+    state.PauseTiming();
+    for (auto& client : *clients) {
+        if (client != nullptr) {
+            client->close();
+        }
+        client.clear();
+    }
+    state.ResumeTiming();
+}
+
+// Sets up as many buffers as a stream with one allocateBuffer call each.
+void BM_AllocateBuffersSequentially(benchmark::State& state) {
+    sp<IBufferHub> bufferHub = getBufferHub(state);
+    if (bufferHub == nullptr) {
+        return;
+    }
+    const HardwareBufferDescription desc = makeDescription();
+    std::vector<sp<IBufferClient>> clients(state.range(0));
+
+    for (auto _ : state) {
+        bool failed = false;
+        for (auto& client : clients) {
+            bufferHub->allocateBuffer(desc, kUserMetadataSize,
+                                      [&](const auto& status, const auto& outClient,
+                                          const auto& /*traits*/) {
+                                          if (status == V1_0_BufferHubStatus::NO_ERROR) {
+                                              client = outClient;
+                                          }
+                                      });
+            if (client == nullptr) {
+                failed = true;
+                break;
+            }
+        }
+
+        closeUntimed(state, &clients);
+        if (failed) {
+            state.SkipWithError("allocateBuffer failed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_AllocateBuffersSequentially)->RangeMultiplier(4)->Range(1, 64);
+
+// Sets up the same buffers with a single allocateBuffers call.
+void BM_AllocateBuffersBatched(benchmark::State& state) {
+    sp<IBufferHub> bufferHub = getBufferHub(state);
+    if (bufferHub == nullptr) {
+        return;
+    }
+    const HardwareBufferDescription desc = makeDescription();
+
+    for (auto _ : state) {
+        hidl_vec<sp<IBufferClient>> clients;
+        bufferHub->allocateBuffers(desc, kUserMetadataSize, state.range(0),
+                                   [&](const auto& status, const auto& outClients,
+                                       const auto& /*traits*/) {
+                                       if (status == BufferHubStatus::NO_ERROR) {
+                                           clients = outClients;
+                                       }
+                                   });
+        if (clients.size() == 0) {
+            state.SkipWithError("allocateBuffers failed");
+            break;
+        }
+
+        closeUntimed(state, &clients);
+    }
+}
+BENCHMARK(BM_AllocateBuffersBatched)->RangeMultiplier(4)->Range(1, 64);
+
+// Allocates the |count| buffers shared by the import benchmarks.
+bool allocateOwners(const sp<IBufferHub>& bufferHub, size_t count,
+                    hidl_vec<sp<IBufferClient>>* owners) {
+    bufferHub->allocateBuffers(makeDescription(), kUserMetadataSize, count,
+                               [&](const auto& status, const auto& outClients,
+                                   const auto& /*traits*/) {
+                                   if (status == BufferHubStatus::NO_ERROR) {
+                                       *owners = outClients;
+                                   }
+                               });
+    return owners->size() == count;
+}
+
+// Duplicates a token for each of |owners| outside of the timed region.
+// Importing a token consumes it, so every iteration needs fresh ones.
+bool duplicateTokensUntimed(benchmark::State& state, const hidl_vec<sp<IBufferClient>>& owners,
+                            hidl_vec<hidl_handle>* tokens) {
+    state.PauseTiming();
+    bool ok = true;
+    tokens->resize(owners.size());
+    for (size_t i = 0; i < owners.size() && ok; ++i) {
+        (*tokens)[i] = hidl_handle();
+        owners[i]->duplicate([&](const auto& outToken, const auto& status) {
+            if (status == V1_0_BufferHubStatus::NO_ERROR) {
+                (*tokens)[i] = outToken;
+            }
+        });
+        ok = (*tokens)[i].getNativeHandle() != nullptr;
+    }
+    state.ResumeTiming();
+    return ok;
+}
+
+void closeOwners(const hidl_vec<sp<IBufferClient>>& owners) {
+    for (const auto& owner : owners) {
+        owner->close();
+    }
+}
+
+// Shares a stream's buffers with one importBuffer call each.
+void BM_ImportBuffersSequentially(benchmark::State& state) {
+    sp<IBufferHub> bufferHub = getBufferHub(state);
+    if (bufferHub == nullptr) {
+        return;
+    }
+    hidl_vec<sp<IBufferClient>> owners;
+    if (!allocateOwners(bufferHub, state.range(0), &owners)) {
+        state.SkipWithError("allocateBuffers failed");
+        closeOwners(owners);
+        return;
+    }
+    hidl_vec<hidl_handle> tokens;
+    std::vector<sp<IBufferClient>> clients(owners.size());
+
+    for (auto _ : state) {
+        if (!duplicateTokensUntimed(state, owners, &tokens)) {
+            state.SkipWithError("duplicate failed");
+            break;
+        }
+
+        bool failed = false;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            bufferHub->importBuffer(tokens[i], [&](const auto& status, const auto& outClient,
+                                                   const auto& /*traits*/) {
+                if (status == V1_0_BufferHubStatus::NO_ERROR) {
+                    clients[i] = outClient;
+                }
+            });
+            if (clients[i] == nullptr) {
+                failed = true;
+                break;
+            }
+        }
+
+        closeUntimed(state, &clients);
+        if (failed) {
+            state.SkipWithError("importBuffer failed");
+            break;
+        }
+    }
+
+    closeOwners(owners);
+}
+BENCHMARK(BM_ImportBuffersSequentially)->RangeMultiplier(4)->Range(1, 64);
+
+// Shares the same buffers with a single importBuffers call.
+void BM_ImportBuffersBatched(benchmark::State& state) {
+    sp<IBufferHub> bufferHub = getBufferHub(state);
+    if (bufferHub == nullptr) {
+        return;
+    }
+    hidl_vec<sp<IBufferClient>> owners;
+    if (!allocateOwners(bufferHub, state.range(0), &owners)) {
+        state.SkipWithError("allocateBuffers failed");
+        closeOwners(owners);
+        return;
+    }
+    hidl_vec<hidl_handle> tokens;
+
+    for (auto _ : state) {
+        if (!duplicateTokensUntimed(state, owners, &tokens)) {
+            state.SkipWithError("duplicate failed");
+            break;
+        }
+
+        hidl_vec<sp<IBufferClient>> clients;
+        bufferHub->importBuffers(tokens, [&](const auto& status, const auto& outClients,
+                                             const auto& /*traits*/) {
+            if (status == BufferHubStatus::NO_ERROR) {
+                clients = outClients;
+            }
+        });
+        if (clients.size() != tokens.size()) {
+            state.SkipWithError("importBuffers failed");
+            break;
+        }
+
+        closeUntimed(state, &clients);
+    }
+
+    closeOwners(owners);
+}
+BENCHMARK(BM_ImportBuffersBatched)->RangeMultiplier(4)->Range(1, 64);
+
+}  // namespace
+
+BENCHMARK_MAIN();
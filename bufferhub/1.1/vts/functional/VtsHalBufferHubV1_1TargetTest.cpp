@@ -0,0 +1,550 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VtsHalBufferHubV1_1TargetTest"
+
+#include <VtsHalHidlTargetTestBase.h>
+#include <android-base/logging.h>
+#include <android/frameworks/bufferhub/1.1/IBufferClient.h>
+#include <android/frameworks/bufferhub/1.1/IBufferHub.h>
+#include <android/frameworks/bufferhub/1.1/IBufferPool.h>
+#include <android/hardware_buffer.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+using ::android::frameworks::bufferhub::V1_0::BufferTraits;
+using ::android::frameworks::bufferhub::V1_0::IBufferClient;
+using ::android::frameworks::bufferhub::V1_1::BatchLimits;
+using ::android::frameworks::bufferhub::V1_1::BufferHubStatus;
+using ::android::frameworks::bufferhub::V1_1::BufferPoolStats;
+using ::android::frameworks::bufferhub::V1_1::IBufferHub;
+using ::android::frameworks::bufferhub::V1_1::IBufferPool;
+using ::android::frameworks::bufferhub::V1_1::ReclaimStats;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::graphics::common::V1_2::HardwareBufferDescription;
+
+using V1_0_BufferHubStatus = ::android::frameworks::bufferhub::V1_0::BufferHubStatus;
+using V1_1_IBufferClient = ::android::frameworks::bufferhub::V1_1::IBufferClient;
+
+namespace android {
+namespace frameworks {
+namespace bufferhub {
+namespace vts {
+
+// Stride is an output that unknown before allocation.
+const AHardwareBuffer_Desc kDesc = {
+    /*width=*/640UL, /*height=*/480UL,
+    /*layers=*/1,    /*format=*/AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM,
+    /*usage=*/0ULL,  /*stride=*/0UL,
+    /*rfu0=*/0UL,    /*rfu1=*/0ULL};
+const size_t kUserMetadataSize = 1;
+// How long the service may take to reclaim a buffer closed with closeDeferred.
+constexpr auto kReclaimTimeout = std::chrono::seconds(5);
+
+// Test environment for BufferHub HIDL HAL.
+class BufferHubHidlEnv : public ::testing::VtsHalHidlTargetTestEnvBase {
+   public:
+    // get the test environment singleton
+    static BufferHubHidlEnv* Instance() {
+        static BufferHubHidlEnv* instance = new BufferHubHidlEnv;
+        return instance;
+    }
+
+    void registerTestServices() override { registerTestService<IBufferHub>(); }
+
+   private:
+    BufferHubHidlEnv() {}
+};
+
+class HalBufferHubVts : public ::testing::VtsHalHidlTargetTestBase {
+   protected:
+    void SetUp() override {
+        VtsHalHidlTargetTestBase::SetUp();
+
+        mBufferHub = IBufferHub::getService();
+        ASSERT_NE(nullptr, mBufferHub.get());
+
+        memcpy(&mDesc, &kDesc, sizeof(HardwareBufferDescription));
+    }
+
+    BufferHubStatus createBufferPool(uint32_t minCount, uint32_t maxCount,
+                                     sp<IBufferPool>* pool) {
+        BufferHubStatus ret = BufferHubStatus::ALLOCATION_FAILED;
+        IBufferHub::createBufferPool_cb callback = [&](const auto& status,
+                                                       const auto& outPool) {
+            ret = status;
+            *pool = outPool;
+        };
+        EXPECT_TRUE(
+                mBufferHub->createBufferPool(mDesc, kUserMetadataSize, minCount, maxCount, callback)
+                        .isOk());
+        return ret;
+    }
+
+    BufferHubStatus allocateBuffers(uint32_t count, hidl_vec<sp<IBufferClient>>* clients,
+                                    hidl_vec<BufferTraits>* bufferTraits) {
+        BufferHubStatus ret = BufferHubStatus::ALLOCATION_FAILED;
+        IBufferHub::allocateBuffers_cb callback = [&](const auto& status, const auto& outClients,
+                                                      const auto& traits) {
+            ret = status;
+            *clients = outClients;
+            *bufferTraits = std::move(traits);
+        };
+        EXPECT_TRUE(mBufferHub->allocateBuffers(mDesc, kUserMetadataSize, count, callback).isOk());
+        return ret;
+    }
+
+    BufferHubStatus importBuffers(const hidl_vec<hidl_handle>& tokens,
+                                  hidl_vec<sp<IBufferClient>>* clients,
+                                  hidl_vec<BufferTraits>* bufferTraits) {
+        BufferHubStatus ret = BufferHubStatus::ALLOCATION_FAILED;
+        IBufferHub::importBuffers_cb callback = [&](const auto& status, const auto& outClients,
+                                                    const auto& traits) {
+            ret = status;
+            *clients = outClients;
+            *bufferTraits = std::move(traits);
+        };
+        EXPECT_TRUE(mBufferHub->importBuffers(tokens, callback).isOk());
+        return ret;
+    }
+
+    static BufferHubStatus acquire(const sp<IBufferPool>& pool, sp<IBufferClient>* client,
+                                   BufferTraits* bufferTraits) {
+        BufferHubStatus ret = BufferHubStatus::ALLOCATION_FAILED;
+        IBufferPool::acquire_cb callback = [&](const auto& status, const auto& outClient,
+                                               const auto& traits) {
+            ret = status;
+            *client = outClient;
+            *bufferTraits = std::move(traits);
+        };
+        EXPECT_TRUE(pool->acquire(callback).isOk());
+        return ret;
+    }
+
+    static BufferPoolStats getStats(const sp<IBufferPool>& pool) {
+        BufferPoolStats stats = {};
+        IBufferPool::getStats_cb callback = [&](const auto& status, const auto& outStats) {
+            EXPECT_EQ(status, BufferHubStatus::NO_ERROR);
+            stats = outStats;
+        };
+        EXPECT_TRUE(pool->getStats(callback).isOk());
+        return stats;
+    }
+
+    ReclaimStats getReclaimStats() {
+        ReclaimStats stats = {};
+        IBufferHub::getReclaimStats_cb callback = [&](const auto& outStats) { stats = outStats; };
+        EXPECT_TRUE(mBufferHub->getReclaimStats(callback).isOk());
+        return stats;
+    }
+
+    sp<V1_1_IBufferClient> allocateBuffer() {
+        sp<IBufferClient> client;
+        IBufferHub::allocateBuffer_cb callback = [&](const auto& status, const auto& outClient,
+                                                     const auto& /*traits*/) {
+            EXPECT_EQ(V1_0_BufferHubStatus::NO_ERROR, status);
+            client = outClient;
+        };
+        EXPECT_TRUE(mBufferHub->allocateBuffer(mDesc, kUserMetadataSize, callback).isOk());
+        if (client == nullptr) {
+            return nullptr;
+        }
+        return V1_1_IBufferClient::castFrom(client);
+    }
+
+    sp<IBufferHub> mBufferHub;
+    HardwareBufferDescription mDesc;
+};
+
+int bufferId(const BufferTraits& bufferTraits) {
+    return bufferTraits.bufferInfo->data[2];
+}
+
+// Helper function to verify that given bufferTrais is consistent with kDesc
+// and has a gralloc handle and a buffer info handle. The structure of
+// BufferTraits.bufferInfo handle is defined in ui/BufferHubDefs.h
+bool isValidTraits(const BufferTraits& bufferTraits) {
+    AHardwareBuffer_Desc desc;
+    memcpy(&desc, &bufferTraits.bufferDesc, sizeof(AHardwareBuffer_Desc));
+
+    const native_handle_t* bufferInfo = bufferTraits.bufferInfo.getNativeHandle();
+    if (bufferInfo == nullptr) {
+        return false;
+    }
+    uint32_t userMetadataSize;
+    memcpy(&userMetadataSize, &bufferInfo->data[4], sizeof(userMetadataSize));
+
+    // Not comparing stride because it's unknown before allocation
+    return desc.format == kDesc.format && desc.height == kDesc.height &&
+           desc.layers == kDesc.layers && desc.usage == kDesc.usage && desc.width == kDesc.width &&
+           bufferTraits.bufferHandle.getNativeHandle() != nullptr && bufferInfo->data[0] >= 0 &&
+           bufferInfo->data[1] >= 0 && bufferId(bufferTraits) >= 0 &&
+           userMetadataSize == kUserMetadataSize;
+}
+
+// Test IBufferHub::createBufferPool with counts out of range
+TEST_F(HalBufferHubVts, CreateBufferPoolWithInvalidCounts) {
+    sp<IBufferPool> pool;
+    EXPECT_EQ(BufferHubStatus::INVALID_ARGUMENT,
+              createBufferPool(/*minCount=*/0, /*maxCount=*/0, &pool));
+    EXPECT_EQ(nullptr, pool.get());
+    EXPECT_EQ(BufferHubStatus::INVALID_ARGUMENT,
+              createBufferPool(/*minCount=*/3, /*maxCount=*/2, &pool));
+    EXPECT_EQ(nullptr, pool.get());
+}
+
+// Test IBufferPool::acquire then IBufferPool::release
+TEST_F(HalBufferHubVts, AcquireAndReleaseBuffer) {
+    sp<IBufferPool> pool;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, createBufferPool(/*minCount=*/1, /*maxCount=*/4, &pool));
+    ASSERT_NE(nullptr, pool.get());
+
+    sp<IBufferClient> client;
+    BufferTraits bufferTraits = {};
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, acquire(pool, &client, &bufferTraits));
+    ASSERT_NE(nullptr, client.get());
+    EXPECT_TRUE(isValidTraits(bufferTraits));
+    EXPECT_EQ(1U, getStats(pool).inUseCount);
+
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, pool->release(client));
+    EXPECT_EQ(BufferHubStatus::CLIENT_CLOSED, pool->release(client));
+    EXPECT_EQ(V1_0_BufferHubStatus::CLIENT_CLOSED, client->close());
+    EXPECT_EQ(0U, getStats(pool).inUseCount);
+
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->close());
+}
+
+// Test that a released buffer is handed out again instead of a new one
+TEST_F(HalBufferHubVts, RecycleReleasedBuffer) {
+    sp<IBufferPool> pool;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, createBufferPool(/*minCount=*/1, /*maxCount=*/1, &pool));
+
+    sp<IBufferClient> client;
+    BufferTraits bufferTraits = {};
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, acquire(pool, &client, &bufferTraits));
+    const int firstBufferId = bufferId(bufferTraits);
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, pool->release(client));
+
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, acquire(pool, &client, &bufferTraits));
+    EXPECT_TRUE(isValidTraits(bufferTraits));
+    EXPECT_EQ(firstBufferId, bufferId(bufferTraits));
+
+    const BufferPoolStats stats = getStats(pool);
+    EXPECT_EQ(2U, stats.recycledCount + stats.allocatedCount);
+    EXPECT_GE(stats.recycledCount, 1U);
+
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->release(client));
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->close());
+}
+
+// Test that no more than maxCount buffers can be in use
+TEST_F(HalBufferHubVts, AcquireFromExhaustedPool) {
+    sp<IBufferPool> pool;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, createBufferPool(/*minCount=*/0, /*maxCount=*/2, &pool));
+
+    sp<IBufferClient> clients[3];
+    BufferTraits bufferTraits = {};
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, acquire(pool, &clients[0], &bufferTraits));
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, acquire(pool, &clients[1], &bufferTraits));
+    EXPECT_EQ(BufferHubStatus::POOL_EXHAUSTED, acquire(pool, &clients[2], &bufferTraits));
+    EXPECT_EQ(nullptr, clients[2].get());
+
+    // Closing the client directly also gives the buffer back to the pool.
+    ASSERT_EQ(V1_0_BufferHubStatus::NO_ERROR, clients[0]->close());
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, acquire(pool, &clients[2], &bufferTraits));
+    EXPECT_TRUE(isValidTraits(bufferTraits));
+
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->release(clients[1]));
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->release(clients[2]));
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->close());
+}
+
+// Test IBufferPool::release with a client allocated outside of the pool
+TEST_F(HalBufferHubVts, ReleaseBufferNotFromPool) {
+    sp<IBufferPool> pool;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, createBufferPool(/*minCount=*/0, /*maxCount=*/1, &pool));
+
+    V1_0_BufferHubStatus ret;
+    sp<IBufferClient> client;
+    IBufferHub::allocateBuffer_cb callback = [&](const auto& status, const auto& outClient,
+                                                 const auto& /*traits*/) {
+        ret = status;
+        client = outClient;
+    };
+    ASSERT_TRUE(mBufferHub->allocateBuffer(mDesc, kUserMetadataSize, callback).isOk());
+    ASSERT_EQ(V1_0_BufferHubStatus::NO_ERROR, ret);
+
+    EXPECT_EQ(BufferHubStatus::NOT_FROM_POOL, pool->release(client));
+    EXPECT_EQ(V1_0_BufferHubStatus::NO_ERROR, client->close());
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->close());
+}
+
+// Test IBufferPool::trim below minCount
+TEST_F(HalBufferHubVts, TrimIdleBuffers) {
+    sp<IBufferPool> pool;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, createBufferPool(/*minCount=*/2, /*maxCount=*/4, &pool));
+    EXPECT_EQ(2U, getStats(pool).idleCount);
+
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, pool->trim(/*maxIdleCount=*/0));
+    BufferPoolStats stats = getStats(pool);
+    EXPECT_EQ(0U, stats.idleCount);
+    EXPECT_EQ(2U, stats.trimmedCount);
+
+    // The pool allocates again on demand.
+    sp<IBufferClient> client;
+    BufferTraits bufferTraits = {};
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, acquire(pool, &client, &bufferTraits));
+    EXPECT_TRUE(isValidTraits(bufferTraits));
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->release(client));
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->close());
+}
+
+// Test that buffers in use outlive a closed pool
+TEST_F(HalBufferHubVts, ClosePoolWithBufferInUse) {
+    sp<IBufferPool> pool;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, createBufferPool(/*minCount=*/1, /*maxCount=*/2, &pool));
+
+    sp<IBufferClient> client;
+    BufferTraits bufferTraits = {};
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, acquire(pool, &client, &bufferTraits));
+
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, pool->close());
+    EXPECT_EQ(BufferHubStatus::POOL_CLOSED, pool->close());
+    EXPECT_EQ(BufferHubStatus::POOL_CLOSED, pool->trim(/*maxIdleCount=*/0));
+
+    sp<IBufferClient> client2;
+    EXPECT_EQ(BufferHubStatus::POOL_CLOSED, acquire(pool, &client2, &bufferTraits));
+    EXPECT_EQ(nullptr, client2.get());
+
+    hidl_handle token;
+    V1_0_BufferHubStatus ret;
+    IBufferClient::duplicate_cb dupCb = [&](const auto& outToken, const auto& status) {
+        token = outToken;
+        ret = status;
+    };
+    ASSERT_TRUE(client->duplicate(dupCb).isOk());
+    EXPECT_EQ(V1_0_BufferHubStatus::NO_ERROR, ret);
+
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->release(client));
+}
+
+// Test IBufferHub::allocateBuffers then IBufferClient::close
+TEST_F(HalBufferHubVts, AllocateBuffers) {
+    constexpr uint32_t kCount = 4;
+
+    hidl_vec<sp<IBufferClient>> clients;
+    hidl_vec<BufferTraits> bufferTraits;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, allocateBuffers(kCount, &clients, &bufferTraits));
+    ASSERT_EQ(kCount, clients.size());
+    ASSERT_EQ(kCount, bufferTraits.size());
+
+    for (uint32_t i = 0; i < kCount; ++i) {
+        EXPECT_NE(nullptr, clients[i].get());
+        EXPECT_TRUE(isValidTraits(bufferTraits[i]));
+        for (uint32_t j = 0; j < i; ++j) {
+            EXPECT_NE(bufferId(bufferTraits[i]), bufferId(bufferTraits[j]));
+        }
+    }
+
+    for (const auto& client : clients) {
+        EXPECT_EQ(V1_0_BufferHubStatus::NO_ERROR, client->close());
+    }
+}
+
+// Test IBufferHub::allocateBuffers with counts out of range
+TEST_F(HalBufferHubVts, AllocateBuffersWithInvalidCount) {
+    hidl_vec<sp<IBufferClient>> clients;
+    hidl_vec<BufferTraits> bufferTraits;
+    EXPECT_EQ(BufferHubStatus::INVALID_ARGUMENT, allocateBuffers(0, &clients, &bufferTraits));
+    EXPECT_EQ(0U, clients.size());
+    EXPECT_EQ(BufferHubStatus::INVALID_ARGUMENT,
+              allocateBuffers(static_cast<uint32_t>(BatchLimits::MAX_BATCH_COUNT) + 1, &clients,
+                              &bufferTraits));
+    EXPECT_EQ(0U, clients.size());
+}
+
+// Test duplicating a batch of buffers and importing them with IBufferHub::importBuffers
+TEST_F(HalBufferHubVts, DuplicateAndImportBuffers) {
+    constexpr uint32_t kCount = 3;
+
+    hidl_vec<sp<IBufferClient>> clients;
+    hidl_vec<BufferTraits> bufferTraits;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, allocateBuffers(kCount, &clients, &bufferTraits));
+
+    hidl_vec<hidl_handle> tokens;
+    tokens.resize(kCount);
+    for (uint32_t i = 0; i < kCount; ++i) {
+        V1_0_BufferHubStatus ret;
+        IBufferClient::duplicate_cb dupCb = [&](const auto& outToken, const auto& status) {
+            tokens[i] = outToken;
+            ret = status;
+        };
+        ASSERT_TRUE(clients[i]->duplicate(dupCb).isOk());
+        ASSERT_EQ(V1_0_BufferHubStatus::NO_ERROR, ret);
+    }
+
+    hidl_vec<sp<IBufferClient>> clients2;
+    hidl_vec<BufferTraits> bufferTraits2;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, importBuffers(tokens, &clients2, &bufferTraits2));
+    ASSERT_EQ(kCount, clients2.size());
+    ASSERT_EQ(kCount, bufferTraits2.size());
+
+    // In order, each is a new client of the buffer of the same index.
+    for (uint32_t i = 0; i < kCount; ++i) {
+        EXPECT_NE(nullptr, clients2[i].get());
+        EXPECT_TRUE(isValidTraits(bufferTraits2[i]));
+        EXPECT_EQ(bufferId(bufferTraits[i]), bufferId(bufferTraits2[i]));
+    }
+
+    for (uint32_t i = 0; i < kCount; ++i) {
+        EXPECT_EQ(V1_0_BufferHubStatus::NO_ERROR, clients[i]->close());
+        EXPECT_EQ(V1_0_BufferHubStatus::NO_ERROR, clients2[i]->close());
+    }
+}
+
+// Test IBufferHub::importBuffers with one bad token among valid ones
+TEST_F(HalBufferHubVts, ImportBuffersWithInvalidToken) {
+    hidl_vec<sp<IBufferClient>> clients;
+    hidl_vec<BufferTraits> bufferTraits;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, allocateBuffers(1, &clients, &bufferTraits));
+
+    hidl_vec<hidl_handle> tokens;
+    tokens.resize(2);
+    V1_0_BufferHubStatus ret;
+    IBufferClient::duplicate_cb dupCb = [&](const auto& outToken, const auto& status) {
+        tokens[0] = outToken;
+        ret = status;
+    };
+    ASSERT_TRUE(clients[0]->duplicate(dupCb).isOk());
+    ASSERT_EQ(V1_0_BufferHubStatus::NO_ERROR, ret);
+
+    native_handle_t* tokenHandle = native_handle_create(/*numFds=*/0, /*numInts=*/2);
+    tokenHandle->data[0] = 0;
+    // Assign a random number since we cannot know the HMAC value.
+    tokenHandle->data[1] = 42;
+    tokens[1].setTo(tokenHandle, /*shouldOwn=*/true);
+
+    hidl_vec<sp<IBufferClient>> clients2;
+    hidl_vec<BufferTraits> bufferTraits2;
+    EXPECT_EQ(BufferHubStatus::INVALID_TOKEN, importBuffers(tokens, &clients2, &bufferTraits2));
+    EXPECT_EQ(0U, clients2.size());
+    EXPECT_EQ(0U, bufferTraits2.size());
+
+    EXPECT_EQ(BufferHubStatus::INVALID_ARGUMENT,
+              importBuffers(hidl_vec<hidl_handle>(), &clients2, &bufferTraits2));
+
+    EXPECT_EQ(V1_0_BufferHubStatus::NO_ERROR, clients[0]->close());
+}
+
+// Test IBufferClient::closeDeferred on a client of a @1.1 service
+TEST_F(HalBufferHubVts, CloseDeferred) {
+    // Every client of a @1.1 service implements @1.1::IBufferClient.
+    sp<V1_1_IBufferClient> client = allocateBuffer();
+    ASSERT_NE(nullptr, client.get());
+
+    hidl_handle token;
+    V1_0_BufferHubStatus ret;
+    IBufferClient::duplicate_cb dupCb = [&](const auto& outToken, const auto& status) {
+        token = outToken;
+        ret = status;
+    };
+    ASSERT_TRUE(client->duplicate(dupCb).isOk());
+    ASSERT_EQ(V1_0_BufferHubStatus::NO_ERROR, ret);
+
+    // The client is closed as soon as the call returns.
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, client->closeDeferred());
+    EXPECT_EQ(BufferHubStatus::CLIENT_CLOSED, client->closeDeferred());
+    EXPECT_EQ(V1_0_BufferHubStatus::CLIENT_CLOSED, client->close());
+    ASSERT_TRUE(client->duplicate(dupCb).isOk());
+    EXPECT_EQ(V1_0_BufferHubStatus::CLIENT_CLOSED, ret);
+
+    IBufferHub::importBuffer_cb importCb = [&](const auto& status, const auto& /*outClient*/,
+                                               const auto& /*traits*/) { ret = status; };
+    ASSERT_TRUE(mBufferHub->importBuffer(token, importCb).isOk());
+    EXPECT_EQ(V1_0_BufferHubStatus::INVALID_TOKEN, ret);
+}
+
+// Test that buffers closed with IBufferClient::closeDeferred are reclaimed
+TEST_F(HalBufferHubVts, CloseDeferredReclaimsBuffers) {
+    constexpr uint32_t kCount = 4;
+
+    // Other clients of the service may close buffers concurrently, so only
+    // lower bounds of the counters are known.
+    const ReclaimStats before = getReclaimStats();
+    for (uint32_t i = 0; i < kCount; ++i) {
+        sp<V1_1_IBufferClient> client = allocateBuffer();
+        ASSERT_NE(nullptr, client.get());
+        ASSERT_EQ(BufferHubStatus::NO_ERROR, client->closeDeferred());
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + kReclaimTimeout;
+    ReclaimStats after = getReclaimStats();
+    while (after.freedCount + after.recycledCount <
+                   before.freedCount + before.recycledCount + kCount &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        after = getReclaimStats();
+    }
+    EXPECT_GE(after.freedCount + after.recycledCount,
+              before.freedCount + before.recycledCount + kCount);
+    EXPECT_GE(after.freedBytes, before.freedBytes);
+
+    // A pending buffer holds memory, and freed buffers give it back.
+    EXPECT_EQ(after.pendingFreeCount == 0, after.pendingFreeBytes == 0);
+    if (after.freedCount > before.freedCount) {
+        EXPECT_GT(after.freedBytes, before.freedBytes);
+    }
+}
+
+// Test that IBufferClient::closeDeferred gives a pool's buffer back to the pool
+TEST_F(HalBufferHubVts, CloseDeferredReleasesToPool) {
+    sp<IBufferPool> pool;
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, createBufferPool(/*minCount=*/0, /*maxCount=*/1, &pool));
+
+    sp<IBufferClient> client;
+    BufferTraits bufferTraits = {};
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, acquire(pool, &client, &bufferTraits));
+    sp<V1_1_IBufferClient> client11 = V1_1_IBufferClient::castFrom(client);
+    ASSERT_NE(nullptr, client11.get());
+    EXPECT_EQ(1U, getStats(pool).inUseCount);
+
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, client11->closeDeferred());
+    EXPECT_EQ(0U, getStats(pool).inUseCount);
+    EXPECT_EQ(BufferHubStatus::CLIENT_CLOSED, pool->release(client));
+
+    // The pool has room for another buffer again.
+    ASSERT_EQ(BufferHubStatus::NO_ERROR, acquire(pool, &client, &bufferTraits));
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->release(client));
+    EXPECT_EQ(BufferHubStatus::NO_ERROR, pool->close());
+}
+
+}  // namespace vts
+}  // namespace bufferhub
+}  // namespace frameworks
+}  // namespace android
+
+int main(int argc, char** argv) {
+    ::testing::AddGlobalTestEnvironment(
+        android::frameworks::bufferhub::vts::BufferHubHidlEnv::Instance());
+    ::testing::InitGoogleTest(&argc, argv);
+    android::frameworks::bufferhub::vts::BufferHubHidlEnv::Instance()->init(&argc, argv);
+    int status = RUN_ALL_TESTS();
+    LOG(INFO) << "Test result = " << status;
+    return status;
+}
@@ -17,27 +17,59 @@
 #include "ALooper.h"
 
 #include "ASensorEventQueue.h"
+#include "SensorDispatcher.h"
 
 #define LOG_TAG "libsensorndkbridge"
-#include <android/looper.h>
 #include <android-base/logging.h>
 
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using android::INVALID_OPERATION;
 using android::Mutex;
+using android::OK;
+using android::sp;
+using android::status_t;
+
+static uint32_t toEpollEvents(int events) {
+    uint32_t epollEvents = 0;
+    if (events & ALOOPER_EVENT_INPUT) { epollEvents |= EPOLLIN; }
+    if (events & ALOOPER_EVENT_OUTPUT) { epollEvents |= EPOLLOUT; }
+    return epollEvents;
+}
+
+static int fromEpollEvents(uint32_t epollEvents) {
+    int events = 0;
+    if (epollEvents & EPOLLIN) { events |= ALOOPER_EVENT_INPUT; }
+    if (epollEvents & EPOLLOUT) { events |= ALOOPER_EVENT_OUTPUT; }
+    if (epollEvents & EPOLLERR) { events |= ALOOPER_EVENT_ERROR; }
+    if (epollEvents & EPOLLHUP) { events |= ALOOPER_EVENT_HANGUP; }
+    return events;
+}
 
 ALooper::ALooper()
-    : mAwoken(false) {
+    : mEpollFd(epoll_create1(EPOLL_CLOEXEC)),
+      mWakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    CHECK(mEpollFd.get() >= 0) << "Could not create epoll instance: " << strerror(errno);
+    CHECK(mWakeFd.get() >= 0) << "Could not create wake eventfd: " << strerror(errno);
+
+    struct epoll_event item = {};
+    item.events = EPOLLIN;
+    item.data.fd = mWakeFd.get();
+    CHECK_EQ(epoll_ctl(mEpollFd.get(), EPOLL_CTL_ADD, mWakeFd.get(), &item), 0);
 }
 
-void ALooper::signalSensorEvents(ASensorEventQueue *queue) {
-    Mutex::Autolock autoLock(mLock);
-    mReadyQueues.insert(queue);
-    mCondition.signal();
+ALooper::~ALooper() {
+    if (mDispatcher != NULL) {
+        mDispatcher->stop();
+    }
 }
 
 void ALooper::wake() {
-    Mutex::Autolock autoLock(mLock);
-    mAwoken = true;
-    mCondition.signal();
+    eventfd_write(mWakeFd.get(), 1);
 }
 
 int ALooper::pollOnce(
@@ -46,39 +78,81 @@ int ALooper::pollOnce(
     if (outEvents) { *outEvents = 0; }
     if (outData) { *outData = NULL; }
 
-    int64_t waitUntilNs;
-    if (timeoutMillis < 0) {
-        waitUntilNs = -1;
-    } else {
-        waitUntilNs = systemTime(SYSTEM_TIME_MONOTONIC) + timeoutMillis * 1000000LL;
-    }
+    int result = ALOOPER_POLL_WAKE;
 
-    Mutex::Autolock autoLock(mLock);
-    int64_t nowNs;
-    while ((timeoutMillis < 0
-                || (nowNs = systemTime(SYSTEM_TIME_MONOTONIC)) < waitUntilNs)
-            && mReadyQueues.empty()
-            && !mAwoken) {
-        if (timeoutMillis < 0) {
-            mCondition.wait(mLock);
-        } else {
-            mCondition.waitRelative(mLock, waitUntilNs - nowNs);
+    if (mResponses.empty()) {
+        struct epoll_event items[kMaxEventsPerPoll];
+        int count = TEMP_FAILURE_RETRY(
+                epoll_wait(mEpollFd.get(), items, kMaxEventsPerPoll, timeoutMillis));
+
+        if (count < 0) {
+            PLOG(ERROR) << "epoll_wait failed";
+            return ALOOPER_POLL_ERROR;
+        } else if (count == 0) {
+            LOG(VERBOSE) << "pollOnce returning " << ALOOPER_POLL_TIMEOUT;
+            return ALOOPER_POLL_TIMEOUT;
         }
-    }
 
-    int result = ALOOPER_POLL_TIMEOUT;
+        for (int i = 0; i < count; ++i) {
+            const int fd = items[i].data.fd;
+            const int events = fromEpollEvents(items[i].events);
 
-    if (!mReadyQueues.empty()) {
-        result = ALOOPER_POLL_CALLBACK;
+            if (fd == mWakeFd.get()) {
+                eventfd_t value;
+                eventfd_read(mWakeFd.get(), &value);
+                continue;
+            }
 
-        for (auto queue : mReadyQueues) {
-            queue->dispatchCallback();
+            // Callbacks run without mLock, so they may add and remove fds.
+            Request request;
+            sp<SensorDispatcher> dispatcher;
+            {
+                Mutex::Autolock autoLock(mLock);
+                auto it = mRequests.find(fd);
+                if (it == mRequests.end()) {
+                    // Removed after epoll_wait returned.
+                    continue;
+                }
+                request = it->second;
+                dispatcher = mDispatcher;
+            }
+
+            if (request.queue.unsafe_get() != nullptr) {
+                sp<ASensorEventQueue> queue = request.queue.promote();
+                if (queue == nullptr) {
+                    continue;
+                }
+
+                queue->acknowledgeSignal();
+                if (queue->hasCallback()) {
+                    if (dispatcher != NULL) {
+                        dispatcher->post(queue);
+                    } else if (queue->dispatchCallback() == 0) {
+                        removeFd(fd);
+                    }
+                    result = ALOOPER_POLL_CALLBACK;
+                    continue;
+                }
+            } else if (request.callback != NULL) {
+                if ((*request.callback)(fd, events, request.data) == 0) {
+                    removeFd(fd);
+                }
+                result = ALOOPER_POLL_CALLBACK;
+                continue;
+            }
+
+            mResponses.push_back({fd, request.ident, events, request.data});
         }
+    }
 
-        mReadyQueues.clear();
-    } else if (mAwoken) {
-        result = ALOOPER_POLL_WAKE;
-        mAwoken = false;
+    if (!mResponses.empty()) {
+        const Response response = mResponses.front();
+        mResponses.pop_front();
+
+        if (outFd) { *outFd = response.fd; }
+        if (outEvents) { *outEvents = response.events; }
+        if (outData) { *outData = response.data; }
+        result = response.ident;
     }
 
     LOG(VERBOSE) << "pollOnce returning " << result;
@@ -86,8 +160,117 @@ int ALooper::pollOnce(
     return result;
 }
 
-void ALooper::invalidateSensorQueue(ASensorEventQueue *queue) {
+int ALooper::addFd(int fd, int ident, int events, ALooper_callbackFunc callback, void *data) {
+    if (callback == NULL && ident < 0) {
+        LOG(ERROR) << "Invalid attempt to add fd " << fd << " without callback or ident";
+        return -1;
+    }
+
+    Request request;
+    request.fd = fd;
+    request.ident = callback != NULL ? ALOOPER_POLL_CALLBACK : ident;
+    request.events = events;
+    request.callback = callback;
+    request.data = data;
+    return addRequest(request);
+}
+
+int ALooper::addRequest(const Request &request) {
+    struct epoll_event item = {};
+    item.events = toEpollEvents(request.events);
+    item.data.fd = request.fd;
+
     Mutex::Autolock autoLock(mLock);
-    mReadyQueues.erase(queue);
+    const bool exists = mRequests.count(request.fd) > 0;
+    if (epoll_ctl(mEpollFd.get(), exists ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, request.fd, &item)
+            != 0) {
+        PLOG(ERROR) << "Could not add fd " << request.fd << " to epoll instance";
+        return -1;
+    }
+    mRequests[request.fd] = request;
+    return 1;
 }
 
+int ALooper::removeFd(int fd) {
+    Mutex::Autolock autoLock(mLock);
+    auto it = mRequests.find(fd);
+    if (it == mRequests.end()) {
+        return 0;
+    }
+    mRequests.erase(it);
+
+    if (epoll_ctl(mEpollFd.get(), EPOLL_CTL_DEL, fd, NULL) != 0) {
+        PLOG(ERROR) << "Could not remove fd " << fd << " from epoll instance";
+        return -1;
+    }
+    return 1;
+}
+
+void ALooper::addSensorQueue(ASensorEventQueue *queue, int signalFd) {
+    Request request;
+    request.fd = signalFd;
+    request.ident = queue->getIdent() >= 0 ? queue->getIdent() : ALOOPER_POLL_CALLBACK;
+    request.events = ALOOPER_EVENT_INPUT;
+    request.callback = NULL;
+    request.data = queue->getData();
+    request.queue = queue;
+    CHECK_EQ(addRequest(request), 1);
+}
+
+void ALooper::invalidateSensorQueue(ASensorEventQueue *queue) {
+    removeFd(queue->getSignalFd());
+
+    sp<SensorDispatcher> dispatcher;
+    {
+        Mutex::Autolock autoLock(mLock);
+        dispatcher = mDispatcher;
+    }
+    if (dispatcher != NULL) {
+        dispatcher->remove(queue);
+    }
+}
+
+status_t ALooper::setDispatchWorkers(size_t workerCount) {
+    sp<SensorDispatcher> previous;
+    {
+        Mutex::Autolock autoLock(mLock);
+        if (workerCount > 0) {
+            if (mDispatcher != NULL) {
+                return INVALID_OPERATION;
+            }
+            mDispatcher = new SensorDispatcher(this, workerCount);
+            mDispatcher->start();
+            return OK;
+        }
+        previous = mDispatcher;
+        mDispatcher.clear();
+    }
+
+    // Workers take mLock to remove queues whose callback returned 0.
+    if (previous != NULL) {
+        previous->stop();
+    }
+    return OK;
+}
+
+status_t ALooper::setDispatchPolicy(
+        ASensorEventQueue *queue, uint64_t cpuMask, int schedPolicy, int schedPriority) {
+    sp<SensorDispatcher> dispatcher;
+    {
+        Mutex::Autolock autoLock(mLock);
+        dispatcher = mDispatcher;
+    }
+    if (dispatcher == NULL) {
+        return INVALID_OPERATION;
+    }
+    return dispatcher->setPolicy(queue, {cpuMask, schedPolicy, schedPriority});
+}
+
+uint64_t ALooper::getDispatchStealCount() {
+    sp<SensorDispatcher> dispatcher;
+    {
+        Mutex::Autolock autoLock(mLock);
+        dispatcher = mDispatcher;
+    }
+    return dispatcher == NULL ? 0 : dispatcher->getStealCount();
+}
@@ -19,29 +19,89 @@
 #define A_LOOPER_H_
 
 #include <android-base/macros.h>
-#include <utils/Condition.h>
+#include <android-base/unique_fd.h>
+#include <android/looper.h>
+#include <utils/Errors.h>
 #include <utils/Mutex.h>
+#include <utils/RefBase.h>
 
-#include <set>
+#include <deque>
+#include <unordered_map>
 
 struct ASensorEventQueue;
+struct SensorDispatcher;
 
-struct ALooper {
+// An epoll based looper. Every sensor event queue owns an eventfd that is
+// registered here alongside any file descriptors added by the client through
+// ALooper_addFd, so sensor events can be multiplexed with other I/O.
+//
+// Each thread has its own looper (see ALooper_prepare); a looper stays alive
+// while any event queue created on it does.
+//
+// By default pollOnce() runs the callbacks of sensor event queues itself. With
+// dispatch workers it hands them to a SensorDispatcher instead and returns.
+struct ALooper : public android::RefBase {
     ALooper();
+    ~ALooper();
 
-    void signalSensorEvents(ASensorEventQueue *queue);
     void wake();
 
     int pollOnce(int timeoutMillis, int *outFd, int *outEvents, void **outData);
 
+    // Returns 1 on success or -1 on error, like ALooper_addFd.
+    int addFd(int fd, int ident, int events, ALooper_callbackFunc callback, void *data);
+
+    // Returns 1 if |fd| was removed, 0 if it was not registered or -1 on error.
+    int removeFd(int fd);
+
+    void addSensorQueue(ASensorEventQueue *queue, int signalFd);
     void invalidateSensorQueue(ASensorEventQueue *queue);
 
+    // Runs sensor queue callbacks on |workerCount| worker threads, or on the
+    // polling thread again if 0. The pool can only be removed, not resized;
+    // removing it waits for the callbacks it is running.
+    android::status_t setDispatchWorkers(size_t workerCount);
+
+    // Requires dispatch workers. See SensorDispatcher::Policy.
+    android::status_t setDispatchPolicy(
+            ASensorEventQueue *queue, uint64_t cpuMask, int schedPolicy, int schedPriority);
+
+    // See SensorDispatcher::getStealCount(); 0 without dispatch workers.
+    uint64_t getDispatchStealCount();
+
 private:
+    static constexpr int kMaxEventsPerPoll = 16;
+
+    struct Request {
+        int fd;
+        int ident;
+        int events;
+        ALooper_callbackFunc callback;
+        void *data;
+
+        // Set if |fd| is the signal eventfd of a sensor event queue.
+        android::wp<ASensorEventQueue> queue;
+    };
+
+    struct Response {
+        int fd;
+        int ident;
+        int events;
+        void *data;
+    };
+
+    int addRequest(const Request &request);
+
+    android::base::unique_fd mEpollFd;
+    android::base::unique_fd mWakeFd;
+
     android::Mutex mLock;
-    android::Condition mCondition;
+    std::unordered_map<int, Request> mRequests;
+    android::sp<SensorDispatcher> mDispatcher;
 
-    std::set<ASensorEventQueue *> mReadyQueues;
-    bool mAwoken;
+    // Ready fds without a callback, returned by subsequent pollOnce calls.
+    // Only accessed by the polling thread.
+    std::deque<Response> mResponses;
 
     DISALLOW_COPY_AND_ASSIGN(ALooper);
 };
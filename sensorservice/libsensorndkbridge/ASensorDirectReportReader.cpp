@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ASensorDirectReportReader.h"
+
+#define LOG_TAG "libsensorndkbridge"
+#include <android-base/logging.h>
+#include <android/hardware/sensors/1.0/types.h>
+
+#include <stddef.h>
+
+using android::hardware::sensors::V1_0::SensorsEventFormatOffset;
+
+static constexpr size_t kRecordSize =
+        static_cast<size_t>(SensorsEventFormatOffset::TOTAL_LENGTH);
+
+static_assert(kRecordSize == sizeof(ASensorEvent), "direct report record is not an ASensorEvent");
+static_assert(static_cast<size_t>(SensorsEventFormatOffset::ATOMIC_COUNTER) ==
+                      offsetof(ASensorEvent, reserved0),
+              "atomic counter is not in ASensorEvent::reserved0");
+
+ASensorDirectReportReader::ASensorDirectReportReader(const void *buffer, size_t size)
+    : mBuffer(static_cast<const uint8_t *>(buffer)),
+      mRecordCount(size / kRecordSize),
+      mNextRecord(0),
+      mLastCounter(0),
+      mLostEventCount(0) {
+}
+
+ssize_t ASensorDirectReportReader::getEvents(const ASensorEvent **events, size_t count) {
+    size_t copy = 0;
+    while (copy < count && mRecordCount > 0) {
+        const uint8_t *record = mBuffer + mNextRecord * kRecordSize;
+
+        // The writer updates the counter last, so everything before it is
+        // visible once a new counter value is.
+        const uint32_t counter = __atomic_load_n(
+                reinterpret_cast<const uint32_t *>(
+                        record + static_cast<size_t>(SensorsEventFormatOffset::ATOMIC_COUNTER)),
+                __ATOMIC_ACQUIRE);
+        if (static_cast<int32_t>(counter - mLastCounter) <= 0) {
+            break;
+        }
+
+        const int32_t recordSize = *reinterpret_cast<const int32_t *>(
+                record + static_cast<size_t>(SensorsEventFormatOffset::SIZE_FIELD));
+        if (recordSize != static_cast<int32_t>(kRecordSize)) {
+            LOG(ERROR) << "Unexpected direct report record size " << recordSize;
+            break;
+        }
+
+        if (mLastCounter != 0) {
+            mLostEventCount += counter - mLastCounter - 1;
+        }
+
+        events[copy++] = reinterpret_cast<const ASensorEvent *>(record);
+        mLastCounter = counter;
+        mNextRecord = (mNextRecord + 1) % mRecordCount;
+    }
+
+    return copy;
+}
+
+uint64_t ASensorDirectReportReader::getLostEventCount() const {
+    return mLostEventCount;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef A_SENSOR_DIRECT_REPORT_READER_H_
+
+#define A_SENSOR_DIRECT_REPORT_READER_H_
+
+#include <android-base/macros.h>
+#include <android/sensor.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Walks the records a sensor direct channel writes into a shared memory
+// region (see android.hardware.sensors@1.0::SensorsEventFormatOffset).
+//
+// Records are laid out like ASensorEvent, with the atomic counter in
+// reserved0, so they are handed out in place instead of being copied.
+struct ASensorDirectReportReader {
+    ASensorDirectReportReader(const void *buffer, size_t size);
+
+    // Stores pointers to up to |count| new records in |events| and returns
+    // how many were stored.
+    ssize_t getEvents(const ASensorEvent **events, size_t count);
+
+    // Number of records overwritten by the writer before they were read.
+    uint64_t getLostEventCount() const;
+
+private:
+    const uint8_t *mBuffer;
+    const size_t mRecordCount;
+
+    size_t mNextRecord;
+    uint32_t mLastCounter;
+    uint64_t mLostEventCount;
+
+    DISALLOW_COPY_AND_ASSIGN(ASensorDirectReportReader);
+};
+
+#endif  // A_SENSOR_DIRECT_REPORT_READER_H_
@@ -17,38 +17,183 @@
 #include "ASensorEventQueue.h"
 
 #include "ALooper.h"
+#include "SensorEventConversion.h"
 
 #define LOG_TAG "libsensorndkbridge"
 #include <android-base/logging.h>
 
+#include <utils/Timers.h>
+
+#include <sys/eventfd.h>
+
+#include <string.h>
+
+#include <algorithm>
+
+using android::Mutex;
 using android::sp;
 using android::frameworks::sensorservice::V1_0::Result;
+using android::frameworks::sensorservice::V1_1::EventQueueFlagBits;
 using android::hardware::sensors::V1_0::SensorInfo;
 using android::OK;
 using android::BAD_VALUE;
-using android::Mutex;
+using android::INVALID_OPERATION;
+using android::hardware::EventFlag;
+using android::hardware::MQDescriptorSync;
 using android::hardware::Return;
+using android::hardware::hidl_vec;
 
-ASensorEventQueue::ASensorEventQueue(ALooper* looper, ALooper_callbackFunc callback, void* data)
-    : mLooper(looper), mCallback(callback), mData(data), mRequestAdditionalInfo(false) {}
+// A counter with a single writer needs no read-modify-write.
+static void increment(std::atomic<uint64_t> *counter, uint64_t value) {
+    counter->store(counter->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+ASensorEventQueue::ASensorEventQueue(ALooper* looper, int ident, ALooper_callbackFunc callback,
+                                     void* data, size_t capacity, bool useFmq)
+    : mLooper(looper),
+      mIdent(ident),
+      mCallback(callback),
+      mData(data),
+      mSignalFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      mSignalPending(false),
+      mWakeupCount(0),
+      mSignalTimeNs(0),
+      mQueue(capacity),
+      mUsesFmq(useFmq),
+      mEventFlag(nullptr),
+      mFmqReaderExit(false),
+      mRequestAdditionalInfo(false),
+      mEventsReceived(0),
+      mEventsRead(0),
+      mSpuriousWakeups(0),
+      mRecording(false),
+      mAdaptiveBatching(false),
+      mPendingLatencyUs(-1),
+      mBatchingThreadExit(false),
+      mWaitThreshold(0) {
+    CHECK(mSignalFd.get() >= 0) << "Could not create eventfd";
+    mLooper->addSensorQueue(this, mSignalFd.get());
+}
+
+ASensorEventQueue::~ASensorEventQueue() {
+    stopBatchingThread();
+    stopFmqReader();
+    if (mEventFlag != nullptr) {
+        EventFlag::deleteEventFlag(&mEventFlag);
+    }
+}
 
 void ASensorEventQueue::setImpl(const sp<IEventQueue> &queueImpl) {
+    Mutex::Autolock autoLock(mLock);
     mQueueImpl = queueImpl;
+
+    if (mQueueImpl == NULL) {
+        return;
+    }
+
+    for (const auto &entry : mRegistrations) {
+        Return<Result> ret = mQueueImpl->enableSensor(
+                entry.first,
+                entry.second.samplingPeriodUs,
+                entry.second.maxBatchReportLatencyUs);
+
+        if (!ret.isOk() || static_cast<Result>(ret) != Result::OK) {
+            LOG(WARNING) << "Unable to restore sensor " << entry.first;
+        }
+    }
+}
+
+void ASensorEventQueue::disconnect() {
+    stopFmqReader();
+    setImpl(nullptr);
+}
+
+bool ASensorEventQueue::setFmq(const MQDescriptorSync<Event> &descriptor) {
+    CHECK(mUsesFmq) << "Not an FMQ event queue";
+
+    std::unique_ptr<EventMessageQueue> fmq(new EventMessageQueue(descriptor));
+    if (!fmq->isValid()) {
+        LOG(ERROR) << "Invalid sensor event FMQ";
+        return false;
+    }
+
+    EventFlag *eventFlag = nullptr;
+    if (fmq->getEventFlagWord() == nullptr ||
+        EventFlag::createEventFlag(fmq->getEventFlagWord(), &eventFlag) != OK) {
+        LOG(ERROR) << "Unable to create event flag for sensor event FMQ";
+        return false;
+    }
+
+    // The reader of the previous message queue, if any, was stopped by
+    // disconnect().
+    {
+        Mutex::Autolock autoLock(mFmqLock);
+        if (mEventFlag != nullptr) {
+            EventFlag::deleteEventFlag(&mEventFlag);
+        }
+        mFmq = std::move(fmq);
+        mEventFlag = eventFlag;
+    }
+
+    mFmqReaderExit = false;
+    mFmqReader = std::thread([this] { fmqReaderLoop(); });
+
+    return true;
+}
+
+// The server wakes READ_AND_PROCESS after every write; turn that into a looper
+// signal. Event data is only ever touched by getEvents().
+void ASensorEventQueue::fmqReaderLoop() {
+    while (!mFmqReaderExit.load()) {
+        uint32_t state = 0;
+        mEventFlag->wait(
+                static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS), &state,
+                0 /* timeoutNanoSeconds */, true /* retry */);
+
+        if (!mFmqReaderExit.load() && mFmq->availableToRead() > 0) {
+            signal();
+        }
+    }
+}
+
+void ASensorEventQueue::stopFmqReader() {
+    if (!mFmqReader.joinable()) {
+        return;
+    }
+
+    mFmqReaderExit = true;
+    mEventFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+    mFmqReader.join();
 }
 
 int ASensorEventQueue::registerSensor(
         ASensorRef sensor,
         int32_t samplingPeriodUs,
         int64_t maxBatchReportLatencyUs) {
-    Return<Result> ret = mQueueImpl->enableSensor(
-            reinterpret_cast<const SensorInfo *>(sensor)->sensorHandle,
-            samplingPeriodUs,
-            maxBatchReportLatencyUs);
+    const int32_t sensorHandle = reinterpret_cast<const SensorInfo *>(sensor)->sensorHandle;
 
-    if (!ret.isOk()) {
-        return BAD_VALUE;
+    if (mAdaptiveBatching) {
+        Mutex::Autolock autoLock(mPolicyLock);
+        if (mBatchingPolicy != nullptr) {
+            maxBatchReportLatencyUs = mBatchingPolicy->getLatencyUs();
+        }
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    // Without a server side the registration is applied on reconnect, and a
+    // dead service means a reconnect is on its way.
+    if (mQueueImpl != NULL) {
+        Return<Result> ret = mQueueImpl->enableSensor(
+                sensorHandle, samplingPeriodUs, maxBatchReportLatencyUs);
+
+        if (!ret.isOk() && !ret.isDeadObject()) {
+            return BAD_VALUE;
+        }
     }
 
+    mRegistrations[sensorHandle] = {samplingPeriodUs, maxBatchReportLatencyUs};
+
     return OK;
 }
 
@@ -72,68 +217,473 @@ int ASensorEventQueue::requestAdditionalInfoEvents(bool enable) {
     return OK;
 }
 
-int ASensorEventQueue::disableSensor(ASensorRef sensor) {
-    Return<Result> ret = mQueueImpl->disableSensor(
-            reinterpret_cast<const SensorInfo *>(sensor)->sensorHandle);
+int ASensorEventQueue::setAdaptiveBatching(int64_t minLatencyUs, int64_t maxLatencyUs) {
+    if (minLatencyUs < 0 || maxLatencyUs < 0 || (maxLatencyUs > 0 && minLatencyUs > maxLatencyUs)) {
+        return BAD_VALUE;
+    }
 
-    return ret.isOk() ? OK : BAD_VALUE;
+    int64_t latencyUs;
+    {
+        Mutex::Autolock autoLock(mPolicyLock);
+        if (maxLatencyUs == 0) {
+            mAdaptiveBatching = false;
+            mBatchingPolicy.reset();
+            return OK;
+        }
+
+        mBatchingPolicy.reset(new AdaptiveBatchingPolicy(
+                minLatencyUs, maxLatencyUs, maxAvailableEvents()));
+        mAdaptiveBatching = true;
+        latencyUs = mBatchingPolicy->getLatencyUs();
+
+        if (!mBatchingThread.joinable()) {
+            mBatchingThread = std::thread([this] { batchingLoop(); });
+        }
+    }
+
+    applyBatchLatency(latencyUs);
+    return OK;
 }
 
-ssize_t ASensorEventQueue::getEvents(ASensorEvent *events, size_t count) {
-    // XXX Should this block if there aren't any events in the queue?
+int ASensorEventQueue::startRecording(int fd) {
+    if (fd < 0) {
+        return BAD_VALUE;
+    }
+
+    Mutex::Autolock autoLock(mRecorderLock);
+    if (mRecorder != nullptr) {
+        return INVALID_OPERATION;
+    }
+
+    mRecorder.reset(new SensorTraceWriter(fd));
+    mRecording = true;
+    return OK;
+}
+
+int ASensorEventQueue::stopRecording() {
+    Mutex::Autolock autoLock(mRecorderLock);
+    if (mRecorder == nullptr) {
+        return INVALID_OPERATION;
+    }
+
+    mRecording = false;
+    const android::status_t err = mRecorder->finish();
+    mRecorder.reset();
+    return err;
+}
+
+void ASensorEventQueue::recordTrace(const Event *events, size_t count) {
+    if (!mRecording.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mRecorderLock);
+    if (mRecorder != nullptr) {
+        for (size_t i = 0; i < count; ++i) {
+            mRecorder->append(events[i]);
+        }
+    }
+}
+
+void ASensorEventQueue::recordDelivery(const Event &event, int64_t nowNs) {
+    mDeliveryLatency.record(nowNs - event.timestamp);
+}
+
+void ASensorEventQueue::recordRead(const ASensorEvent *events, size_t count) {
+    const int64_t nowNs = systemTime(SYSTEM_TIME_BOOTTIME);
+    for (size_t i = 0; i < count; ++i) {
+        mReadLatency.record(nowNs - events[i].timestamp);
+    }
+    increment(&mEventsRead, count);
+}
+
+void ASensorEventQueue::getStats(ASensorEventQueueStats *stats) const {
+    memset(stats, 0, sizeof(*stats));
+    stats->eventsReceived = mEventsReceived.load(std::memory_order_relaxed);
+    stats->eventsRead = mEventsRead.load(std::memory_order_relaxed);
+    stats->eventsDropped = mQueue.overflowCount();
+    stats->wakeups = mWakeupCount.load(std::memory_order_relaxed);
+    stats->spuriousWakeups = mSpuriousWakeups.load(std::memory_order_relaxed);
+    mDeliveryLatency.snapshot(&stats->deliveryLatency);
+    mWakeupLatency.snapshot(&stats->wakeupLatency);
+    mReadLatency.snapshot(&stats->readLatency);
+}
+
+void ASensorEventQueue::getBatchingStats(ASensorEventQueueBatchingStats *stats) const {
+    memset(stats, 0, sizeof(*stats));
+    stats->wakeupCount = mWakeupCount.load(std::memory_order_relaxed);
+
+    Mutex::Autolock autoLock(mPolicyLock);
+    if (mBatchingPolicy != nullptr) {
+        stats->maxBatchReportLatencyUs = mBatchingPolicy->getLatencyUs();
+        stats->maxEventAgeUs = mBatchingPolicy->getMaxEventAgeNs() / 1000;
+        stats->peakEventCount = mBatchingPolicy->getPeakEventCount();
+        stats->adjustmentCount = mBatchingPolicy->getAdjustmentCount();
+    }
+}
+
+// Runs on the consumer thread, so the policy sees the drain latency the
+// client actually gets. Sensor timestamps are in the boot time base.
+void ASensorEventQueue::updateBatching(const ASensorEvent *events, size_t count) {
+    const int64_t nowNs = systemTime(SYSTEM_TIME_BOOTTIME);
+
+    int64_t oldestTimestamp = events[0].timestamp;
+    for (size_t i = 1; i < count; ++i) {
+        oldestTimestamp = std::min(oldestTimestamp, events[i].timestamp);
+    }
+
+    int64_t latencyUs;
+    {
+        Mutex::Autolock autoLock(mPolicyLock);
+        if (mBatchingPolicy == nullptr ||
+            !mBatchingPolicy->onDrain(nowNs, nowNs - oldestTimestamp, count)) {
+            return;
+        }
+        latencyUs = mBatchingPolicy->getLatencyUs();
+    }
+
+    Mutex::Autolock autoLock(mBatchingLock);
+    mPendingLatencyUs = latencyUs;
+    mBatchingCondition.signal();
+}
+
+void ASensorEventQueue::batchingLoop() {
+    Mutex::Autolock autoLock(mBatchingLock);
+    while (!mBatchingThreadExit) {
+        if (mPendingLatencyUs < 0) {
+            mBatchingCondition.wait(mBatchingLock);
+            continue;
+        }
+
+        const int64_t latencyUs = mPendingLatencyUs;
+        mPendingLatencyUs = -1;
+
+        mBatchingLock.unlock();
+        applyBatchLatency(latencyUs);
+        mBatchingLock.lock();
+    }
+}
+
+void ASensorEventQueue::stopBatchingThread() {
+    if (!mBatchingThread.joinable()) {
+        return;
+    }
+
+    {
+        Mutex::Autolock autoLock(mBatchingLock);
+        mBatchingThreadExit = true;
+        mBatchingCondition.signal();
+    }
+    mBatchingThread.join();
+}
+
+void ASensorEventQueue::applyBatchLatency(int64_t maxBatchReportLatencyUs) {
+    sp<IEventQueue> queueImpl;
+    std::vector<std::pair<int32_t, Registration>> registrations;
+    {
+        Mutex::Autolock autoLock(mLock);
+        for (auto &entry : mRegistrations) {
+            entry.second.maxBatchReportLatencyUs = maxBatchReportLatencyUs;
+            registrations.emplace_back(entry.first, entry.second);
+        }
+        queueImpl = mQueueImpl;
+    }
+
+    if (queueImpl == NULL) {
+        return;
+    }
+
+    for (const auto &entry : registrations) {
+        Return<Result> ret = queueImpl->enableSensor(
+                entry.first, entry.second.samplingPeriodUs, maxBatchReportLatencyUs);
+        if (!ret.isOk()) {
+            LOG(WARNING) << "Unable to change batch latency of sensor " << entry.first;
+        }
+
+        // registerSensor() and disableSensor() make their calls under mLock,
+        // and one may have reached the service before ours did. If the sensor
+        // changed meanwhile, send its current state again.
+        Mutex::Autolock autoLock(mLock);
+        if (mQueueImpl != queueImpl) {
+            // A reconnect restores every sensor.
+            return;
+        }
+
+        auto current = mRegistrations.find(entry.first);
+        if (current == mRegistrations.end()) {
+            mQueueImpl->disableSensor(entry.first);
+        } else if (current->second.samplingPeriodUs != entry.second.samplingPeriodUs ||
+                   current->second.maxBatchReportLatencyUs != maxBatchReportLatencyUs) {
+            mQueueImpl->enableSensor(entry.first, current->second.samplingPeriodUs,
+                                     current->second.maxBatchReportLatencyUs);
+        }
+    }
+}
+
+int ASensorEventQueue::disableSensor(ASensorRef sensor) {
+    const int32_t sensorHandle = reinterpret_cast<const SensorInfo *>(sensor)->sensorHandle;
 
     Mutex::Autolock autoLock(mLock);
+    mRegistrations.erase(sensorHandle);
+
+    if (mQueueImpl == NULL) {
+        return OK;
+    }
+
+    Return<Result> ret = mQueueImpl->disableSensor(sensorHandle);
 
+    return (ret.isOk() || ret.isDeadObject()) ? OK : BAD_VALUE;
+}
+
+ssize_t ASensorEventQueue::getEvents(ASensorEvent *events, size_t count) {
     static_assert(
             sizeof(ASensorEvent) == sizeof(sensors_event_t), "mismatched size");
 
-    size_t copy = std::min(count, mQueue.size());
-    for (size_t i = 0; i < copy; ++i) {
-        reinterpret_cast<sensors_event_t *>(events)[i] = mQueue[i];
+    size_t copy;
+    if (mUsesFmq) {
+        copy = getEventsFromFmq(reinterpret_cast<sensors_event_t *>(events), count);
+    } else {
+        copy = mQueue.read(reinterpret_cast<sensors_event_t *>(events), count);
+
+        LOG(VERBOSE) << "ASensorEventQueue::getEvents() returned " << copy << " events.";
     }
-    mQueue.erase(mQueue.begin(), mQueue.begin() + copy);
 
-    LOG(VERBOSE) << "ASensorEventQueue::getEvents() returned " << copy << " events.";
+    if (copy > 0) {
+        recordRead(events, copy);
+
+        if (mAdaptiveBatching) {
+            updateBatching(events, copy);
+        }
+    }
 
     return copy;
 }
 
+// Converts events straight out of the shared memory region into |events|.
+ssize_t ASensorEventQueue::getEventsFromFmq(sensors_event_t *events, size_t count) {
+    Mutex::Autolock autoLock(mFmqLock);
+    if (mFmq == nullptr) {
+        return 0;
+    }
+
+    const bool requestAdditionalInfo = mRequestAdditionalInfo.load();
+
+    size_t copy = 0;
+    size_t available;
+    while (copy < count && (available = mFmq->availableToRead()) > 0) {
+        const size_t toRead = std::min(count - copy, available);
+
+        EventMessageQueue::MemTransaction tx;
+        if (!mFmq->beginRead(toRead, &tx)) {
+            break;
+        }
+
+        // Like the binder path, only count the events that are delivered.
+        const size_t copyBefore = copy;
+        for (const auto &region : {tx.getFirstRegion(), tx.getSecondRegion()}) {
+            const Event *src = region.getAddress();
+            recordTrace(src, region.getLength());
+            for (size_t i = 0; i < region.getLength(); ++i) {
+                if (shouldDeliver(src[i], requestAdditionalInfo)) {
+                    convertSensorEvent(src[i], &events[copy++]);
+                }
+            }
+        }
+
+        mFmq->commitRead(toRead);
+        increment(&mEventsReceived, copy - copyBefore);
+        mEventFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ));
+    }
+
+    LOG(VERBOSE) << "ASensorEventQueue::getEvents() returned " << copy << " events from FMQ.";
+
+    return copy;
+}
+
+ssize_t ASensorEventQueue::getEventsBlocking(
+        ASensorEvent *events, size_t count, int64_t timeoutNs, size_t minCount) {
+    if (count == 0) {
+        return 0;
+    }
+
+    minCount = std::max<size_t>(1, std::min({minCount, count, maxAvailableEvents()}));
+
+    if (timeoutNs != 0 && availableEvents() < minCount) {
+        const nsecs_t deadline =
+                timeoutNs < 0 ? -1 : systemTime(SYSTEM_TIME_MONOTONIC) + timeoutNs;
+
+        Mutex::Autolock autoLock(mWaitLock);
+        mWaitThreshold.store(minCount, std::memory_order_relaxed);
+
+        // Pairs with the fence in signal(): either the producer sees the
+        // threshold, or the check below sees the producer's events.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        while (availableEvents() < minCount) {
+            if (deadline < 0) {
+                mWaitCondition.wait(mWaitLock);
+                continue;
+            }
+
+            const nsecs_t remaining = deadline - systemTime(SYSTEM_TIME_MONOTONIC);
+            if (remaining <= 0) {
+                break;
+            }
+            mWaitCondition.waitRelative(mWaitLock, remaining);
+        }
+
+        mWaitThreshold.store(0, std::memory_order_relaxed);
+    }
+
+    return getEvents(events, count);
+}
+
+size_t ASensorEventQueue::availableEvents() const {
+    if (mUsesFmq) {
+        Mutex::Autolock autoLock(mFmqLock);
+        return mFmq != nullptr ? mFmq->availableToRead() : 0;
+    }
+    return mQueue.size();
+}
+
+size_t ASensorEventQueue::maxAvailableEvents() const {
+    if (mUsesFmq) {
+        Mutex::Autolock autoLock(mFmqLock);
+        return mFmq != nullptr ? mFmq->getQuantumCount() : 0;
+    }
+    return mQueue.capacity();
+}
+
 int ASensorEventQueue::hasEvents() const {
-    return !mQueue.empty();
+    return availableEvents() > 0;
+}
+
+// static
+bool ASensorEventQueue::shouldDeliver(const Event &event, bool requestAdditionalInfo) {
+    return static_cast<int32_t>(event.sensorType) != ASENSOR_TYPE_ADDITIONAL_INFO ||
+           requestAdditionalInfo;
 }
 
 Return<void> ASensorEventQueue::onEvent(const Event &event) {
     LOG(VERBOSE) << "ASensorEventQueue::onEvent";
 
-    if (static_cast<int32_t>(event.sensorType) != ASENSOR_TYPE_ADDITIONAL_INFO ||
-        mRequestAdditionalInfo.load()) {
-        {
-            Mutex::Autolock autoLock(mLock);
+    recordTrace(&event, 1);
+
+    if (shouldDeliver(event, mRequestAdditionalInfo.load())) {
+        increment(&mEventsReceived, 1);
 
-            mQueue.emplace_back();
-            sensors_event_t* sensorEvent = &mQueue[mQueue.size() - 1];
-            android::hardware::sensors::V1_0::implementation::convertToSensorEvent(event,
-                                                                                   sensorEvent);
+        sensors_event_t* sensorEvent = mQueue.beginWrite();
+        if (sensorEvent == nullptr) {
+            // The consumer is behind and has already been signalled.
+            return android::hardware::Void();
         }
 
-        mLooper->signalSensorEvents(this);
+        recordDelivery(event, systemTime(SYSTEM_TIME_BOOTTIME));
+        convertSensorEvent(event, sensorEvent);
+        mQueue.endWrite();
+
+        signal();
     }
 
     return android::hardware::Void();
 }
 
-void ASensorEventQueue::dispatchCallback() {
+Return<void> ASensorEventQueue::onEvents(const hidl_vec<Event> &events) {
+    LOG(VERBOSE) << "ASensorEventQueue::onEvents(" << events.size() << ")";
+
+    deliverEvents(events.data(), events.size());
+    return android::hardware::Void();
+}
+
+Return<void> ASensorEventQueue::onCompressedEvents(const hidl_vec<uint8_t> &data) {
+    LOG(VERBOSE) << "ASensorEventQueue::onCompressedEvents(" << data.size() << ")";
+
+    if (!mDecoder.decode(data.data(), data.size(), &mDecodedEvents)) {
+        LOG(ERROR) << "Dropping malformed compressed sensor events";
+        return android::hardware::Void();
+    }
+
+    deliverEvents(mDecodedEvents.data(), mDecodedEvents.size());
+    return android::hardware::Void();
+}
+
+void ASensorEventQueue::deliverEvents(const Event *events, size_t count) {
+    recordTrace(events, count);
+
+    const bool requestAdditionalInfo = mRequestAdditionalInfo.load();
+
+    size_t deliverable = 0;
+    for (size_t i = 0; i < count; ++i) {
+        deliverable += shouldDeliver(events[i], requestAdditionalInfo) ? 1 : 0;
+    }
+
+    increment(&mEventsReceived, deliverable);
+
+    const int64_t nowNs = systemTime(SYSTEM_TIME_BOOTTIME);
+    const size_t reserved = mQueue.reserve(deliverable);
+    size_t written = 0;
+    for (size_t i = 0; i < count && written < reserved; ++i) {
+        if (shouldDeliver(events[i], requestAdditionalInfo)) {
+            recordDelivery(events[i], nowNs);
+            convertSensorEvent(events[i], mQueue.slotAt(written++));
+        }
+    }
+
+    if (written > 0) {
+        mQueue.commit(written);
+        signal();
+    }
+}
+
+void ASensorEventQueue::signal() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const size_t waitThreshold = mWaitThreshold.load(std::memory_order_relaxed);
+    if (waitThreshold != 0 && availableEvents() >= waitThreshold) {
+        Mutex::Autolock autoLock(mWaitLock);
+        mWaitCondition.broadcast();
+    }
+
+    if (!mSignalPending.exchange(true)) {
+        mWakeupCount.fetch_add(1, std::memory_order_relaxed);
+        mSignalTimeNs.store(systemTime(SYSTEM_TIME_MONOTONIC), std::memory_order_relaxed);
+        eventfd_write(mSignalFd.get(), 1);
+    }
+}
+
+void ASensorEventQueue::acknowledgeSignal() {
+    eventfd_t value;
+    eventfd_read(mSignalFd.get(), &value);
+
+    mWakeupLatency.record(
+            systemTime(SYSTEM_TIME_MONOTONIC) - mSignalTimeNs.load(std::memory_order_relaxed));
+    if (availableEvents() == 0) {
+        increment(&mSpuriousWakeups, 1);
+    }
+
+    mSignalPending = false;
+}
+
+int ASensorEventQueue::dispatchCallback() {
+    int res = 0;
     if (mCallback != NULL) {
-        int res = (*mCallback)(-1 /* fd */, ALOOPER_EVENT_INPUT, mData);
+        res = (*mCallback)(-1 /* fd */, ALOOPER_EVENT_INPUT, mData);
 
         if (res == 0) {
             mCallback = NULL;
             mData = NULL;
         }
     }
+    return res;
+}
+
+int ASensorEventQueue::setDispatchPolicy(
+        uint64_t cpuMask, int schedPolicy, int schedPriority) {
+    return mLooper->setDispatchPolicy(this, cpuMask, schedPolicy, schedPriority);
 }
 
 void ASensorEventQueue::invalidate() {
+    stopBatchingThread();
+    stopFmqReader();
     mLooper->invalidateSensorQueue(this);
     setImpl(nullptr);
 }
@@ -19,31 +19,70 @@
 #define A_SENSOR_EVENT_QUEUE_H_
 
 #include <android/frameworks/sensorservice/1.0/IEventQueue.h>
-#include <android/frameworks/sensorservice/1.0/IEventQueueCallback.h>
+#include <android/frameworks/sensorservice/1.1/IEventQueueCallback.h>
 #include <android/looper.h>
 #include <android/sensor.h>
 #include <android-base/macros.h>
+#include <android-base/unique_fd.h>
+#include <fmq/EventFlag.h>
+#include <fmq/MessageQueue.h>
+#include <sensorndkbridge/sensor_ext.h>
 #include <sensors/convert.h>
+#include <utils/Condition.h>
 #include <utils/Mutex.h>
+#include <utils/StrongPointer.h>
 
-#include <atomic>
+#include "ALooper.h"
+#include "AdaptiveBatchingPolicy.h"
+#include "LatencyHistogram.h"
+#include "SensorEventCodec.h"
+#include "SensorEventRing.h"
+#include "SensorTrace.h"
 
-struct ALooper;
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 struct ASensorEventQueue
-    : public android::frameworks::sensorservice::V1_0::IEventQueueCallback {
+    : public android::frameworks::sensorservice::V1_1::IEventQueueCallback {
     using Event = android::hardware::sensors::V1_0::Event;
     using IEventQueue = android::frameworks::sensorservice::V1_0::IEventQueue;
+    using EventMessageQueue =
+            android::hardware::MessageQueue<Event, android::hardware::kSynchronizedReadWrite>;
 
+    // A queue created with |useFmq| reads its events from the fast message
+    // queue passed to setFmq(), and its local ring of |capacity| is unused.
     ASensorEventQueue(
             ALooper *looper,
+            int ident,
             ALooper_callbackFunc callback,
-            void *data);
+            void *data,
+            size_t capacity,
+            bool useFmq = false);
+    ~ASensorEventQueue();
 
     android::hardware::Return<void> onEvent(const Event &event) override;
+    android::hardware::Return<void> onEvents(
+            const android::hardware::hidl_vec<Event> &events) override;
+    android::hardware::Return<void> onCompressedEvents(
+            const android::hardware::hidl_vec<uint8_t> &data) override;
 
+    // Also re-enables every sensor registered on this queue, so that a queue
+    // re-created after a sensor service restart resumes where it left off.
     void setImpl(const android::sp<IEventQueue> &queueImpl);
 
+    // Sets the fast message queue described by |descriptor| as the source of
+    // events of a queue created with |useFmq|. Replaces the previous message
+    // queue, if any.
+    bool setFmq(const android::hardware::MQDescriptorSync<Event> &descriptor);
+    bool usesFmq() const { return mUsesFmq; }
+
+    // Drops the server side after the sensor service died. Sensors registered
+    // until the queue is reconnected are enabled by the next setImpl().
+    void disconnect();
+
     int registerSensor(
             ASensorRef sensor,
             int32_t samplingPeriodUs,
@@ -56,24 +95,149 @@ struct ASensorEventQueue
 
     int requestAdditionalInfoEvents(bool enable);
 
+    // Lets the queue choose the batch latency of every sensor registered on
+    // it within [minLatencyUs, maxLatencyUs], overriding the one passed to
+    // registerSensor(). A |maxLatencyUs| of 0 turns this off again, keeping
+    // the current latency.
+    int setAdaptiveBatching(int64_t minLatencyUs, int64_t maxLatencyUs);
+    void getBatchingStats(ASensorEventQueueBatchingStats *stats) const;
+
+    void getStats(ASensorEventQueueStats *stats) const;
+
+    // Appends every event the service delivers to the queue, including the
+    // ones filtered out before getEvents(), to a sensor trace written to |fd|
+    // until stopRecording() is called. See SensorTrace.h for the format.
+    int startRecording(int fd);
+    int stopRecording();
+
+    // Must not be called concurrently from more than one thread.
     ssize_t getEvents(ASensorEvent *events, size_t count);
+
+    // Like getEvents(), but first waits until at least |minCount| events are
+    // queued or |timeoutNs| has passed. A negative timeout waits forever.
+    ssize_t getEventsBlocking(
+            ASensorEvent *events, size_t count, int64_t timeoutNs, size_t minCount);
+
+    // Safe to call from any thread.
     int hasEvents() const;
 
-    void dispatchCallback();
+    int getIdent() const { return mIdent; }
+    void *getData() const { return mData; }
+    bool hasCallback() const { return mCallback != NULL; }
+
+    // The eventfd the looper polls. signal() makes it readable at most once
+    // until the looper calls acknowledgeSignal(), coalescing wake-ups.
+    int getSignalFd() const { return mSignalFd.get(); }
+    void signal();
+    void acknowledgeSignal();
+
+    // Returns the callback's result; 0 means the callback unregistered itself.
+    int dispatchCallback();
+
+    // Only applies to loopers with dispatch workers.
+    int setDispatchPolicy(uint64_t cpuMask, int schedPolicy, int schedPriority);
 
     void invalidate();
 
 private:
-    ALooper *mLooper;
+    struct Registration {
+        int32_t samplingPeriodUs;
+        int64_t maxBatchReportLatencyUs;
+    };
+
+    static bool shouldDeliver(const Event &event, bool requestAdditionalInfo);
+
+    void deliverEvents(const Event *events, size_t count);
+
+    ssize_t getEventsFromFmq(sensors_event_t *events, size_t count);
+
+    void recordTrace(const Event *events, size_t count);
+    void recordDelivery(const Event &event, int64_t nowNs);
+    void recordRead(const ASensorEvent *events, size_t count);
+    void updateBatching(const ASensorEvent *events, size_t count);
+
+    // Makes one binder call per registered sensor, without holding mLock.
+    void applyBatchLatency(int64_t maxBatchReportLatencyUs);
+
+    void batchingLoop();
+    void stopBatchingThread();
+
+    // Events ready to be read, and the most that can ever be ready at once.
+    size_t availableEvents() const;
+    size_t maxAvailableEvents() const;
+
+    void fmqReaderLoop();
+    void stopFmqReader();
+
+    android::sp<ALooper> mLooper;
+    int mIdent;
     ALooper_callbackFunc mCallback;
     void *mData;
-    android::sp<IEventQueue> mQueueImpl;
 
+    // Guards the server side of the queue and the sensors registered on it.
     android::Mutex mLock;
-    std::vector<sensors_event_t> mQueue;
+    android::sp<IEventQueue> mQueueImpl;
+    std::unordered_map<int32_t, Registration> mRegistrations;
+
+    android::base::unique_fd mSignalFd;
+    std::atomic_bool mSignalPending;
+    std::atomic<uint64_t> mWakeupCount;
+    std::atomic<int64_t> mSignalTimeNs;
+
+    SensorEventRing mQueue;
+
+    // Only used by the producer, for onCompressedEvents().
+    SensorEventDecoder mDecoder;
+    std::vector<Event> mDecodedEvents;
+
+    // Set only for queues created by ASensorManager_createFmqEventQueue.
+    // mFmq is replaced when the queue is reconnected, so it is only accessed
+    // under mFmqLock, which is only contended then.
+    const bool mUsesFmq;
+    mutable android::Mutex mFmqLock;
+    std::unique_ptr<EventMessageQueue> mFmq;
+    android::hardware::EventFlag *mEventFlag;
+    std::thread mFmqReader;
+    std::atomic_bool mFmqReaderExit;
 
     std::atomic_bool mRequestAdditionalInfo;
 
+    // Each counter and histogram has a single writer: the producer
+    // (delivery), the looper thread (wake-ups) or the consumer (reads).
+    std::atomic<uint64_t> mEventsReceived;
+    std::atomic<uint64_t> mEventsRead;
+    std::atomic<uint64_t> mSpuriousWakeups;
+    LatencyHistogram mDeliveryLatency;
+    LatencyHistogram mWakeupLatency;
+    LatencyHistogram mReadLatency;
+
+    // Set while a trace is being recorded; the recorder is fed by the
+    // producer, or by the consumer for message queue delivery.
+    std::atomic_bool mRecording;
+    android::Mutex mRecorderLock;
+    std::unique_ptr<SensorTraceWriter> mRecorder;
+
+    // Set by setAdaptiveBatching(), fed by getEvents().
+    std::atomic_bool mAdaptiveBatching;
+    mutable android::Mutex mPolicyLock;
+    std::unique_ptr<AdaptiveBatchingPolicy> mBatchingPolicy;
+
+    // Applies the latencies the policy picks in getEvents(), so that reads
+    // never wait for binder calls. Only the latest pending one is applied;
+    // -1 means none.
+    std::thread mBatchingThread;
+    android::Mutex mBatchingLock;
+    android::Condition mBatchingCondition;
+    int64_t mPendingLatencyUs;
+    bool mBatchingThreadExit;
+
+    // Set by a consumer blocked in getEventsBlocking() to the number of
+    // events it waits for, 0 otherwise. The producer only takes mWaitLock
+    // when this threshold is reached.
+    std::atomic<size_t> mWaitThreshold;
+    android::Mutex mWaitLock;
+    android::Condition mWaitCondition;
+
     DISALLOW_COPY_AND_ASSIGN(ASensorEventQueue);
 };
 
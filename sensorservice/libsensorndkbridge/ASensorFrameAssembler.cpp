@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ASensorFrameAssembler.h"
+
+#include "ASensorEventQueue.h"
+
+#define LOG_TAG "libsensorndkbridge"
+#include <android-base/logging.h>
+
+// static
+constexpr size_t ASensorFrameAssembler::kHistorySize;
+
+ASensorFrameAssembler::SampleHistory::SampleHistory(size_t capacity)
+    : mSamples(capacity),
+      mHead(0),
+      mSize(0) {
+}
+
+const ASensorEvent &ASensorFrameAssembler::SampleHistory::at(size_t index) const {
+    return mSamples[(mHead + index) % mSamples.size()];
+}
+
+bool ASensorFrameAssembler::SampleHistory::push(const ASensorEvent &event) {
+    const bool full = mSize == mSamples.size();
+    if (full) {
+        pop();
+    }
+
+    mSamples[(mHead + mSize) % mSamples.size()] = event;
+    ++mSize;
+    return !full;
+}
+
+void ASensorFrameAssembler::SampleHistory::pop() {
+    mHead = (mHead + 1) % mSamples.size();
+    --mSize;
+}
+
+ASensorFrameAssembler::ASensorFrameAssembler(
+        const std::vector<FrameSensor> &sensors,
+        int64_t windowNs,
+        int flags,
+        ASensorFrameCallbackFunc callback,
+        void *data)
+    : mWindowNs(windowNs),
+      mInterpolate((flags & ASENSOR_FRAME_ASSEMBLER_INTERPOLATE) != 0),
+      mCallback(callback),
+      mData(data),
+      mQueue(NULL),
+      mStopped(false),
+      mDroppedFrameCount(0),
+      mFrame(sensors.size()),
+      mScratch(kHistorySize) {
+    mChannels.reserve(sensors.size());
+    for (const FrameSensor &sensor : sensors) {
+        mChannels.push_back({sensor, SampleHistory(kHistorySize)});
+    }
+}
+
+// static
+int ASensorFrameAssembler::onQueueReadable(int /* fd */, int /* events */, void *data) {
+    return static_cast<ASensorFrameAssembler *>(data)->drain();
+}
+
+int ASensorFrameAssembler::drain() {
+    ssize_t count;
+    while (!mStopped && (count = mQueue->getEvents(mScratch.data(), mScratch.size())) > 0) {
+        for (ssize_t i = 0; i < count && !mStopped; ++i) {
+            push(mScratch[i]);
+        }
+    }
+
+    return mStopped ? 0 : 1;
+}
+
+int ASensorFrameAssembler::push(const ASensorEvent &event) {
+    if (mStopped) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < mChannels.size(); ++i) {
+        Channel &channel = mChannels[i];
+        if (channel.sensor.sensorHandle != event.sensor) {
+            continue;
+        }
+
+        if (!channel.samples.push(event) && i == 0) {
+            // The other sensors fell behind by a whole history.
+            ++mDroppedFrameCount;
+        }
+
+        assembleFrames();
+        break;
+    }
+
+    return mStopped ? 0 : 1;
+}
+
+void ASensorFrameAssembler::assembleFrames() {
+    SampleHistory &reference = mChannels[0].samples;
+
+    while (!mStopped && !reference.empty()) {
+        const int64_t timestamp = reference.at(0).timestamp;
+        mFrame[0] = reference.at(0);
+
+        Match match = Match::FOUND;
+        for (size_t i = 1; i < mChannels.size() && match == Match::FOUND; ++i) {
+            match = matchSample(mChannels[i], timestamp, &mFrame[i]);
+        }
+
+        if (match == Match::PENDING) {
+            return;
+        }
+
+        if (match == Match::FOUND) {
+            const ASensorFrame frame = {timestamp, mFrame.size(), mFrame.data()};
+            if ((*mCallback)(&frame, mData) == 0) {
+                mStopped = true;
+            }
+        } else {
+            ++mDroppedFrameCount;
+        }
+
+        reference.pop();
+        prune(timestamp);
+    }
+}
+
+ASensorFrameAssembler::Match ASensorFrameAssembler::matchSample(
+        const Channel &channel, int64_t timestamp, ASensorEvent *out) const {
+    const SampleHistory &samples = channel.samples;
+
+    size_t next = 0;
+    while (next < samples.size() && samples.at(next).timestamp < timestamp) {
+        ++next;
+    }
+
+    // A later sample may still be closer, or be needed to interpolate.
+    if (next == samples.size()) {
+        return Match::PENDING;
+    }
+
+    const ASensorEvent &after = samples.at(next);
+    if (after.timestamp == timestamp) {
+        *out = after;
+        return Match::FOUND;
+    }
+
+    const ASensorEvent *before = next > 0 ? &samples.at(next - 1) : NULL;
+    const int64_t afterDelta = after.timestamp - timestamp;
+    const int64_t beforeDelta = before != NULL ? timestamp - before->timestamp : INT64_MAX;
+
+    if (mInterpolate && channel.sensor.interpolatedFloats > 0) {
+        if (beforeDelta > mWindowNs || afterDelta > mWindowNs) {
+            return Match::MISSING;
+        }
+
+        const float fraction = static_cast<float>(beforeDelta) /
+                static_cast<float>(after.timestamp - before->timestamp);
+
+        *out = *before;
+        out->timestamp = timestamp;
+        for (size_t i = 0; i < channel.sensor.interpolatedFloats; ++i) {
+            out->data[i] = before->data[i] + fraction * (after.data[i] - before->data[i]);
+        }
+        return Match::FOUND;
+    }
+
+    if (beforeDelta <= afterDelta && beforeDelta <= mWindowNs) {
+        *out = *before;
+        return Match::FOUND;
+    }
+    if (afterDelta <= mWindowNs) {
+        *out = after;
+        return Match::FOUND;
+    }
+    return Match::MISSING;
+}
+
+// Reference timestamps only increase, so every sample older than the last
+// one at or before |timestamp| is no longer needed.
+void ASensorFrameAssembler::prune(int64_t timestamp) {
+    for (size_t i = 1; i < mChannels.size(); ++i) {
+        SampleHistory &samples = mChannels[i].samples;
+        while (samples.size() >= 2 && samples.at(1).timestamp <= timestamp) {
+            samples.pop();
+        }
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef A_SENSOR_FRAME_ASSEMBLER_H_
+
+#define A_SENSOR_FRAME_ASSEMBLER_H_
+
+#include <android-base/macros.h>
+#include <android/sensor.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+#include <stdint.h>
+
+#include <vector>
+
+// Groups the events of several sensors into frames aligned on the timestamps
+// of the first (reference) sensor.
+//
+// Every sensor keeps a short history of samples. A frame for a reference
+// sample at time t is emitted once every other sensor has a sample within
+// |windowNs| of t: the nearest one, or with interpolation, a sample linearly
+// interpolated between the samples on either side of t. A reference sample
+// that cannot be matched is dropped and counted.
+//
+// All storage is allocated up front; pushing events does not allocate.
+struct ASensorFrameAssembler {
+    // Samples kept per sensor. The oldest one is dropped when this is exceeded.
+    static constexpr size_t kHistorySize = 64;
+
+    struct FrameSensor {
+        int32_t sensorHandle;
+
+        // Leading floats of the payload that are interpolated, 0 if the
+        // sensor type has no fixed float layout.
+        size_t interpolatedFloats;
+    };
+
+    // The first of |sensors| is the reference sensor.
+    ASensorFrameAssembler(
+            const std::vector<FrameSensor> &sensors,
+            int64_t windowNs,
+            int flags,
+            ASensorFrameCallbackFunc callback,
+            void *data);
+
+    // Adds an event, emitting every frame it completes. Events of sensors
+    // that are not part of the frame are ignored. Returns 0 once the callback
+    // has returned 0, 1 otherwise.
+    int push(const ASensorEvent &event);
+
+    // The queue the assembler reads from, set when created through
+    // ASensorManager_createFrameAssembler.
+    void setEventQueue(ASensorEventQueue *queue) { mQueue = queue; }
+    ASensorEventQueue *getEventQueue() const { return mQueue; }
+
+    // Looper callback of the event queue: drains it into push().
+    static int onQueueReadable(int fd, int events, void *data);
+
+    uint64_t getDroppedFrameCount() const { return mDroppedFrameCount; }
+
+private:
+    // Fixed-capacity FIFO of samples that drops the oldest when full.
+    struct SampleHistory {
+        explicit SampleHistory(size_t capacity);
+
+        bool empty() const { return mSize == 0; }
+        size_t size() const { return mSize; }
+        const ASensorEvent &at(size_t index) const;
+
+        // Returns false if the oldest sample had to be dropped.
+        bool push(const ASensorEvent &event);
+        void pop();
+
+    private:
+        std::vector<ASensorEvent> mSamples;
+        size_t mHead;
+        size_t mSize;
+    };
+
+    struct Channel {
+        FrameSensor sensor;
+        SampleHistory samples;
+    };
+
+    enum class Match { FOUND, PENDING, MISSING };
+
+    int drain();
+    void assembleFrames();
+    Match matchSample(const Channel &channel, int64_t timestamp, ASensorEvent *out) const;
+    void prune(int64_t timestamp);
+
+    std::vector<Channel> mChannels;
+    const int64_t mWindowNs;
+    const bool mInterpolate;
+    ASensorFrameCallbackFunc mCallback;
+    void *mData;
+
+    ASensorEventQueue *mQueue;
+    bool mStopped;
+    uint64_t mDroppedFrameCount;
+
+    // One event per channel, handed to the callback.
+    std::vector<ASensorEvent> mFrame;
+
+    // Buffer events are drained from the queue into.
+    std::vector<ASensorEvent> mScratch;
+
+    DISALLOW_COPY_AND_ASSIGN(ASensorFrameAssembler);
+};
+
+#endif  // A_SENSOR_FRAME_ASSEMBLER_H_
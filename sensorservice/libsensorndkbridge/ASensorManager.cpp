@@ -15,19 +15,38 @@
  */
 
 #include "ALooper.h"
+#include "ASensorDirectReportReader.h"
 #include "ASensorEventQueue.h"
+#include "ASensorFrameAssembler.h"
 #include "ASensorManager.h"
+#include "SensorEventConversion.h"
+#include "SensorFlags.h"
+
+#include <sensorndkbridge/sensor_ext.h>
 
 #define LOG_TAG "libsensorndkbridge"
+#include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/stringprintf.h>
 #include <android/looper.h>
+#include <cutils/native_handle.h>
 #include <hidl/HidlTransportSupport.h>
 #include <sensors/convert.h>
+#include <vndk/hardware_buffer.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/eventfd.h>
+
+#include <memory>
+#include <vector>
 
 using android::hardware::sensors::V1_0::SensorInfo;
+using android::frameworks::sensorservice::V1_0::IDirectReportChannel;
 using android::frameworks::sensorservice::V1_0::IEventQueue;
 using android::frameworks::sensorservice::V1_0::ISensorManager;
 using android::frameworks::sensorservice::V1_0::Result;
+using android::hardware::sensors::V1_0::RateLevel;
 using android::hardware::sensors::V1_0::SensorType;
 using android::sp;
 using android::wp;
@@ -36,11 +55,32 @@ using android::status_t;
 using android::OK;
 using android::NO_INIT;
 using android::BAD_VALUE;
+using android::INVALID_OPERATION;
+using android::NAME_NOT_FOUND;
+using android::NO_MEMORY;
+using android::PERMISSION_DENIED;
+using android::UNKNOWN_ERROR;
+using android::hardware::hidl_handle;
+using android::hardware::hidl_memory;
 using android::hardware::hidl_vec;
 using android::hardware::Return;
+using android::base::StringAppendF;
 
 static Mutex gLock;
 
+static status_t convertResult(Result result) {
+    switch (result) {
+        case Result::OK:                return OK;
+        case Result::NOT_EXIST:         return NAME_NOT_FOUND;
+        case Result::NO_MEMORY:         return NO_MEMORY;
+        case Result::NO_INIT:           return NO_INIT;
+        case Result::PERMISSION_DENIED: return PERMISSION_DENIED;
+        case Result::BAD_VALUE:         return BAD_VALUE;
+        case Result::INVALID_OPERATION: return INVALID_OPERATION;
+        default:                        return UNKNOWN_ERROR;
+    }
+}
+
 // static
 ASensorManager *ASensorManager::sInstance = NULL;
 
@@ -57,19 +97,74 @@ ASensorManager *ASensorManager::getInstance() {
     return sInstance;
 }
 
+// static
+std::atomic<int> ASensorManager::sStatsDumpSignalFd(-1);
+
+// static
+ASensorManager *ASensorManager::sStatsDumpOwner = NULL;
+
+// static
+constexpr size_t ASensorManager::kMinEventQueueCapacity;
+// static
+constexpr size_t ASensorManager::kMaxEventQueueCapacity;
+// static
+constexpr std::chrono::milliseconds ASensorManager::kReconnectRetryDelay;
+
 void ASensorManager::SensorDeathRecipient::serviceDied(
         uint64_t, const wp<::android::hidl::base::V1_0::IBase>&) {
-    LOG(ERROR) << "Sensor service died. Cleanup sensor manager instance!";
-    Mutex::Autolock autoLock(gLock);
-    delete sInstance;
-    sInstance = NULL;
+    LOG(ERROR) << "Sensor service died. Reconnecting sensor manager instance!";
+    mManager->onServiceDied();
 }
 
 ASensorManager::ASensorManager()
-    : mInitCheck(NO_INIT) {
-    mManager = ISensorManager::getService();
+    : ASensorManager(ISensorManager::getService()) {
+}
+
+ASensorManager::ASensorManager(const sp<ISensorManager> &manager, ServiceProvider provider)
+    : mServiceProvider(provider),
+      mReconnectExit(false),
+      mStatsDumpOutputFd(-1),
+      mStatsDumpExit(false),
+      mInitCheck(NO_INIT),
+      mNextDirectChannelId(1) {
+    if (!mServiceProvider) {
+        mServiceProvider = [] { return ISensorManager::getService(); };
+    }
+
+    mDeathRecipient = new SensorDeathRecipient(this);
+
+    Mutex::Autolock autoLock(mLock);
+    attachLocked(manager);
+}
+
+ASensorManager::~ASensorManager() {
+    disableStatsDump();
+
+    {
+        std::lock_guard<std::mutex> reconnectLock(mReconnectLock);
+        mReconnectExit = true;
+        if (mReconnectThread.joinable()) {
+            mReconnectThread.join();
+        }
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    if (mManager != NULL) {
+        Return<bool> unlinked = mManager->unlinkToDeath(mDeathRecipient);
+        (void)unlinked.isOk();
+    }
+}
+
+void ASensorManager::attachLocked(const sp<ISensorManager> &manager) {
+    mManager = manager;
+    mManagerV1_1 = NULL;
+
     if (mManager != NULL) {
-        mDeathRecipient = new SensorDeathRecipient();
+        Return<sp<ISensorManagerV1_1>> managerV1_1 = ISensorManagerV1_1::castFrom(mManager);
+        if (managerV1_1.isOk()) {
+            mManagerV1_1 = managerV1_1;
+        }
+
         Return<bool> linked = mManager->linkToDeath(mDeathRecipient, /*cookie*/ 0);
         if (!linked.isOk()) {
             LOG(ERROR) << "Transaction error in linking to sensor service death: " <<
@@ -83,7 +178,76 @@ ASensorManager::ASensorManager()
     }
 }
 
+void ASensorManager::onServiceDied() {
+    std::lock_guard<std::mutex> reconnectLock(mReconnectLock);
+
+    // A previous reconnect may still be replaying onto the service that died.
+    if (mReconnectThread.joinable()) {
+        mReconnectThread.join();
+    }
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        mInitCheck = NO_INIT;
+        mManager = NULL;
+        mManagerV1_1 = NULL;
+
+        // Direct channels are owned by the dead service, clients have to
+        // create them again.
+        mDirectChannels.clear();
+
+        for (ASensorEventQueue *queue : mEventQueues) {
+            queue->disconnect();
+        }
+
+        // Shared queues keep their subscriptions, only the multiplexer has
+        // to be reconnected.
+        if (mMultiplexer != NULL) {
+            mMultiplexer->setImpl(NULL);
+        }
+    }
+
+    if (!mReconnectExit) {
+        mReconnectThread = std::thread([this] { reconnectLoop(); });
+    }
+}
+
+// The sensor list is kept: sensor handles are assigned by the HAL and survive
+// a sensor service restart, and clients still hold ASensorRefs into it.
+void ASensorManager::reconnectLoop() {
+    sp<ISensorManager> manager;
+    while (!mReconnectExit && (manager = mServiceProvider()) == NULL) {
+        std::this_thread::sleep_for(kReconnectRetryDelay);
+    }
+
+    if (manager == NULL) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    attachLocked(manager);
+    if (mInitCheck != OK) {
+        LOG(ERROR) << "Unable to reattach to sensor service";
+        return;
+    }
+
+    size_t restored = 0;
+    for (ASensorEventQueue *queue : mEventQueues) {
+        if (connectEventQueueLocked(queue, queue->usesFmq()) == OK) {
+            ++restored;
+        }
+    }
+
+    if (mMultiplexer != NULL && connectMultiplexerLocked() != OK) {
+        LOG(ERROR) << "Unable to restore shared event queues";
+    }
+
+    LOG(INFO) << "Reconnected to sensor service, restored " << restored << " of "
+              << mEventQueues.size() << " event queues";
+}
+
 status_t ASensorManager::initCheck() const {
+    Mutex::Autolock autoLock(mLock);
     return mInitCheck;
 }
 
@@ -92,7 +256,7 @@ int ASensorManager::getSensorList(ASensorList *out) {
 
     Mutex::Autolock autoLock(mLock);
 
-    if (mSensorList == NULL) {
+    if (mSensorList == NULL && mManager != NULL) {
         Return<void> ret =
             mManager->getSensorList([&](const auto &list, auto result) {
                 if (result != Result::OK) {
@@ -109,6 +273,8 @@ int ASensorManager::getSensorList(ASensorList *out) {
             mSensorList.get()[i] =
                 reinterpret_cast<ASensorRef>(&mSensors[i]);
         }
+
+        buildSensorIndexLocked();
     }
 
     if (out) {
@@ -118,53 +284,115 @@ int ASensorManager::getSensorList(ASensorList *out) {
     return mSensors.size();
 }
 
+// Mirrors SensorManager::getDefaultSensor() in the sensor service, which
+// picks the first sensor of a type, preferring wake-up variants only for the
+// types whose wake-up sensor is the natural default.
+static bool isWakeUpDefault(SensorType type) {
+    switch (type) {
+        case SensorType::PROXIMITY:
+        case SensorType::SIGNIFICANT_MOTION:
+        case SensorType::TILT_DETECTOR:
+        case SensorType::WAKE_GESTURE:
+        case SensorType::GLANCE_GESTURE:
+        case SensorType::PICK_UP_GESTURE:
+        case SensorType::WRIST_TILT_GESTURE:
+        case SensorType::LOW_LATENCY_OFFBODY_DETECT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// static
+int64_t ASensorManager::defaultSensorKey(int type, bool wakeUp) {
+    return (static_cast<int64_t>(type) << 1) | (wakeUp ? 1 : 0);
+}
+
+void ASensorManager::buildSensorIndexLocked() {
+    mSensorsByHandle.clear();
+    mDefaultSensors.clear();
+
+    for (size_t i = 0; i < mSensors.size(); ++i) {
+        const SensorInfo &sensor = mSensors[i];
+        const ASensorRef ref = reinterpret_cast<ASensorRef>(&sensor);
+
+        mSensorsByHandle.emplace(sensor.sensorHandle, ref);
+
+        // emplace() keeps the first sensor of each type and wake-up state.
+        mDefaultSensors.emplace(
+                defaultSensorKey(static_cast<int>(sensor.type),
+                                 sensor_flags::isWakeUp(sensor.flags)),
+                ref);
+    }
+}
+
 ASensorRef ASensorManager::getDefaultSensor(int type) {
+    return getDefaultSensorEx(type, isWakeUpDefault(static_cast<SensorType>(type)));
+}
+
+ASensorRef ASensorManager::getSensorByHandle(int32_t sensorHandle) {
     (void)getSensorList(NULL /* list */);
 
-    ASensorRef defaultSensor = NULL;
+    Mutex::Autolock autoLock(mLock);
+    auto it = mSensorsByHandle.find(sensorHandle);
+    return it == mSensorsByHandle.end() ? NULL : it->second;
+}
 
-    Return<void> ret = mManager->getDefaultSensor(
-            static_cast<SensorType>(type),
-            [&](const auto &sensor, auto result) {
-                if (result != Result::OK) {
-                    return;
-                }
+// ISensorManager::getDefaultSensor() has no wake-up parameter, so this is
+// resolved from the local index like getDefaultSensor().
+ASensorRef ASensorManager::getDefaultSensorEx(int type, bool wakeUp) {
+    (void)getSensorList(NULL /* list */);
 
-                for (size_t i = 0; i < mSensors.size(); ++i) {
-                    if (sensor == mSensors[i]) {
-                        defaultSensor =
-                             reinterpret_cast<ASensorRef>(&mSensors[i]);
+    Mutex::Autolock autoLock(mLock);
+    auto it = mDefaultSensors.find(defaultSensorKey(type, wakeUp));
+    return it == mDefaultSensors.end() ? NULL : it->second;
+}
 
-                        break;
-                    }
-                }
-            });
+size_t ASensorManager::getEventQueueCapacity() {
+    (void)getSensorList(NULL /* list */);
 
-    (void)ret.isOk();
+    Mutex::Autolock autoLock(mLock);
 
-    return defaultSensor;
-}
+    // A queue must be able to absorb a full hardware FIFO flush.
+    size_t capacity = kMinEventQueueCapacity;
+    for (size_t i = 0; i < mSensors.size(); ++i) {
+        capacity = std::max(capacity, static_cast<size_t>(mSensors[i].fifoMaxEventCount));
+    }
 
-ASensorRef ASensorManager::getDefaultSensorEx(
-        int /* type */, bool /* wakeup */) {
-    // XXX ISensorManager's getDefaultSensorEx() lacks a "wakeup" parameter.
-    return NULL;
+    return std::min(capacity, kMaxEventQueueCapacity);
 }
 
-ASensorEventQueue *ASensorManager::createEventQueue(
-        ALooper *looper,
-        int /* ident */,
-        ALooper_callbackFunc callback,
-        void *data) {
-    LOG(VERBOSE) << "ASensorManager::createEventQueue";
+status_t ASensorManager::connectEventQueueLocked(
+        const sp<ASensorEventQueue> &queue, bool useFmq) {
+    if (mManager == NULL) {
+        return NO_INIT;
+    }
 
-    sp<ASensorEventQueue> queue =
-        new ASensorEventQueue(looper, callback, data);
+    Result result = Result::UNKNOWN_ERROR;
+    bool transportOk;
+
+    if (useFmq) {
+        if (mManagerV1_1 == NULL) {
+            return INVALID_OPERATION;
+        }
+
+        transportOk = mManagerV1_1->createEventQueueFmq(
+                [&](const sp<IEventQueue> &queueImpl, const auto &descriptor, auto tmpResult) {
+                    result = tmpResult;
+                    if (result != Result::OK) {
+                        return;
+                    }
+
+                    if (!queue->setFmq(descriptor)) {
+                        result = Result::NO_MEMORY;
+                        return;
+                    }
 
-    ::android::hardware::setMinSchedulerPolicy(queue, SCHED_FIFO, 98);
-    Result result;
-    Return<void> ret =
-        mManager->createEventQueue(
+                    queue->setImpl(queueImpl);
+                }).isOk();
+    } else {
+        ::android::hardware::setMinSchedulerPolicy(queue, SCHED_FIFO, 98);
+        transportOk = mManager->createEventQueue(
                 queue, [&](const sp<IEventQueue> &queueImpl, auto tmpResult) {
                     result = tmpResult;
                     if (result != Result::OK) {
@@ -172,28 +400,419 @@ ASensorEventQueue *ASensorManager::createEventQueue(
                     }
 
                     queue->setImpl(queueImpl);
-                });
+                }).isOk();
+    }
+
+    if (!transportOk) {
+        return UNKNOWN_ERROR;
+    }
+
+    return convertResult(result);
+}
 
-    if (!ret.isOk() || result != Result::OK) {
+ASensorEventQueue *ASensorManager::createEventQueue(
+        ALooper *looper,
+        int ident,
+        ALooper_callbackFunc callback,
+        void *data) {
+    LOG(VERBOSE) << "ASensorManager::createEventQueue";
+
+    sp<ASensorEventQueue> queue =
+        new ASensorEventQueue(looper, ident, callback, data, getEventQueueCapacity());
+
+    Mutex::Autolock autoLock(mLock);
+    if (connectEventQueueLocked(queue, false /* useFmq */) != OK) {
         LOG(ERROR) << "FAILED to create event queue";
+        queue->invalidate();
         return NULL;
     }
 
+    mEventQueues.insert(queue.get());
     queue->incStrong(NULL /* id */);
 
     LOG(VERBOSE) << "Returning event queue " << queue.get();
     return queue.get();
 }
 
+ASensorEventQueue *ASensorManager::createFmqEventQueue(
+        ALooper *looper,
+        int ident,
+        ALooper_callbackFunc callback,
+        void *data) {
+    LOG(VERBOSE) << "ASensorManager::createFmqEventQueue";
+
+    bool supportsFmq;
+    {
+        Mutex::Autolock autoLock(mLock);
+        supportsFmq = mManagerV1_1 != NULL;
+    }
+
+    if (!supportsFmq) {
+        LOG(WARNING) << "Sensor service has no FMQ event queues, falling back to binder";
+        return createEventQueue(looper, ident, callback, data);
+    }
+
+    // Events stay in the FMQ until read, so the local ring is never used.
+    sp<ASensorEventQueue> queue =
+        new ASensorEventQueue(looper, ident, callback, data, 1 /* capacity */, true /* useFmq */);
+
+    Mutex::Autolock autoLock(mLock);
+    if (connectEventQueueLocked(queue, true /* useFmq */) != OK) {
+        LOG(ERROR) << "FAILED to create FMQ event queue";
+        queue->invalidate();
+        return NULL;
+    }
+
+    mEventQueues.insert(queue.get());
+    queue->incStrong(NULL /* id */);
+
+    LOG(VERBOSE) << "Returning FMQ event queue " << queue.get();
+    return queue.get();
+}
+
+status_t ASensorManager::connectMultiplexerLocked() {
+    if (mManager == NULL) {
+        return NO_INIT;
+    }
+
+    if (mMultiplexer == NULL) {
+        mMultiplexer = new SensorMultiplexer(mSensors);
+    } else if (mMultiplexer->hasImpl()) {
+        return OK;
+    }
+
+    Result result = Result::UNKNOWN_ERROR;
+    ::android::hardware::setMinSchedulerPolicy(mMultiplexer, SCHED_FIFO, 98);
+    bool transportOk = mManager->createEventQueue(
+            mMultiplexer, [&](const sp<IEventQueue> &queueImpl, auto tmpResult) {
+                result = tmpResult;
+                if (result != Result::OK) {
+                    return;
+                }
+
+                mMultiplexer->setImpl(queueImpl);
+            }).isOk();
+
+    if (!transportOk) {
+        return UNKNOWN_ERROR;
+    }
+
+    return convertResult(result);
+}
+
+ASensorEventQueue *ASensorManager::createSharedEventQueue(
+        ALooper *looper,
+        int ident,
+        ALooper_callbackFunc callback,
+        void *data,
+        bool decimate) {
+    LOG(VERBOSE) << "ASensorManager::createSharedEventQueue";
+
+    sp<ASensorEventQueue> queue =
+        new ASensorEventQueue(looper, ident, callback, data, getEventQueueCapacity());
+
+    Mutex::Autolock autoLock(mLock);
+    if (connectMultiplexerLocked() != OK) {
+        LOG(ERROR) << "FAILED to create shared event queue";
+        queue->invalidate();
+        return NULL;
+    }
+
+    sp<SensorMultiplexer::Subscription> subscription = mMultiplexer->subscribe(queue, decimate);
+    queue->setImpl(subscription);
+
+    mSharedEventQueues.emplace(queue.get(), subscription);
+    queue->incStrong(NULL /* id */);
+
+    LOG(VERBOSE) << "Returning shared event queue " << queue.get();
+    return queue.get();
+}
+
 void ASensorManager::destroyEventQueue(ASensorEventQueue *queue) {
     LOG(VERBOSE) << "ASensorManager::destroyEventQueue(" << queue << ")";
 
+    sp<SensorMultiplexer> multiplexer;
+    sp<SensorMultiplexer::Subscription> subscription;
+    {
+        Mutex::Autolock autoLock(mLock);
+        mEventQueues.erase(queue);
+
+        auto it = mSharedEventQueues.find(queue);
+        if (it != mSharedEventQueues.end()) {
+            multiplexer = mMultiplexer;
+            subscription = it->second;
+            mSharedEventQueues.erase(it);
+        }
+    }
+
+    if (subscription != NULL) {
+        multiplexer->unsubscribe(subscription);
+    }
+
     queue->invalidate();
 
     queue->decStrong(NULL /* id */);
     queue = NULL;
 }
 
+int ASensorManager::createSharedMemoryDirectChannel(int fd, size_t size) {
+    LOG(VERBOSE) << "ASensorManager::createSharedMemoryDirectChannel";
+
+    // The handle is only borrowed for the duration of the call; binder
+    // duplicates the fd when sending it to the service.
+    NATIVE_HANDLE_DECLARE_STORAGE(storage, 1 /* numFds */, 0 /* numInts */);
+    native_handle_t *handle = native_handle_init(storage, 1 /* numFds */, 0 /* numInts */);
+    handle->data[0] = fd;
+
+    hidl_memory mem("ashmem", handle, size);
+
+    return createDirectChannel([&](const sp<ISensorManager> &manager, const auto &cb) {
+        return manager->createAshmemDirectChannel(mem, size, cb);
+    });
+}
+
+int ASensorManager::createHardwareBufferDirectChannel(
+        const native_handle_t *buffer, size_t size) {
+    LOG(VERBOSE) << "ASensorManager::createHardwareBufferDirectChannel";
+
+    // Borrowed like the ashmem handle above.
+    hidl_handle handle(buffer);
+
+    return createDirectChannel([&](const sp<ISensorManager> &manager, const auto &cb) {
+        return manager->createGrallocDirectChannel(handle, size, cb);
+    });
+}
+
+// static
+bool ASensorManager::isValidDirectChannelBuffer(const AHardwareBuffer_Desc &desc, size_t size) {
+    return desc.format == AHARDWAREBUFFER_FORMAT_BLOB &&
+           (desc.usage & AHARDWAREBUFFER_USAGE_SENSOR_DIRECT_DATA) != 0 &&
+           desc.width >= size;
+}
+
+int ASensorManager::createDirectChannel(const DirectChannelFactory &factory) {
+    sp<ISensorManager> manager;
+    {
+        Mutex::Autolock autoLock(mLock);
+        manager = mManager;
+    }
+
+    if (manager == NULL) {
+        return NO_INIT;
+    }
+
+    sp<IDirectReportChannel> channel;
+    Result result = Result::UNKNOWN_ERROR;
+    Return<void> ret = factory(manager, [&](const auto &tmpChannel, auto tmpResult) {
+        result = tmpResult;
+        channel = tmpChannel;
+    });
+
+    if (!ret.isOk()) {
+        LOG(ERROR) << "Transaction error creating direct channel: " << ret.description();
+        return UNKNOWN_ERROR;
+    }
+    if (result != Result::OK) {
+        return convertResult(result);
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    const int channelId = mNextDirectChannelId++;
+    mDirectChannels.emplace(channelId, channel);
+    return channelId;
+}
+
+int ASensorManager::configureDirectReport(ASensorRef sensor, int channelId, int rate) {
+    sp<IDirectReportChannel> channel;
+    {
+        Mutex::Autolock autoLock(mLock);
+        auto it = mDirectChannels.find(channelId);
+        if (it == mDirectChannels.end()) {
+            return BAD_VALUE;
+        }
+        channel = it->second;
+    }
+
+    const int32_t sensorHandle = (sensor == NULL)
+            ? -1 : reinterpret_cast<const SensorInfo *>(sensor)->sensorHandle;
+
+    int token = 0;
+    Result result = Result::UNKNOWN_ERROR;
+    Return<void> ret = channel->configure(
+            sensorHandle, static_cast<RateLevel>(rate), [&](auto tmpToken, auto tmpResult) {
+                token = tmpToken;
+                result = tmpResult;
+            });
+
+    if (!ret.isOk()) {
+        LOG(ERROR) << "Transaction error configuring direct report: " << ret.description();
+        return UNKNOWN_ERROR;
+    }
+
+    return result == Result::OK ? token : convertResult(result);
+}
+
+void ASensorManager::destroyDirectChannel(int channelId) {
+    sp<IDirectReportChannel> channel;
+    {
+        Mutex::Autolock autoLock(mLock);
+        auto it = mDirectChannels.find(channelId);
+        if (it == mDirectChannels.end()) {
+            return;
+        }
+        channel = it->second;
+        mDirectChannels.erase(it);
+    }
+
+    // Dropping the last reference destroys the channel on the server side.
+    channel.clear();
+}
+
+static void appendHistogram(
+        std::string *dump, const char *name, const ASensorLatencyHistogram &histogram) {
+    StringAppendF(dump, "    %s: count=%" PRIu64 " mean=%" PRIu64 "us max=%" PRId64 "us\n",
+                  name, histogram.count,
+                  histogram.count > 0 ? histogram.sumUs / histogram.count : 0,
+                  histogram.maxNs / 1000);
+
+    if (histogram.count == 0) {
+        return;
+    }
+
+    dump->append("     ");
+    for (size_t i = 0; i < ASENSOR_LATENCY_HISTOGRAM_BUCKETS; ++i) {
+        if (histogram.buckets[i] == 0) {
+            continue;
+        }
+        if (i == 0) {
+            StringAppendF(dump, " <1us:%" PRIu64, histogram.buckets[i]);
+        } else {
+            StringAppendF(dump, " %" PRIu64 "us:%" PRIu64, uint64_t(1) << (i - 1),
+                          histogram.buckets[i]);
+        }
+    }
+    dump->append("\n");
+}
+
+void ASensorManager::dumpStats(int fd) {
+    std::string dump;
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        std::vector<ASensorEventQueue *> queues(mEventQueues.begin(), mEventQueues.end());
+        for (const auto &entry : mSharedEventQueues) {
+            queues.push_back(entry.first);
+        }
+
+        StringAppendF(&dump, "libsensorndkbridge: %zu event queue(s)\n", queues.size());
+        if (mMultiplexer != NULL) {
+            StringAppendF(&dump, "  %zu shared, %" PRIu64 " shared sensor updates\n",
+                          mSharedEventQueues.size(), mMultiplexer->getRemoteCallCount());
+        }
+        for (ASensorEventQueue *queue : queues) {
+            ASensorEventQueueStats stats;
+            queue->getStats(&stats);
+
+            const char *kind = mSharedEventQueues.count(queue) > 0
+                    ? " (shared)" : queue->usesFmq() ? " (fmq)" : "";
+            StringAppendF(&dump, "  queue %p%s:\n", queue, kind);
+            StringAppendF(&dump,
+                          "    received=%" PRIu64 " read=%" PRIu64 " dropped=%" PRIu64
+                          " wakeups=%" PRIu64 " spurious=%" PRIu64 "\n",
+                          stats.eventsReceived, stats.eventsRead, stats.eventsDropped,
+                          stats.wakeups, stats.spuriousWakeups);
+            appendHistogram(&dump, "delivery latency", stats.deliveryLatency);
+            appendHistogram(&dump, "wakeup latency", stats.wakeupLatency);
+            appendHistogram(&dump, "read latency", stats.readLatency);
+        }
+    }
+
+    if (fd >= 0) {
+        android::base::WriteStringToFd(dump, fd);
+    } else {
+        LOG(INFO) << dump;
+    }
+}
+
+// static
+void ASensorManager::onStatsDumpSignal(int /* signal */) {
+    const int savedErrno = errno;
+    const int fd = sStatsDumpSignalFd.load();
+    if (fd >= 0) {
+        eventfd_write(fd, 1);
+    }
+    errno = savedErrno;
+}
+
+status_t ASensorManager::enableStatsDump(int fd) {
+    Mutex::Autolock autoLock(gLock);
+
+    if (sStatsDumpOwner != NULL) {
+        return INVALID_OPERATION;
+    }
+
+    mStatsDumpSignalFd.reset(eventfd(0, EFD_CLOEXEC));
+    if (mStatsDumpSignalFd.get() < 0) {
+        return -errno;
+    }
+
+    mStatsDumpOutputFd = fd;
+    mStatsDumpExit = false;
+    sStatsDumpSignalFd = mStatsDumpSignalFd.get();
+
+    struct sigaction action = {};
+    action.sa_handler = onStatsDumpSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGQUIT, &action, &mPreviousSigquitAction) != 0) {
+        const status_t err = -errno;
+        sStatsDumpSignalFd = -1;
+        mStatsDumpSignalFd.reset();
+        return err;
+    }
+
+    mStatsDumpThread = std::thread([this] { statsDumpLoop(); });
+    sStatsDumpOwner = this;
+
+    return OK;
+}
+
+void ASensorManager::statsDumpLoop() {
+    for (;;) {
+        eventfd_t value;
+        if (eventfd_read(mStatsDumpSignalFd.get(), &value) != 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (mStatsDumpExit) {
+            break;
+        }
+
+        dumpStats(mStatsDumpOutputFd);
+    }
+}
+
+void ASensorManager::disableStatsDump() {
+    Mutex::Autolock autoLock(gLock);
+
+    if (sStatsDumpOwner != this) {
+        return;
+    }
+
+    sigaction(SIGQUIT, &mPreviousSigquitAction, NULL);
+    sStatsDumpSignalFd = -1;
+
+    mStatsDumpExit = true;
+    eventfd_write(mStatsDumpSignalFd.get(), 1);
+    mStatsDumpThread.join();
+
+    mStatsDumpSignalFd.reset();
+    sStatsDumpOwner = NULL;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 ASensorManager *ASensorManager_getInstance() {
@@ -238,14 +857,12 @@ ASensor const* ASensorManager_getDefaultSensor(
     return manager->getDefaultSensor(type);
 }
 
-#if 0
 ASensor const* ASensorManager_getDefaultSensorEx(
         ASensorManager* manager, int type, bool wakeUp) {
     RETURN_IF_MANAGER_IS_NULL(NULL);
 
     return manager->getDefaultSensorEx(type, wakeUp);
 }
-#endif
 
 ASensorEventQueue* ASensorManager_createEventQueue(
         ASensorManager* manager,
@@ -262,6 +879,21 @@ ASensorEventQueue* ASensorManager_createEventQueue(
     return manager->createEventQueue(looper, ident, callback, data);
 }
 
+ASensorEventQueue* ASensorManager_createFmqEventQueue(
+        ASensorManager* manager,
+        ALooper* looper,
+        int ident,
+        ALooper_callbackFunc callback,
+        void* data) {
+    RETURN_IF_MANAGER_IS_NULL(NULL);
+
+    if (looper == NULL) {
+        return NULL;
+    }
+
+    return manager->createFmqEventQueue(looper, ident, callback, data);
+}
+
 int ASensorManager_destroyEventQueue(
         ASensorManager* manager, ASensorEventQueue* queue) {
     RETURN_IF_MANAGER_IS_NULL(BAD_VALUE);
@@ -273,23 +905,42 @@ int ASensorManager_destroyEventQueue(
     return OK;
 }
 
-#if 0
 int ASensorManager_createSharedMemoryDirectChannel(
         ASensorManager* manager, int fd, size_t size) {
     RETURN_IF_MANAGER_IS_NULL(BAD_VALUE);
 
-    return OK;
+    return manager->createSharedMemoryDirectChannel(fd, size);
 }
 
 int ASensorManager_createHardwareBufferDirectChannel(
         ASensorManager* manager, AHardwareBuffer const * buffer, size_t size) {
     RETURN_IF_MANAGER_IS_NULL(BAD_VALUE);
 
-    return OK;
+    if (buffer == NULL) {
+        return BAD_VALUE;
+    }
+
+    AHardwareBuffer_Desc desc;
+    AHardwareBuffer_describe(buffer, &desc);
+    if (!ASensorManager::isValidDirectChannelBuffer(desc, size)) {
+        return BAD_VALUE;
+    }
+
+    const native_handle_t *handle = AHardwareBuffer_getNativeHandle(buffer);
+    if (handle == NULL) {
+        return BAD_VALUE;
+    }
+
+    return manager->createHardwareBufferDirectChannel(handle, size);
 }
 
 void ASensorManager_destroyDirectChannel(
         ASensorManager* manager, int channelId) {
+    if (manager == NULL) {
+        return;
+    }
+
+    manager->destroyDirectChannel(channelId);
 }
 
 int ASensorManager_configureDirectReport(
@@ -297,9 +948,89 @@ int ASensorManager_configureDirectReport(
         ASensor const* sensor,
         int channelId,int rate) {
     RETURN_IF_MANAGER_IS_NULL(BAD_VALUE);
-    return OK;
+
+    // A NULL sensor with rate STOP stops all sensors on the channel.
+    if (sensor == NULL && rate != ASENSOR_DIRECT_RATE_STOP) {
+        return BAD_VALUE;
+    }
+
+    return manager->configureDirectReport(sensor, channelId, rate);
+}
+
+ASensorDirectReportReader* ASensorDirectReportReader_create(const void* buffer, size_t size) {
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    return new ASensorDirectReportReader(buffer, size);
+}
+
+void ASensorDirectReportReader_destroy(ASensorDirectReportReader* reader) {
+    delete reader;
+}
+
+ssize_t ASensorDirectReportReader_getEvents(
+        ASensorDirectReportReader* reader, ASensorEvent const** events, size_t count) {
+    if (reader == NULL || events == NULL) {
+        return BAD_VALUE;
+    }
+
+    return reader->getEvents(events, count);
+}
+
+uint64_t ASensorDirectReportReader_getLostEventCount(ASensorDirectReportReader* reader) {
+    return reader == NULL ? 0 : reader->getLostEventCount();
+}
+
+ASensorFrameAssembler* ASensorManager_createFrameAssembler(
+        ASensorManager* manager, ALooper* looper, ASensor const* const* sensors, size_t count,
+        int64_t windowNs, int flags, ASensorFrameCallbackFunc callback, void* data) {
+    RETURN_IF_MANAGER_IS_NULL(NULL);
+
+    if (looper == NULL || sensors == NULL || count == 0 || windowNs < 0 || callback == NULL) {
+        return NULL;
+    }
+
+    std::vector<ASensorFrameAssembler::FrameSensor> frameSensors(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (sensors[i] == NULL) {
+            return NULL;
+        }
+        const SensorInfo *info = reinterpret_cast<const SensorInfo *>(sensors[i]);
+        frameSensors[i] = {info->sensorHandle, fixedLayoutPayloadSize(info->type) / sizeof(float)};
+    }
+
+    std::unique_ptr<ASensorFrameAssembler> assembler(
+            new ASensorFrameAssembler(frameSensors, windowNs, flags, callback, data));
+
+    ASensorEventQueue *queue = manager->createEventQueue(
+            looper, ALOOPER_POLL_CALLBACK, ASensorFrameAssembler::onQueueReadable,
+            assembler.get());
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    assembler->setEventQueue(queue);
+    return assembler.release();
+}
+
+void ASensorManager_destroyFrameAssembler(
+        ASensorManager* manager, ASensorFrameAssembler* assembler) {
+    if (manager == NULL || assembler == NULL) {
+        return;
+    }
+
+    manager->destroyEventQueue(assembler->getEventQueue());
+    delete assembler;
+}
+
+ASensorEventQueue* ASensorFrameAssembler_getEventQueue(ASensorFrameAssembler* assembler) {
+    return assembler == NULL ? NULL : assembler->getEventQueue();
+}
+
+uint64_t ASensorFrameAssembler_getDroppedFrameCount(ASensorFrameAssembler* assembler) {
+    return assembler == NULL ? 0 : assembler->getDroppedFrameCount();
 }
-#endif
 
 int ASensorEventQueue_registerSensor(
         ASensorEventQueue* queue,
@@ -346,6 +1077,79 @@ ssize_t ASensorEventQueue_getEvents(
     return queue->getEvents(events, count);
 }
 
+ssize_t ASensorEventQueue_getEventsBlocking(
+        ASensorEventQueue* queue, ASensorEvent* events, size_t count, int64_t timeoutNs,
+        size_t minCount) {
+    LOG(VERBOSE) << "ASensorEventQueue_getEventsBlocking";
+    RETURN_IF_QUEUE_IS_NULL(BAD_VALUE);
+    return queue->getEventsBlocking(events, count, timeoutNs, minCount);
+}
+
+int ASensorEventQueue_setAdaptiveBatching(
+        ASensorEventQueue* queue, int64_t minLatencyUs, int64_t maxLatencyUs) {
+    RETURN_IF_QUEUE_IS_NULL(BAD_VALUE);
+    return queue->setAdaptiveBatching(minLatencyUs, maxLatencyUs);
+}
+
+int ASensorEventQueue_getBatchingStats(
+        ASensorEventQueue* queue, ASensorEventQueueBatchingStats* stats) {
+    RETURN_IF_QUEUE_IS_NULL(BAD_VALUE);
+    if (stats == NULL) {
+        return BAD_VALUE;
+    }
+
+    queue->getBatchingStats(stats);
+    return OK;
+}
+
+int ASensorEventQueue_getStats(ASensorEventQueue* queue, ASensorEventQueueStats* stats) {
+    RETURN_IF_QUEUE_IS_NULL(BAD_VALUE);
+    if (stats == NULL) {
+        return BAD_VALUE;
+    }
+
+    queue->getStats(stats);
+    return OK;
+}
+
+ASensorEventQueue* ASensorManager_createSharedEventQueue(ASensorManager* manager,
+        ALooper* looper, int ident, ALooper_callbackFunc callback, void* data, int flags) {
+    RETURN_IF_MANAGER_IS_NULL(NULL);
+
+    if (looper == NULL) {
+        return NULL;
+    }
+
+    return manager->createSharedEventQueue(
+            looper, ident, callback, data, (flags & ASENSOR_SHARED_EVENT_QUEUE_DECIMATE) != 0);
+}
+
+int ASensorEventQueue_startRecording(ASensorEventQueue* queue, int fd) {
+    RETURN_IF_QUEUE_IS_NULL(BAD_VALUE);
+    return queue->startRecording(fd);
+}
+
+int ASensorEventQueue_stopRecording(ASensorEventQueue* queue) {
+    RETURN_IF_QUEUE_IS_NULL(BAD_VALUE);
+    return queue->stopRecording();
+}
+
+int ASensorEventQueue_setDispatchPolicy(ASensorEventQueue* queue,
+        const ASensorDispatchPolicy* policy) {
+    RETURN_IF_QUEUE_IS_NULL(BAD_VALUE);
+    if (policy == NULL) {
+        return BAD_VALUE;
+    }
+
+    return queue->setDispatchPolicy(
+            policy->cpuMask, policy->schedPolicy, policy->schedPriority);
+}
+
+int ASensorManager_enableStatsDump(ASensorManager* manager, int fd) {
+    RETURN_IF_MANAGER_IS_NULL(BAD_VALUE);
+    return manager->enableStatsDump(fd);
+}
+
 int ASensorEventQueue_requestAdditionalInfoEvents(ASensorEventQueue* queue, bool enable) {
     RETURN_IF_QUEUE_IS_NULL(BAD_VALUE);
     return queue->requestAdditionalInfoEvents(enable);
@@ -402,54 +1206,64 @@ int ASensor_getHandle(ASensor const* sensor) {
     return reinterpret_cast<const SensorInfo*>(sensor)->sensorHandle;
 }
 
-#if 0
 int ASensor_getReportingMode(ASensor const* sensor) {
     RETURN_IF_SENSOR_IS_NULL(AREPORTING_MODE_INVALID);
-    return 0;
+    return sensor_flags::reportingMode(reinterpret_cast<const SensorInfo *>(sensor)->flags);
 }
 
 bool ASensor_isWakeUpSensor(ASensor const* sensor) {
     RETURN_IF_SENSOR_IS_NULL(false);
-    return false;
+    return sensor_flags::isWakeUp(reinterpret_cast<const SensorInfo *>(sensor)->flags);
 }
 
 bool ASensor_isDirectChannelTypeSupported(
         ASensor const* sensor, int channelType) {
     RETURN_IF_SENSOR_IS_NULL(false);
-    return false;
+    return sensor_flags::supportsDirectChannelType(
+            reinterpret_cast<const SensorInfo *>(sensor)->flags, channelType);
 }
 
 int ASensor_getHighestDirectReportRateLevel(ASensor const* sensor) {
     RETURN_IF_SENSOR_IS_NULL(ASENSOR_DIRECT_RATE_STOP);
-    return 0;
+    return sensor_flags::highestDirectReportRateLevel(
+            reinterpret_cast<const SensorInfo *>(sensor)->flags);
 }
-#endif
 
-static ALooper *getTheLooper() {
-    static ALooper *sLooper = NULL;
+// Every thread gets its own looper, so queues created on different threads
+// are polled and dispatched independently. Unlike the NDK, ALooper_forThread
+// prepares a looper if the thread does not have one yet, since callers of
+// this library have always been able to rely on it returning non-NULL.
+static thread_local sp<ALooper> tLooper;
 
-    Mutex::Autolock autoLock(gLock);
-    if (sLooper == NULL) {
-        sLooper = new ALooper;
+static ALooper *getThreadLooper() {
+    if (tLooper == NULL) {
+        tLooper = new ALooper;
     }
 
-    return sLooper;
+    return tLooper.get();
 }
 
-
 ALooper *ALooper_forThread() {
     LOG(VERBOSE) << "ALooper_forThread";
-    return getTheLooper();
+    return getThreadLooper();
 }
 
 ALooper *ALooper_prepare(int /* opts */) {
     LOG(VERBOSE) << "ALooper_prepare";
-    return getTheLooper();
+    return getThreadLooper();
+}
+
+void ALooper_acquire(ALooper* looper) {
+    looper->incStrong(NULL /* id */);
+}
+
+void ALooper_release(ALooper* looper) {
+    looper->decStrong(NULL /* id */);
 }
 
 int ALooper_pollOnce(
         int timeoutMillis, int* outFd, int* outEvents, void** outData) {
-    int res = getTheLooper()->pollOnce(timeoutMillis, outFd, outEvents, outData);
+    int res = getThreadLooper()->pollOnce(timeoutMillis, outFd, outEvents, outData);
     LOG(VERBOSE) << "ALooper_pollOnce => " << res;
     return res;
 }
@@ -458,3 +1272,28 @@ void ALooper_wake(ALooper* looper) {
     LOG(VERBOSE) << "ALooper_wake";
     looper->wake();
 }
+
+int ALooper_addFd(ALooper* looper, int fd, int ident, int events,
+        ALooper_callbackFunc callback, void* data) {
+    LOG(VERBOSE) << "ALooper_addFd(" << fd << ")";
+    if (looper == NULL) {
+        return -1;
+    }
+    return looper->addFd(fd, ident, events, callback, data);
+}
+
+int ALooper_removeFd(ALooper* looper, int fd) {
+    LOG(VERBOSE) << "ALooper_removeFd(" << fd << ")";
+    if (looper == NULL) {
+        return -1;
+    }
+    return looper->removeFd(fd);
+}
+
+int ALooper_setSensorDispatchWorkers(ALooper* looper, size_t workerCount) {
+    LOG(VERBOSE) << "ALooper_setSensorDispatchWorkers(" << workerCount << ")";
+    if (looper == NULL) {
+        return BAD_VALUE;
+    }
+    return looper->setDispatchWorkers(workerCount);
+}
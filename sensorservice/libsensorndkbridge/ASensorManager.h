@@ -19,24 +19,52 @@
 #define A_SENSOR_MANAGER_H_
 
 #include <android-base/macros.h>
+#include <android-base/unique_fd.h>
 #include <android/frameworks/sensorservice/1.0/ISensorManager.h>
+#include <android/frameworks/sensorservice/1.1/ISensorManager.h>
+#include <android/hardware_buffer.h>
 #include <android/sensor.h>
+#include <cutils/native_handle.h>
 #include <utils/Mutex.h>
 #include <utils/RefBase.h>
 
+#include "SensorMultiplexer.h"
+
+#include <signal.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
 struct ALooper;
 
 struct ASensorManager {
     static ASensorManager *getInstance();
 
+    // Re-acquires the service after it dies. May return null while the
+    // service is still restarting, in which case it is called again later.
+    using ServiceProvider =
+            std::function<android::sp<android::frameworks::sensorservice::V1_0::ISensorManager>()>;
+
     ASensorManager();
+    explicit ASensorManager(
+            const android::sp<android::frameworks::sensorservice::V1_0::ISensorManager> &manager,
+            ServiceProvider provider = ServiceProvider());
+    ~ASensorManager();
+
     android::status_t initCheck() const;
 
     // Returns error or number of sensors returned.
     int getSensorList(ASensorList *list);
 
+    // Resolved from a local index built with the sensor list, without IPC.
     ASensorRef getDefaultSensor(int type);
     ASensorRef getDefaultSensorEx(int type, bool wakeup);
+    ASensorRef getSensorByHandle(int32_t sensorHandle);
 
     ASensorEventQueue *createEventQueue(
             ALooper *looper,
@@ -44,30 +72,149 @@ struct ASensorManager {
             ALooper_callbackFunc callback,
             void *data);
 
+    // Like createEventQueue, but events are read from a fast message queue
+    // rather than delivered through binder, if the service supports it.
+    ASensorEventQueue *createFmqEventQueue(
+            ALooper *looper,
+            int ident,
+            ALooper_callbackFunc callback,
+            void *data);
+
+    // Like createEventQueue, but the queue shares one server-side queue with
+    // every other shared queue of this manager, see SensorMultiplexer.
+    ASensorEventQueue *createSharedEventQueue(
+            ALooper *looper,
+            int ident,
+            ALooper_callbackFunc callback,
+            void *data,
+            bool decimate);
+
     void destroyEventQueue(ASensorEventQueue *queue);
 
+    // Returns a positive channel id or a negative error code.
+    int createSharedMemoryDirectChannel(int fd, size_t size);
+
+    // Like createSharedMemoryDirectChannel, for the native handle of a
+    // gralloc buffer. The handle is only used during the call.
+    int createHardwareBufferDirectChannel(const native_handle_t *buffer, size_t size);
+
+    // Whether a buffer described by |desc| can back a direct channel of
+    // |size| bytes. Same requirements as the framework's SensorManager: a
+    // BLOB buffer allocated for sensor direct data, large enough for |size|.
+    static bool isValidDirectChannelBuffer(const AHardwareBuffer_Desc &desc, size_t size);
+
+    // Returns a positive report token, 0 if |rate| is STOP, or a negative
+    // error code.
+    int configureDirectReport(ASensorRef sensor, int channelId, int rate);
+
+    void destroyDirectChannel(int channelId);
+
+    // Writes the statistics of every event queue to |fd|, or to the log if
+    // |fd| is negative.
+    void dumpStats(int fd);
+
+    // Calls dumpStats(fd) whenever the process receives SIGQUIT, until the
+    // manager is destroyed. Only one manager can do this at a time.
+    android::status_t enableStatsDump(int fd);
+
 private:
 
+    // Bounds on the number of events an ASensorEventQueue can buffer between
+    // two calls to ASensorEventQueue_getEvents.
+    static constexpr size_t kMinEventQueueCapacity = 256;
+    static constexpr size_t kMaxEventQueueCapacity = 16384;
+
+    // How long to wait before asking the provider again for a service that
+    // has not come back yet.
+    static constexpr std::chrono::milliseconds kReconnectRetryDelay{10};
+
     struct SensorDeathRecipient : public android::hardware::hidl_death_recipient
     {
+        explicit SensorDeathRecipient(ASensorManager *manager) : mManager(manager) {}
+
         // hidl_death_recipient interface
         virtual void serviceDied(uint64_t cookie,
                 const ::android::wp<::android::hidl::base::V1_0::IBase>& who) override;
+
+    private:
+        ASensorManager *mManager;
     };
 
     using ISensorManager = android::frameworks::sensorservice::V1_0::ISensorManager;
+    using ISensorManagerV1_1 = android::frameworks::sensorservice::V1_1::ISensorManager;
+    using IDirectReportChannel = android::frameworks::sensorservice::V1_0::IDirectReportChannel;
     using SensorInfo = android::hardware::sensors::V1_0::SensorInfo;
 
+    using DirectChannelCallback = std::function<void(
+            const android::sp<IDirectReportChannel> &,
+            android::frameworks::sensorservice::V1_0::Result)>;
+    using DirectChannelFactory = std::function<android::hardware::Return<void>(
+            const android::sp<ISensorManager> &, const DirectChannelCallback &)>;
+
+    size_t getEventQueueCapacity();
+
+    // Creates a channel through |factory| and returns its id.
+    int createDirectChannel(const DirectChannelFactory &factory);
+
+    static int64_t defaultSensorKey(int type, bool wakeUp);
+    void buildSensorIndexLocked();
+
+    void attachLocked(const android::sp<ISensorManager> &manager);
+    android::status_t connectEventQueueLocked(
+            const android::sp<ASensorEventQueue> &queue, bool useFmq);
+    android::status_t connectMultiplexerLocked();
+
+    // Detaches every event queue from the dead service and re-acquires it on
+    // mReconnectThread, which then re-creates the queues' server side.
+    void onServiceDied();
+    void reconnectLoop();
+
+    static void onStatsDumpSignal(int signal);
+    void statsDumpLoop();
+    void disableStatsDump();
+
     static ASensorManager *sInstance;
     android::sp<SensorDeathRecipient> mDeathRecipient = nullptr;
 
+    ServiceProvider mServiceProvider;
+    std::mutex mReconnectLock;
+    std::thread mReconnectThread;
+    std::atomic_bool mReconnectExit;
+
+    // Written by the SIGQUIT handler, read by mStatsDumpThread.
+    static std::atomic<int> sStatsDumpSignalFd;
+    static ASensorManager *sStatsDumpOwner;
+    android::base::unique_fd mStatsDumpSignalFd;
+    int mStatsDumpOutputFd;
+    std::thread mStatsDumpThread;
+    std::atomic_bool mStatsDumpExit;
+    struct sigaction mPreviousSigquitAction;
+
     android::status_t mInitCheck;
     android::sp<ISensorManager> mManager;
+    android::sp<ISensorManagerV1_1> mManagerV1_1;
 
     mutable android::Mutex mLock;
     android::hardware::hidl_vec<SensorInfo> mSensors;
     std::unique_ptr<ASensorRef[]> mSensorList;
 
+    // Indices into mSensors, rebuilt whenever the list is fetched. The first
+    // sensor of each type and wake-up state is keyed by defaultSensorKey().
+    std::unordered_map<int32_t, ASensorRef> mSensorsByHandle;
+    std::unordered_map<int64_t, ASensorRef> mDefaultSensors;
+
+    // Queues handed out to clients and not destroyed yet.
+    std::unordered_set<ASensorEventQueue *> mEventQueues;
+
+    // Shared queues and their subscriptions. Only the multiplexer has a
+    // server-side queue, created with the first shared queue.
+    android::sp<SensorMultiplexer> mMultiplexer;
+    std::unordered_map<ASensorEventQueue *, android::sp<SensorMultiplexer::Subscription>>
+            mSharedEventQueues;
+
+    std::unordered_map<int, android::sp<IDirectReportChannel>> mDirectChannels;
+    int mNextDirectChannelId;
+
     DISALLOW_COPY_AND_ASSIGN(ASensorManager);
 };
 
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AdaptiveBatchingPolicy.h"
+
+#include <algorithm>
+
+// static
+constexpr int64_t AdaptiveBatchingPolicy::kDefaultEvaluationPeriodNs;
+// static
+constexpr int64_t AdaptiveBatchingPolicy::kIncreaseSteps;
+
+AdaptiveBatchingPolicy::AdaptiveBatchingPolicy(
+        int64_t minLatencyUs,
+        int64_t maxLatencyUs,
+        size_t capacity,
+        int64_t evaluationPeriodNs)
+    : mMinLatencyUs(minLatencyUs),
+      mMaxLatencyUs(maxLatencyUs),
+      mCapacity(capacity),
+      mEvaluationPeriodNs(evaluationPeriodNs),
+      mLatencyUs(minLatencyUs),
+      mAdjustmentCount(0),
+      mPeriodStartNs(-1),
+      mMaxEventAgeNs(0),
+      mPeakEventCount(0),
+      mLastMaxEventAgeNs(0),
+      mLastPeakEventCount(0) {
+}
+
+bool AdaptiveBatchingPolicy::onDrain(
+        int64_t nowNs, int64_t oldestEventAgeNs, size_t eventCount) {
+    if (mPeriodStartNs < 0) {
+        mPeriodStartNs = nowNs;
+    }
+
+    mMaxEventAgeNs = std::max(mMaxEventAgeNs, oldestEventAgeNs);
+    mPeakEventCount = std::max(mPeakEventCount, eventCount);
+
+    if (nowNs - mPeriodStartNs < mEvaluationPeriodNs) {
+        return false;
+    }
+
+    const bool changed = evaluate();
+
+    mLastMaxEventAgeNs = mMaxEventAgeNs;
+    mLastPeakEventCount = mPeakEventCount;
+    mPeriodStartNs = nowNs;
+    mMaxEventAgeNs = 0;
+    mPeakEventCount = 0;
+
+    return changed;
+}
+
+bool AdaptiveBatchingPolicy::evaluate() {
+    const int64_t deadlineNs = mMaxLatencyUs * 1000;
+
+    int64_t latencyUs;
+    if (mMaxEventAgeNs > deadlineNs || mPeakEventCount > mCapacity / 2) {
+        latencyUs = std::max(mMinLatencyUs, mLatencyUs / 2);
+    } else {
+        // Whatever the consumer adds on top of the batch latency is already
+        // part of the measured age, so the slack can go to batching.
+        const int64_t slackUs = (deadlineNs - mMaxEventAgeNs) / 1000;
+        const int64_t stepUs =
+                std::max<int64_t>(1, (mMaxLatencyUs - mMinLatencyUs) / kIncreaseSteps);
+        latencyUs = std::min(mMaxLatencyUs, mLatencyUs + std::min(stepUs, slackUs));
+    }
+
+    if (latencyUs == mLatencyUs) {
+        return false;
+    }
+
+    mLatencyUs = latencyUs;
+    ++mAdjustmentCount;
+    return true;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ADAPTIVE_BATCHING_POLICY_H_
+
+#define ADAPTIVE_BATCHING_POLICY_H_
+
+#include <android-base/macros.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Picks the maxBatchReportLatencyUs of an event queue from what its consumer
+// actually sees, to wake it up as rarely as possible without delivering any
+// event later than a deadline.
+//
+// Each drain reports the age of the oldest event it returned and how many
+// events it returned. Once per evaluation period the policy backs off
+// multiplicatively if an event was older than the deadline or the queue got
+// more than half full, and otherwise grows the latency additively by at most
+// the remaining slack to the deadline.
+struct AdaptiveBatchingPolicy {
+    static constexpr int64_t kDefaultEvaluationPeriodNs = 1000000000;
+
+    // Steps it takes to grow from |minLatencyUs| to |maxLatencyUs|.
+    static constexpr int64_t kIncreaseSteps = 8;
+
+    AdaptiveBatchingPolicy(
+            int64_t minLatencyUs,
+            int64_t maxLatencyUs,
+            size_t capacity,
+            int64_t evaluationPeriodNs = kDefaultEvaluationPeriodNs);
+
+    // Returns true if the batch latency changed.
+    bool onDrain(int64_t nowNs, int64_t oldestEventAgeNs, size_t eventCount);
+
+    int64_t getLatencyUs() const { return mLatencyUs; }
+    uint64_t getAdjustmentCount() const { return mAdjustmentCount; }
+
+    // Worst values seen during the last completed evaluation period.
+    int64_t getMaxEventAgeNs() const { return mLastMaxEventAgeNs; }
+    size_t getPeakEventCount() const { return mLastPeakEventCount; }
+
+private:
+    bool evaluate();
+
+    const int64_t mMinLatencyUs;
+    const int64_t mMaxLatencyUs;
+    const size_t mCapacity;
+    const int64_t mEvaluationPeriodNs;
+
+    int64_t mLatencyUs;
+    uint64_t mAdjustmentCount;
+
+    int64_t mPeriodStartNs;
+    int64_t mMaxEventAgeNs;
+    size_t mPeakEventCount;
+
+    int64_t mLastMaxEventAgeNs;
+    size_t mLastPeakEventCount;
+
+    DISALLOW_COPY_AND_ASSIGN(AdaptiveBatchingPolicy);
+};
+
+#endif  // ADAPTIVE_BATCHING_POLICY_H_
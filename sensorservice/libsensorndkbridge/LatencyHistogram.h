@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H_
+
+#define LATENCY_HISTOGRAM_H_
+
+#include <android-base/macros.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+#include <stdint.h>
+
+#include <atomic>
+
+// A histogram of latencies in power-of-two microsecond buckets: bucket 0
+// holds latencies below 1us, bucket i holds [2^(i-1), 2^i) us and the last
+// bucket everything above.
+//
+// There must be a single writer, which then needs no read-modify-write
+// atomics; snapshot() may be called from any thread and sees each counter
+// consistently, though not necessarily all counters at the same instant.
+struct LatencyHistogram {
+    static constexpr size_t kBucketCount = ASENSOR_LATENCY_HISTOGRAM_BUCKETS;
+
+    LatencyHistogram();
+
+    static size_t bucketOf(int64_t latencyNs);
+
+    void record(int64_t latencyNs);
+    void snapshot(ASensorLatencyHistogram *out) const;
+
+private:
+    static void increment(std::atomic<uint64_t> *counter, uint64_t value) {
+        counter->store(counter->load(std::memory_order_relaxed) + value,
+                       std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> mBuckets[kBucketCount];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mSumUs;
+    std::atomic<int64_t> mMaxNs;
+
+    DISALLOW_COPY_AND_ASSIGN(LatencyHistogram);
+};
+
+inline LatencyHistogram::LatencyHistogram()
+    : mCount(0),
+      mSumUs(0),
+      mMaxNs(0) {
+    for (auto &bucket : mBuckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+// static
+inline size_t LatencyHistogram::bucketOf(int64_t latencyNs) {
+    const uint64_t latencyUs = latencyNs > 0 ? static_cast<uint64_t>(latencyNs) / 1000 : 0;
+    if (latencyUs == 0) {
+        return 0;
+    }
+
+    const size_t bucket = 64 - __builtin_clzll(latencyUs);
+    return bucket < kBucketCount ? bucket : kBucketCount - 1;
+}
+
+inline void LatencyHistogram::record(int64_t latencyNs) {
+    increment(&mBuckets[bucketOf(latencyNs)], 1);
+    increment(&mCount, 1);
+    increment(&mSumUs, latencyNs > 0 ? latencyNs / 1000 : 0);
+    if (latencyNs > mMaxNs.load(std::memory_order_relaxed)) {
+        mMaxNs.store(latencyNs, std::memory_order_relaxed);
+    }
+}
+
+inline void LatencyHistogram::snapshot(ASensorLatencyHistogram *out) const {
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        out->buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+    }
+    out->count = mCount.load(std::memory_order_relaxed);
+    out->sumUs = mSumUs.load(std::memory_order_relaxed);
+    out->maxNs = mMaxNs.load(std::memory_order_relaxed);
+}
+
+#endif  // LATENCY_HISTOGRAM_H_
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorDispatcher.h"
+
+#include "ALooper.h"
+#include "ASensorEventQueue.h"
+
+#define LOG_TAG "libsensorndkbridge"
+#include <android-base/logging.h>
+
+#include <errno.h>
+
+using android::BAD_VALUE;
+using android::Mutex;
+using android::OK;
+using android::sp;
+using android::status_t;
+
+// static
+constexpr SensorDispatcher::Policy SensorDispatcher::kDefaultPolicy;
+
+SensorDispatcher::Strand::Strand(ASensorEventQueue *queue, size_t homeWorker)
+    : queue(queue), homeWorker(homeWorker), state(IDLE), policy(kDefaultPolicy) {}
+
+SensorDispatcher::SensorDispatcher(ALooper *looper, size_t workerCount)
+    : mLooper(looper),
+      mNextWorker(0),
+      mPending(0),
+      mExit(false),
+      mStealCount(0) {
+    CHECK_GT(workerCount, 0u);
+    for (size_t i = 0; i < workerCount; ++i) {
+        mWorkers.emplace_back(new Worker);
+    }
+
+    if (sched_getaffinity(0 /* pid */, sizeof(mDefaultCpus), &mDefaultCpus) != 0) {
+        PLOG(WARNING) << "Unable to get CPU affinity";
+        CPU_ZERO(&mDefaultCpus);
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &mDefaultCpus);
+        }
+    }
+}
+
+void SensorDispatcher::start() {
+    sp<SensorDispatcher> self = this;
+    for (size_t i = 0; i < mWorkers.size(); ++i) {
+        mWorkers[i]->thread = std::thread([self, i] { self->workerLoop(i); });
+    }
+}
+
+void SensorDispatcher::stop() {
+    mExit = true;
+    {
+        Mutex::Autolock autoLock(mWaitLock);
+        mWaitCondition.broadcast();
+    }
+
+    for (auto &worker : mWorkers) {
+        if (!worker->thread.joinable()) {
+            continue;
+        }
+
+        // The last reference to the looper can be dropped by a callback.
+        if (worker->thread.get_id() == std::this_thread::get_id()) {
+            worker->thread.detach();
+        } else {
+            worker->thread.join();
+        }
+    }
+}
+
+status_t SensorDispatcher::validatePolicy(const Policy &policy) const {
+    switch (policy.schedPolicy) {
+        case SCHED_OTHER:
+        case SCHED_BATCH:
+        case SCHED_IDLE:
+        case SCHED_FIFO:
+        case SCHED_RR:
+            break;
+        default:
+            return BAD_VALUE;
+    }
+
+    if (policy.schedPriority < sched_get_priority_min(policy.schedPolicy) ||
+        policy.schedPriority > sched_get_priority_max(policy.schedPolicy)) {
+        return BAD_VALUE;
+    }
+
+    if (policy.cpuMask != 0) {
+        bool allowed = false;
+        for (int cpu = 0; cpu < 64; ++cpu) {
+            if ((policy.cpuMask & (1ull << cpu)) && CPU_ISSET(cpu, &mDefaultCpus)) {
+                allowed = true;
+                break;
+            }
+        }
+        if (!allowed) {
+            return BAD_VALUE;
+        }
+    }
+
+    return OK;
+}
+
+status_t SensorDispatcher::setPolicy(ASensorEventQueue *queue, const Policy &policy) {
+    const status_t err = validatePolicy(policy);
+    if (err != OK) {
+        return err;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    sp<Strand> &strand = mStrands[queue];
+    if (strand == NULL) {
+        strand = new Strand(queue, mNextWorker++ % mWorkers.size());
+    }
+    strand->policy = policy;
+    return OK;
+}
+
+void SensorDispatcher::post(const sp<ASensorEventQueue> &queue) {
+    sp<Strand> strand;
+    {
+        Mutex::Autolock autoLock(mLock);
+        sp<Strand> &entry = mStrands[queue.get()];
+        if (entry == NULL) {
+            entry = new Strand(queue.get(), mNextWorker++ % mWorkers.size());
+        }
+        strand = entry;
+    }
+
+    int state = strand->state.load();
+    for (;;) {
+        if (state == Strand::IDLE) {
+            if (strand->state.compare_exchange_weak(state, Strand::QUEUED)) {
+                enqueue(strand->homeWorker, strand);
+                return;
+            }
+        } else if (state == Strand::RUNNING) {
+            if (strand->state.compare_exchange_weak(state, Strand::RUNNING_SIGNALED)) {
+                return;
+            }
+        } else {
+            // Already queued, or will be once the current run ends.
+            return;
+        }
+    }
+}
+
+void SensorDispatcher::remove(ASensorEventQueue *queue) {
+    Mutex::Autolock autoLock(mLock);
+    mStrands.erase(queue);
+}
+
+void SensorDispatcher::enqueue(size_t index, const sp<Strand> &strand) {
+    {
+        Worker *worker = mWorkers[index].get();
+        Mutex::Autolock autoLock(worker->lock);
+        worker->ready.push_back(strand);
+        ++mPending;
+    }
+
+    Mutex::Autolock autoLock(mWaitLock);
+    mWaitCondition.signal();
+}
+
+sp<SensorDispatcher::Strand> SensorDispatcher::takeWork(size_t index) {
+    {
+        Worker *worker = mWorkers[index].get();
+        Mutex::Autolock autoLock(worker->lock);
+        if (!worker->ready.empty()) {
+            sp<Strand> strand = worker->ready.front();
+            worker->ready.pop_front();
+            --mPending;
+            return strand;
+        }
+    }
+
+    for (size_t i = 1; i < mWorkers.size(); ++i) {
+        Worker *victim = mWorkers[(index + i) % mWorkers.size()].get();
+        Mutex::Autolock autoLock(victim->lock);
+        if (!victim->ready.empty()) {
+            sp<Strand> strand = victim->ready.back();
+            victim->ready.pop_back();
+            --mPending;
+            mStealCount.fetch_add(1, std::memory_order_relaxed);
+            return strand;
+        }
+    }
+
+    return NULL;
+}
+
+void SensorDispatcher::workerLoop(size_t index) {
+    while (!mExit) {
+        sp<Strand> strand = takeWork(index);
+        if (strand != NULL) {
+            run(index, strand);
+            continue;
+        }
+
+        Mutex::Autolock autoLock(mWaitLock);
+        while (mPending == 0 && !mExit) {
+            mWaitCondition.wait(mWaitLock);
+        }
+    }
+}
+
+void SensorDispatcher::run(size_t index, const sp<Strand> &strand) {
+    strand->state = Strand::RUNNING;
+
+    // A strand left RUNNING would swallow every later post.
+    sp<ASensorEventQueue> queue = strand->queue.promote();
+    if (queue == NULL) {
+        strand->state = Strand::IDLE;
+        return;
+    }
+
+    Policy policy;
+    bool removed;
+    {
+        Mutex::Autolock autoLock(mLock);
+        auto it = mStrands.find(queue.get());
+        removed = it == mStrands.end() || it->second != strand;
+        policy = strand->policy;
+    }
+    if (removed) {
+        strand->state = Strand::IDLE;
+        return;
+    }
+
+    applyPolicy(mWorkers[index].get(), policy);
+
+    if (queue->dispatchCallback() == 0) {
+        mLooper->removeFd(queue->getSignalFd());
+        remove(queue.get());
+        return;
+    }
+
+    // Signaled while running: go again, after whatever else is ready here.
+    int state = Strand::RUNNING;
+    if (!strand->state.compare_exchange_strong(state, Strand::IDLE)) {
+        strand->state = Strand::QUEUED;
+        enqueue(index, strand);
+    }
+}
+
+void SensorDispatcher::applyPolicy(Worker *worker, const Policy &policy) {
+    if (worker->applied == policy) {
+        return;
+    }
+    // Failures are only logged once per change; the callback runs anyway.
+    worker->applied = policy;
+
+    cpu_set_t cpus;
+    if (policy.cpuMask == 0) {
+        cpus = mDefaultCpus;
+    } else {
+        CPU_ZERO(&cpus);
+        for (int cpu = 0; cpu < 64; ++cpu) {
+            if (policy.cpuMask & (1ull << cpu)) {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+    }
+    if (sched_setaffinity(0 /* this thread */, sizeof(cpus), &cpus) != 0) {
+        PLOG(WARNING) << "Unable to set sensor dispatch CPU affinity";
+    }
+
+    struct sched_param param = {};
+    param.sched_priority = policy.schedPriority;
+    if (sched_setscheduler(0 /* this thread */, policy.schedPolicy, &param) != 0) {
+        PLOG(WARNING) << "Unable to set sensor dispatch scheduling policy";
+    }
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSOR_DISPATCHER_H_
+
+#define SENSOR_DISPATCHER_H_
+
+#include <android-base/macros.h>
+#include <utils/Condition.h>
+#include <utils/Errors.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+
+#include <sched.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct ALooper;
+struct ASensorEventQueue;
+
+// Runs the callbacks of the sensor event queues of a looper on a pool of
+// worker threads instead of the polling thread, so that a slow callback only
+// holds up its own queue.
+//
+// Each worker owns a deque of ready queues and takes work from the front of
+// it; an idle worker steals from the back of the others. A queue is run by
+// at most one worker at a time, and a queue signaled while it runs is run
+// again afterwards, so its callback sees events in order and never runs
+// concurrently with itself.
+//
+// A queue may ask to run with a CPU affinity and scheduling policy. Whichever
+// worker runs it, stolen or not, moves itself there for the duration.
+struct SensorDispatcher : public android::RefBase {
+    struct Policy {
+        // Bit i allows CPU i; 0 allows every CPU the process may use.
+        uint64_t cpuMask;
+        int schedPolicy;
+        int schedPriority;
+
+        bool operator==(const Policy &other) const {
+            return cpuMask == other.cpuMask && schedPolicy == other.schedPolicy &&
+                   schedPriority == other.schedPriority;
+        }
+        bool operator!=(const Policy &other) const { return !(*this == other); }
+    };
+
+    static constexpr Policy kDefaultPolicy = {0 /* cpuMask */, SCHED_OTHER, 0 /* priority */};
+
+    // Queues whose callback returns 0 are removed from |looper|, which must
+    // outlive the dispatcher.
+    SensorDispatcher(ALooper *looper, size_t workerCount);
+
+    // Workers run until stop() is called, and keep the dispatcher alive
+    // until then.
+    void start();
+
+    // Waits for the workers to finish what they are running. Safe to call
+    // from a worker, which then exits after its current callback.
+    void stop();
+
+    size_t getWorkerCount() const { return mWorkers.size(); }
+
+    // Applies from the next time the queue is run.
+    android::status_t setPolicy(ASensorEventQueue *queue, const Policy &policy);
+
+    // Schedules the callback of |queue|.
+    void post(const android::sp<ASensorEventQueue> &queue);
+
+    // Forgets |queue|; a run already scheduled for it is skipped.
+    void remove(ASensorEventQueue *queue);
+
+    // Number of queue runs taken from another worker's deque.
+    uint64_t getStealCount() const { return mStealCount.load(std::memory_order_relaxed); }
+
+private:
+    struct Strand : public android::RefBase {
+        enum State { IDLE, QUEUED, RUNNING, RUNNING_SIGNALED };
+
+        explicit Strand(ASensorEventQueue *queue, size_t homeWorker);
+
+        android::wp<ASensorEventQueue> queue;
+        const size_t homeWorker;
+        std::atomic<int> state;
+
+        // Guarded by the dispatcher's mLock.
+        Policy policy;
+    };
+
+    struct Worker {
+        android::Mutex lock;
+        std::deque<android::sp<Strand>> ready;
+        std::thread thread;
+
+        // What the worker thread last moved itself to.
+        Policy applied = kDefaultPolicy;
+    };
+
+    android::status_t validatePolicy(const Policy &policy) const;
+
+    void workerLoop(size_t index);
+    android::sp<Strand> takeWork(size_t index);
+    void enqueue(size_t index, const android::sp<Strand> &strand);
+    void run(size_t index, const android::sp<Strand> &strand);
+    void applyPolicy(Worker *worker, const Policy &policy);
+
+    ALooper *const mLooper;
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+
+    // The CPUs the process may run on, restored for queues without a mask.
+    cpu_set_t mDefaultCpus;
+
+    android::Mutex mLock;
+    std::unordered_map<ASensorEventQueue *, android::sp<Strand>> mStrands;
+    size_t mNextWorker;
+
+    // Workers sleep on mWaitCondition while there is no work anywhere.
+    android::Mutex mWaitLock;
+    android::Condition mWaitCondition;
+    std::atomic<size_t> mPending;
+    std::atomic_bool mExit;
+
+    std::atomic<uint64_t> mStealCount;
+
+    DISALLOW_COPY_AND_ASSIGN(SensorDispatcher);
+};
+
+#endif  // SENSOR_DISPATCHER_H_
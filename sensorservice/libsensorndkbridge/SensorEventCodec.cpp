@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorEventCodec.h"
+
+#include "Varint.h"
+
+#include <math.h>
+#include <string.h>
+
+using android::hardware::hidl_vec;
+using namespace sensor_event_codec;
+
+// Beyond 2^24 not every integer is a float, so q would not round trip.
+static constexpr float kMaxQuantized = 16777216.0f;
+
+static constexpr size_t kPayloadSize = sizeof(Event::u);
+static constexpr size_t kStatusOffset = 3 * sizeof(float);
+
+static_assert(kMaxAxes * sizeof(float) <= kPayloadSize, "axes do not fit the payload");
+
+static bool quantize(float value, float resolution, int32_t *q) {
+    if (!(resolution > 0.0f) || !isfinite(value)) {
+        return false;
+    }
+
+    const float scaled = value / resolution;
+    if (!(fabsf(scaled) < kMaxQuantized)) {
+        return false;
+    }
+
+    // Bitwise, so that -0.0f and 0.0f stay apart.
+    const int32_t candidate = static_cast<int32_t>(lrintf(scaled));
+    const float restored = dequantize(candidate, resolution);
+    if (memcmp(&restored, &value, sizeof(value)) != 0) {
+        return false;
+    }
+
+    *q = candidate;
+    return true;
+}
+
+static void putBytes(std::vector<uint8_t> *out, const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    out->insert(out->end(), bytes, bytes + size);
+}
+
+SensorEventEncoder::SensorEventEncoder(const hidl_vec<SensorInfo> &sensors) {
+    for (const auto &sensor : sensors) {
+        mResolutions[sensor.sensorHandle] = sensor.resolution;
+    }
+}
+
+// static
+uint64_t SensorEventEncoder::tableKey(const Event &event) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(event.sensorHandle)) << 32) |
+           static_cast<uint32_t>(event.sensorType);
+}
+
+float SensorEventEncoder::getResolution(int32_t sensorHandle) const {
+    auto it = mResolutions.find(sensorHandle);
+    return it != mResolutions.end() ? it->second : 0.0f;
+}
+
+void SensorEventEncoder::encode(const Event *events, size_t count, std::vector<uint8_t> *out) {
+    out->clear();
+    out->push_back(kVersion);
+    putVarint(out, count);
+
+    // The sensor table, in order of first appearance. Entries are per handle
+    // and type, so that every event of an entry has the same payload layout.
+    mSensorIndices.clear();
+    mTableEvents.clear();
+    for (size_t i = 0; i < count; ++i) {
+        if (mSensorIndices.emplace(tableKey(events[i]), mTableEvents.size()).second) {
+            mTableEvents.push_back(&events[i]);
+        }
+    }
+
+    putVarint(out, mTableEvents.size());
+    for (const Event *event : mTableEvents) {
+        const float resolution = getResolution(event->sensorHandle);
+        putVarint(out, zigzagEncode(event->sensorHandle));
+        putVarint(out, static_cast<uint32_t>(event->sensorType));
+        putBytes(out, &resolution, sizeof(resolution));
+    }
+
+    mPreviousQ.assign(mTableEvents.size() * kMaxAxes, 0);
+
+    int64_t previousTimestamp = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const Event &event = events[i];
+        const uint32_t index = mSensorIndices[tableKey(event)];
+
+        putVarint(out, index);
+        putVarint(out, zigzagEncode(event.timestamp - previousTimestamp));
+        previousTimestamp = event.timestamp;
+
+        const uint8_t *payload = reinterpret_cast<const uint8_t *>(&event.u);
+        const size_t axisCount = quantizedAxisCount(event.sensorType);
+        if (axisCount == 0) {
+            size_t length = kPayloadSize;
+            while (length > 0 && payload[length - 1] == 0) {
+                --length;
+            }
+            out->push_back(static_cast<uint8_t>(length));
+            putBytes(out, payload, length);
+            continue;
+        }
+
+        const float resolution = getResolution(event.sensorHandle);
+        float values[kMaxAxes];
+        memcpy(values, payload, axisCount * sizeof(float));
+
+        int32_t q[kMaxAxes];
+        uint8_t rawAxes = 0;
+        for (size_t axis = 0; axis < axisCount; ++axis) {
+            if (!quantize(values[axis], resolution, &q[axis])) {
+                rawAxes |= 1 << axis;
+            }
+        }
+
+        out->push_back(rawAxes);
+        int32_t *previousQ = &mPreviousQ[index * kMaxAxes];
+        for (size_t axis = 0; axis < axisCount; ++axis) {
+            if (rawAxes & (1 << axis)) {
+                putBytes(out, &values[axis], sizeof(float));
+            } else {
+                putVarint(out, zigzagEncode(static_cast<int64_t>(q[axis]) - previousQ[axis]));
+                previousQ[axis] = q[axis];
+            }
+        }
+
+        if (axisCount == 3) {
+            out->push_back(payload[kStatusOffset]);
+        }
+    }
+}
+
+bool SensorEventDecoder::decode(const uint8_t *data, size_t size, std::vector<Event> *out) {
+    if (!decodeEvents(data, data + size, out)) {
+        out->clear();
+        return false;
+    }
+    return true;
+}
+
+bool SensorEventDecoder::decodeEvents(
+        const uint8_t *position, const uint8_t *end, std::vector<Event> *out) {
+    out->clear();
+
+    uint64_t eventCount;
+    uint64_t sensorCount;
+    if (position >= end || *position++ != kVersion ||
+        !getVarint(&position, end, &eventCount) ||
+        !getVarint(&position, end, &sensorCount) ||
+        // Each event takes at least three bytes, each sensor at least six.
+        eventCount > static_cast<size_t>(end - position) / 3 ||
+        sensorCount > static_cast<size_t>(end - position) / 6) {
+        return false;
+    }
+
+    mSensors.resize(sensorCount);
+    for (Sensor &sensor : mSensors) {
+        uint64_t sensorHandle;
+        uint64_t sensorType;
+        if (!getVarint(&position, end, &sensorHandle) ||
+            !getVarint(&position, end, &sensorType) ||
+            static_cast<size_t>(end - position) < sizeof(float)) {
+            return false;
+        }
+        sensor.sensorHandle = static_cast<int32_t>(zigzagDecode(sensorHandle));
+        sensor.sensorType = static_cast<SensorType>(sensorType);
+        memcpy(&sensor.resolution, position, sizeof(float));
+        position += sizeof(float);
+        sensor.axisCount = quantizedAxisCount(sensor.sensorType);
+    }
+
+    mPreviousQ.assign(sensorCount * kMaxAxes, 0);
+    out->resize(eventCount);
+
+    int64_t timestamp = 0;
+    for (Event &event : *out) {
+        uint64_t index;
+        uint64_t delta;
+        if (!getVarint(&position, end, &index) || index >= sensorCount ||
+            !getVarint(&position, end, &delta) || position >= end) {
+            return false;
+        }
+
+        const Sensor &sensor = mSensors[index];
+        timestamp = static_cast<int64_t>(static_cast<uint64_t>(timestamp) +
+                                         static_cast<uint64_t>(zigzagDecode(delta)));
+        event.timestamp = timestamp;
+        event.sensorHandle = sensor.sensorHandle;
+        event.sensorType = sensor.sensorType;
+
+        uint8_t *payload = reinterpret_cast<uint8_t *>(&event.u);
+        memset(payload, 0, kPayloadSize);
+
+        if (sensor.axisCount == 0) {
+            const size_t length = *position++;
+            if (length > kPayloadSize || length > static_cast<size_t>(end - position)) {
+                return false;
+            }
+            memcpy(payload, position, length);
+            position += length;
+            continue;
+        }
+
+        const uint8_t rawAxes = *position++;
+        int32_t *previousQ = &mPreviousQ[index * kMaxAxes];
+        float values[kMaxAxes];
+        for (size_t axis = 0; axis < sensor.axisCount; ++axis) {
+            if (rawAxes & (1 << axis)) {
+                if (static_cast<size_t>(end - position) < sizeof(float)) {
+                    return false;
+                }
+                memcpy(&values[axis], position, sizeof(float));
+                position += sizeof(float);
+            } else {
+                uint64_t q;
+                if (!getVarint(&position, end, &q)) {
+                    return false;
+                }
+                // Wraps instead of overflowing on corrupt input.
+                previousQ[axis] = static_cast<int32_t>(static_cast<uint32_t>(previousQ[axis]) +
+                                                       static_cast<uint32_t>(zigzagDecode(q)));
+                values[axis] = dequantize(previousQ[axis], sensor.resolution);
+            }
+        }
+        memcpy(payload, values, sensor.axisCount * sizeof(float));
+
+        if (sensor.axisCount == 3) {
+            if (position >= end) {
+                return false;
+            }
+            payload[kStatusOffset] = *position++;
+        }
+    }
+
+    return position == end;
+}
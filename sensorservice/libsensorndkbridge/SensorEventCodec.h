@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSOR_EVENT_CODEC_H_
+
+#define SENSOR_EVENT_CODEC_H_
+
+#include <android-base/macros.h>
+#include <android/hardware/sensors/1.0/types.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <unordered_map>
+#include <vector>
+
+// The compact event encoding of @1.1::IEventQueueCallback.onCompressedEvents,
+// see IEventQueueCallback.hal for the format.
+//
+// Motion sensor values are stored as integer multiples of the sensor's
+// resolution, delta coded against the previous sample of the same sensor, so
+// a slowly varying axis usually takes one or two bytes instead of four. Values
+// that are not such a multiple are stored raw, which keeps the encoding
+// lossless whatever the HAL reports.
+namespace sensor_event_codec {
+
+using Event = android::hardware::sensors::V1_0::Event;
+using SensorInfo = android::hardware::sensors::V1_0::SensorInfo;
+using SensorType = android::hardware::sensors::V1_0::SensorType;
+
+constexpr uint8_t kVersion = 1;
+
+// Most axes a quantized payload can have.
+constexpr size_t kMaxAxes = 6;
+
+// Number of quantizable float axes at the start of the payload of |type|.
+constexpr size_t quantizedAxisCount(SensorType type) {
+    switch (type) {
+        case SensorType::ACCELEROMETER:
+        case SensorType::MAGNETIC_FIELD:
+        case SensorType::ORIENTATION:
+        case SensorType::GYROSCOPE:
+        case SensorType::GRAVITY:
+        case SensorType::LINEAR_ACCELERATION:
+            return 3;
+
+        case SensorType::MAGNETIC_FIELD_UNCALIBRATED:
+        case SensorType::GYROSCOPE_UNCALIBRATED:
+        case SensorType::ACCELEROMETER_UNCALIBRATED:
+            return 6;
+
+        default:
+            return 0;
+    }
+}
+
+// Both sides must compute this the same way for the encoding to be lossless.
+inline float dequantize(int32_t q, float resolution) {
+    return static_cast<float>(q) * resolution;
+}
+
+}  // namespace sensor_event_codec
+
+// Encodes batches of events. The resolutions of the sensors come from the
+// sensor list; events of sensors missing from it are stored raw.
+struct SensorEventEncoder {
+    using Event = sensor_event_codec::Event;
+    using SensorInfo = sensor_event_codec::SensorInfo;
+
+    explicit SensorEventEncoder(const android::hardware::hidl_vec<SensorInfo> &sensors);
+
+    // Replaces the contents of |out| with the encoding of |events|.
+    void encode(const Event *events, size_t count, std::vector<uint8_t> *out);
+
+private:
+    static uint64_t tableKey(const Event &event);
+    float getResolution(int32_t sensorHandle) const;
+
+    std::unordered_map<int32_t, float> mResolutions;
+
+    // Per batch state, kept to reuse its storage.
+    std::unordered_map<uint64_t, uint32_t> mSensorIndices;
+    std::vector<const Event *> mTableEvents;
+    std::vector<int32_t> mPreviousQ;
+
+    DISALLOW_COPY_AND_ASSIGN(SensorEventEncoder);
+};
+
+// Decodes batches of events. Not thread-safe.
+struct SensorEventDecoder {
+    using Event = sensor_event_codec::Event;
+
+    SensorEventDecoder() = default;
+
+    // Replaces the contents of |out| with the events in |data|. Returns false,
+    // leaving |out| empty, if |data| is not a valid encoding.
+    bool decode(const uint8_t *data, size_t size, std::vector<Event> *out);
+
+private:
+    struct Sensor {
+        int32_t sensorHandle;
+        sensor_event_codec::SensorType sensorType;
+        float resolution;
+        size_t axisCount;
+    };
+
+    bool decodeEvents(const uint8_t *position, const uint8_t *end, std::vector<Event> *out);
+
+    // Per batch state, kept to reuse its storage.
+    std::vector<Sensor> mSensors;
+    std::vector<int32_t> mPreviousQ;
+
+    DISALLOW_COPY_AND_ASSIGN(SensorEventDecoder);
+};
+
+#endif  // SENSOR_EVENT_CODEC_H_
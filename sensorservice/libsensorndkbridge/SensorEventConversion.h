@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSOR_EVENT_CONVERSION_H_
+
+#define SENSOR_EVENT_CONVERSION_H_
+
+#include <android/hardware/sensors/1.0/types.h>
+#include <hardware/sensors.h>
+#include <sensors/convert.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Event to sensors_event_t conversion with a fast path for the high rate
+// motion sensors. Their Event payload already has the sensors_event_t layout
+// (three or six floats, optionally followed by an int8_t status), so the
+// conversion is a fixed-size copy of that prefix, which the compiler turns
+// into a few vector moves, instead of a field by field copy.
+//
+// The result is bit-identical to convertToSensorEvent().
+
+// Number of leading payload bytes shared by Event and sensors_event_t for
+// |type|, or 0 if |type| has to go through convertToSensorEvent().
+constexpr size_t fixedLayoutPayloadSize(android::hardware::sensors::V1_0::SensorType type) {
+    using android::hardware::sensors::V1_0::SensorType;
+
+    switch (type) {
+        // Vec3: x, y, z, status.
+        case SensorType::ACCELEROMETER:
+        case SensorType::MAGNETIC_FIELD:
+        case SensorType::ORIENTATION:
+        case SensorType::GYROSCOPE:
+        case SensorType::GRAVITY:
+        case SensorType::LINEAR_ACCELERATION:
+            return 3 * sizeof(float) + sizeof(int8_t);
+
+        // Uncal: x, y, z, x_bias, y_bias, z_bias.
+        case SensorType::MAGNETIC_FIELD_UNCALIBRATED:
+        case SensorType::GYROSCOPE_UNCALIBRATED:
+        case SensorType::ACCELEROMETER_UNCALIBRATED:
+            return 6 * sizeof(float);
+
+        default:
+            return 0;
+    }
+}
+
+template <android::hardware::sensors::V1_0::SensorType type>
+inline void convertFixedLayoutEvent(
+        const android::hardware::sensors::V1_0::Event &src, sensors_event_t *dst) {
+    constexpr size_t kPayloadSize = fixedLayoutPayloadSize(type);
+    static_assert(kPayloadSize > 0, "sensor type has no fixed payload layout");
+    static_assert(kPayloadSize <= sizeof(dst->data), "payload does not fit");
+    static_assert(sizeof(src.u) == sizeof(dst->data), "mismatched payload size");
+
+    dst->version = sizeof(sensors_event_t);
+    dst->sensor = src.sensorHandle;
+    dst->type = static_cast<int32_t>(type);
+    dst->reserved0 = 0;
+    dst->timestamp = src.timestamp;
+
+    uint8_t *payload = reinterpret_cast<uint8_t *>(dst->data);
+    memcpy(payload, &src.u, kPayloadSize);
+    memset(payload + kPayloadSize, 0, sizeof(dst->data) - kPayloadSize);
+
+    dst->flags = 0;
+    memset(dst->reserved1, 0, sizeof(dst->reserved1));
+}
+
+inline void convertSensorEvent(
+        const android::hardware::sensors::V1_0::Event &src, sensors_event_t *dst) {
+    using android::hardware::sensors::V1_0::SensorType;
+
+#define CONVERT_FIXED_LAYOUT(x)                                 \
+    case SensorType::x:                                         \
+        convertFixedLayoutEvent<SensorType::x>(src, dst);       \
+        return
+
+    switch (src.sensorType) {
+        CONVERT_FIXED_LAYOUT(ACCELEROMETER);
+        CONVERT_FIXED_LAYOUT(MAGNETIC_FIELD);
+        CONVERT_FIXED_LAYOUT(ORIENTATION);
+        CONVERT_FIXED_LAYOUT(GYROSCOPE);
+        CONVERT_FIXED_LAYOUT(GRAVITY);
+        CONVERT_FIXED_LAYOUT(LINEAR_ACCELERATION);
+        CONVERT_FIXED_LAYOUT(MAGNETIC_FIELD_UNCALIBRATED);
+        CONVERT_FIXED_LAYOUT(GYROSCOPE_UNCALIBRATED);
+        CONVERT_FIXED_LAYOUT(ACCELEROMETER_UNCALIBRATED);
+        default:
+            android::hardware::sensors::V1_0::implementation::convertToSensorEvent(src, dst);
+            return;
+    }
+
+#undef CONVERT_FIXED_LAYOUT
+}
+
+#endif  // SENSOR_EVENT_CONVERSION_H_
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSOR_EVENT_RING_H_
+
+#define SENSOR_EVENT_RING_H_
+
+#include <android-base/macros.h>
+#include <hardware/sensors.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+// A fixed-capacity single-producer/single-consumer ring of sensors_event_t.
+//
+// The producer is the hwbinder thread delivering IEventQueueCallback calls
+// (oneway transactions to one binder node are serialized by the driver), the
+// consumer is whichever thread calls ASensorEventQueue_getEvents. Neither side
+// takes a lock; when the ring is full new events are dropped and counted.
+struct SensorEventRing {
+    static constexpr size_t kCacheLineSize = 64;
+
+    // The capacity is rounded up to the next power of two.
+    explicit SensorEventRing(size_t minCapacity);
+
+    size_t capacity() const { return mMask + 1; }
+
+    // Producer side: returns the slot to fill in place, or nullptr if the ring
+    // is full. A non-null slot is published by the following endWrite().
+    sensors_event_t *beginWrite();
+    void endWrite();
+
+    // Batched producer side: reserves up to |count| slots and returns how many
+    // were reserved, counting the rest as overflow. Slots [0, reserved) are
+    // filled through slotAt() and published together by commit().
+    size_t reserve(size_t count);
+    sensors_event_t *slotAt(size_t offset);
+    void commit(size_t count);
+
+    // Consumer side: moves up to |count| events into |out|.
+    size_t read(sensors_event_t *out, size_t count);
+
+    // Safe to call from any thread.
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+    uint64_t overflowCount() const;
+
+private:
+    struct FreeDeleter {
+        void operator()(sensors_event_t *p) const { free(p); }
+    };
+
+    static size_t roundUpToPowerOfTwo(size_t n);
+
+    const size_t mMask;
+    std::unique_ptr<sensors_event_t[], FreeDeleter> mBuffer;
+
+    // Producer-owned cache line.
+    alignas(kCacheLineSize) std::atomic<size_t> mWriteIndex;
+    size_t mCachedReadIndex;
+    std::atomic<uint64_t> mOverflowCount;
+
+    // Consumer-owned cache line.
+    alignas(kCacheLineSize) std::atomic<size_t> mReadIndex;
+
+    DISALLOW_COPY_AND_ASSIGN(SensorEventRing);
+};
+
+// static
+inline size_t SensorEventRing::roundUpToPowerOfTwo(size_t n) {
+    size_t result = 1;
+    while (result < n) {
+        result <<= 1;
+    }
+    return result;
+}
+
+inline SensorEventRing::SensorEventRing(size_t minCapacity)
+    : mMask(roundUpToPowerOfTwo(std::max<size_t>(minCapacity, 1)) - 1),
+      mWriteIndex(0),
+      mCachedReadIndex(0),
+      mOverflowCount(0),
+      mReadIndex(0) {
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, kCacheLineSize, capacity() * sizeof(sensors_event_t)) != 0) {
+        abort();
+    }
+    mBuffer.reset(static_cast<sensors_event_t *>(buffer));
+}
+
+inline sensors_event_t *SensorEventRing::beginWrite() {
+    return reserve(1) == 1 ? slotAt(0) : nullptr;
+}
+
+inline void SensorEventRing::endWrite() {
+    commit(1);
+}
+
+inline size_t SensorEventRing::reserve(size_t count) {
+    const size_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+    size_t available = capacity() - (writeIndex - mCachedReadIndex);
+    if (available < count) {
+        mCachedReadIndex = mReadIndex.load(std::memory_order_acquire);
+        available = capacity() - (writeIndex - mCachedReadIndex);
+    }
+
+    const size_t reserved = std::min(count, available);
+    if (reserved < count) {
+        mOverflowCount.store(
+                mOverflowCount.load(std::memory_order_relaxed) + (count - reserved),
+                std::memory_order_relaxed);
+    }
+    return reserved;
+}
+
+inline sensors_event_t *SensorEventRing::slotAt(size_t offset) {
+    return &mBuffer[(mWriteIndex.load(std::memory_order_relaxed) + offset) & mMask];
+}
+
+inline void SensorEventRing::commit(size_t count) {
+    mWriteIndex.store(
+            mWriteIndex.load(std::memory_order_relaxed) + count,
+            std::memory_order_release);
+}
+
+inline size_t SensorEventRing::read(sensors_event_t *out, size_t count) {
+    const size_t readIndex = mReadIndex.load(std::memory_order_relaxed);
+    const size_t writeIndex = mWriteIndex.load(std::memory_order_acquire);
+
+    const size_t copy = std::min(count, writeIndex - readIndex);
+    const size_t start = readIndex & mMask;
+    const size_t firstChunk = std::min(copy, capacity() - start);
+
+    memcpy(out, &mBuffer[start], firstChunk * sizeof(sensors_event_t));
+    memcpy(out + firstChunk, &mBuffer[0], (copy - firstChunk) * sizeof(sensors_event_t));
+
+    mReadIndex.store(readIndex + copy, std::memory_order_release);
+    return copy;
+}
+
+inline size_t SensorEventRing::size() const {
+    // Load the read index first so that the difference can never underflow.
+    const size_t readIndex = mReadIndex.load(std::memory_order_acquire);
+    return mWriteIndex.load(std::memory_order_acquire) - readIndex;
+}
+
+inline uint64_t SensorEventRing::overflowCount() const {
+    return mOverflowCount.load(std::memory_order_relaxed);
+}
+
+#endif  // SENSOR_EVENT_RING_H_
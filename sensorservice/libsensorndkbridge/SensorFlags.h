@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSOR_FLAGS_H_
+
+#define SENSOR_FLAGS_H_
+
+#include <android/hardware/sensors/1.0/types.h>
+#include <android/sensor.h>
+
+#include <stdint.h>
+
+// Decodes the attributes packed into SensorInfo::flags. The NDK constants are
+// the HAL bit fields shifted down, so every attribute is a mask and a shift.
+namespace sensor_flags {
+
+using SensorFlagBits = android::hardware::sensors::V1_0::SensorFlagBits;
+using SensorFlagShift = android::hardware::sensors::V1_0::SensorFlagShift;
+
+constexpr uint32_t bits(SensorFlagBits flag) {
+    return static_cast<uint32_t>(flag);
+}
+
+constexpr unsigned kReportingModeShift = static_cast<unsigned>(SensorFlagShift::REPORTING_MODE);
+constexpr unsigned kDirectReportShift = static_cast<unsigned>(SensorFlagShift::DIRECT_REPORT);
+constexpr unsigned kDirectChannelShift = static_cast<unsigned>(SensorFlagShift::DIRECT_CHANNEL);
+
+static_assert((bits(SensorFlagBits::ON_CHANGE_MODE) >> kReportingModeShift) ==
+                      AREPORTING_MODE_ON_CHANGE &&
+              (bits(SensorFlagBits::ONE_SHOT_MODE) >> kReportingModeShift) ==
+                      AREPORTING_MODE_ONE_SHOT &&
+              (bits(SensorFlagBits::SPECIAL_REPORTING_MODE) >> kReportingModeShift) ==
+                      AREPORTING_MODE_SPECIAL_TRIGGER,
+              "Reporting modes do not match");
+// The mask covers the whole rate level field, which has room to spare.
+static_assert((bits(SensorFlagBits::MASK_DIRECT_REPORT) >> kDirectReportShift) >=
+                      ASENSOR_DIRECT_RATE_VERY_FAST,
+              "Direct report rate levels do not fit");
+static_assert((bits(SensorFlagBits::DIRECT_CHANNEL_ASHMEM) >> kDirectChannelShift) ==
+                      ASENSOR_DIRECT_CHANNEL_TYPE_SHARED_MEMORY &&
+              (bits(SensorFlagBits::DIRECT_CHANNEL_GRALLOC) >> kDirectChannelShift) ==
+                      ASENSOR_DIRECT_CHANNEL_TYPE_HARDWARE_BUFFER,
+              "Direct channel types do not match");
+
+constexpr bool isWakeUp(uint32_t flags) {
+    return (flags & bits(SensorFlagBits::WAKE_UP)) != 0;
+}
+
+constexpr int reportingMode(uint32_t flags) {
+    return static_cast<int>(
+            (flags & bits(SensorFlagBits::MASK_REPORTING_MODE)) >> kReportingModeShift);
+}
+
+constexpr bool isContinuous(uint32_t flags) {
+    return reportingMode(flags) == AREPORTING_MODE_CONTINUOUS;
+}
+
+constexpr int highestDirectReportRateLevel(uint32_t flags) {
+    return static_cast<int>(
+            (flags & bits(SensorFlagBits::MASK_DIRECT_REPORT)) >> kDirectReportShift);
+}
+
+// |channelType| is one of the ASENSOR_DIRECT_CHANNEL_TYPE_* values.
+constexpr bool supportsDirectChannelType(uint32_t flags, int channelType) {
+    return (channelType == ASENSOR_DIRECT_CHANNEL_TYPE_SHARED_MEMORY ||
+            channelType == ASENSOR_DIRECT_CHANNEL_TYPE_HARDWARE_BUFFER) &&
+           (flags & (static_cast<uint32_t>(channelType) << kDirectChannelShift)) != 0;
+}
+
+}  // namespace sensor_flags
+
+#endif  // SENSOR_FLAGS_H_
@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorMultiplexer.h"
+
+#include "SensorFlags.h"
+
+#define LOG_TAG "libsensorndkbridge"
+#include <android-base/logging.h>
+
+#include <algorithm>
+
+using android::Mutex;
+using android::sp;
+using android::hardware::Return;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::SensorType;
+
+SensorMultiplexer::Subscription::Subscription(
+        const sp<SensorMultiplexer> &multiplexer, bool decimate)
+    : mMultiplexer(multiplexer), mDecimate(decimate) {}
+
+Return<SensorMultiplexer::Result> SensorMultiplexer::Subscription::enableSensor(
+        int32_t sensorHandle, int32_t samplingPeriodUs, int64_t maxBatchReportLatencyUs) {
+    return mMultiplexer->enableSensor(
+            this, sensorHandle, samplingPeriodUs, maxBatchReportLatencyUs);
+}
+
+Return<SensorMultiplexer::Result> SensorMultiplexer::Subscription::disableSensor(
+        int32_t sensorHandle) {
+    return mMultiplexer->disableSensor(this, sensorHandle);
+}
+
+SensorMultiplexer::SensorMultiplexer(const hidl_vec<SensorInfo> &sensors)
+    : mRemoteCallCount(0) {
+    for (const auto &sensor : sensors) {
+        if (sensor_flags::isContinuous(sensor.flags)) {
+            mContinuousSensors.insert(sensor.sensorHandle);
+        }
+    }
+}
+
+sp<SensorMultiplexer::Subscription> SensorMultiplexer::subscribe(
+        const sp<IEventQueueCallback> &callback, bool decimate) {
+    sp<Subscription> subscription = new Subscription(this, decimate);
+
+    Mutex::Autolock autoLock(mLock);
+    mDeliveries[subscription.get()].callback = callback;
+    return subscription;
+}
+
+void SensorMultiplexer::unsubscribe(const sp<Subscription> &subscription) {
+    Mutex::Autolock configLock(mConfigLock);
+    Mutex::Autolock autoLock(mLock);
+
+    for (auto it = mSensors.begin(); it != mSensors.end();) {
+        auto &subscribers = it->second.subscribers;
+        subscribers.erase(
+                std::remove_if(subscribers.begin(), subscribers.end(),
+                               [&](const Subscriber &s) {
+                                   return s.subscription == subscription.get();
+                               }),
+                subscribers.end());
+
+        if (updateRemoteLocked(it->first, &it->second) != Result::OK) {
+            LOG(WARNING) << "Unable to update shared sensor " << it->first;
+        }
+
+        if (subscribers.empty()) {
+            it = mSensors.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    mDeliveries.erase(subscription.get());
+}
+
+void SensorMultiplexer::setImpl(const sp<IEventQueue> &remote) {
+    Mutex::Autolock configLock(mConfigLock);
+    Mutex::Autolock autoLock(mLock);
+    mRemote = remote;
+
+    if (mRemote == NULL) {
+        return;
+    }
+
+    for (auto &entry : mSensors) {
+        // Whatever the previous remote queue was asked for is gone with it.
+        entry.second.enabled = false;
+        if (updateRemoteLocked(entry.first, &entry.second) != Result::OK) {
+            LOG(WARNING) << "Unable to restore shared sensor " << entry.first;
+        }
+    }
+}
+
+bool SensorMultiplexer::hasImpl() const {
+    Mutex::Autolock autoLock(mLock);
+    return mRemote != NULL;
+}
+
+uint64_t SensorMultiplexer::getRemoteCallCount() const {
+    Mutex::Autolock autoLock(mLock);
+    return mRemoteCallCount;
+}
+
+SensorMultiplexer::Result SensorMultiplexer::enableSensor(
+        Subscription *subscription, int32_t sensorHandle, int32_t samplingPeriodUs,
+        int64_t maxBatchReportLatencyUs) {
+    Mutex::Autolock configLock(mConfigLock);
+    Mutex::Autolock autoLock(mLock);
+
+    if (mDeliveries.find(subscription) == mDeliveries.end()) {
+        return Result::BAD_VALUE;
+    }
+
+    SensorState &state = mSensors[sensorHandle];
+    auto it = std::find_if(state.subscribers.begin(), state.subscribers.end(),
+                           [&](const Subscriber &s) { return s.subscription == subscription; });
+
+    Subscriber previous = {};
+    const bool existed = it != state.subscribers.end();
+    if (existed) {
+        previous = *it;
+        it->samplingPeriodUs = samplingPeriodUs;
+        it->maxBatchReportLatencyUs = maxBatchReportLatencyUs;
+    } else {
+        state.subscribers.push_back(
+                {subscription, samplingPeriodUs, maxBatchReportLatencyUs, 0 /* lastTimestamp */});
+    }
+
+    const Result result = updateRemoteLocked(sensorHandle, &state);
+    if (result != Result::OK) {
+        if (existed) {
+            *std::find_if(state.subscribers.begin(), state.subscribers.end(),
+                          [&](const Subscriber &s) { return s.subscription == subscription; }) =
+                    previous;
+        } else {
+            state.subscribers.pop_back();
+        }
+        if (state.subscribers.empty() && !state.enabled) {
+            mSensors.erase(sensorHandle);
+        }
+    }
+
+    return result;
+}
+
+SensorMultiplexer::Result SensorMultiplexer::disableSensor(
+        Subscription *subscription, int32_t sensorHandle) {
+    Mutex::Autolock configLock(mConfigLock);
+    Mutex::Autolock autoLock(mLock);
+
+    auto sensor = mSensors.find(sensorHandle);
+    if (sensor == mSensors.end()) {
+        return Result::BAD_VALUE;
+    }
+
+    SensorState &state = sensor->second;
+    auto it = std::find_if(state.subscribers.begin(), state.subscribers.end(),
+                           [&](const Subscriber &s) { return s.subscription == subscription; });
+    if (it == state.subscribers.end()) {
+        return Result::BAD_VALUE;
+    }
+    state.subscribers.erase(it);
+
+    // Other subscribers may be slower now; the subscriber itself is gone
+    // either way, events it still gets are simply not delivered.
+    if (updateRemoteLocked(sensorHandle, &state) != Result::OK) {
+        LOG(WARNING) << "Unable to update shared sensor " << sensorHandle;
+    }
+
+    if (state.subscribers.empty()) {
+        mSensors.erase(sensor);
+    }
+
+    return Result::OK;
+}
+
+SensorMultiplexer::Result SensorMultiplexer::updateRemoteLocked(
+        int32_t sensorHandle, SensorState *state) {
+    const bool enabled = !state->subscribers.empty();
+    int32_t samplingPeriodUs = 0;
+    int64_t maxBatchReportLatencyUs = 0;
+    for (size_t i = 0; i < state->subscribers.size(); ++i) {
+        const Subscriber &s = state->subscribers[i];
+        samplingPeriodUs = i == 0 ? s.samplingPeriodUs
+                                  : std::min(samplingPeriodUs, s.samplingPeriodUs);
+        maxBatchReportLatencyUs = i == 0 ? s.maxBatchReportLatencyUs
+                                         : std::min(maxBatchReportLatencyUs,
+                                                    s.maxBatchReportLatencyUs);
+    }
+
+    if (enabled == state->enabled &&
+        (!enabled || (samplingPeriodUs == state->samplingPeriodUs &&
+                      maxBatchReportLatencyUs == state->maxBatchReportLatencyUs))) {
+        return Result::OK;
+    }
+
+    // Without a remote queue the configuration is applied by setImpl().
+    if (mRemote != NULL) {
+        // mRemote only changes under mConfigLock, which stays held.
+        const sp<IEventQueue> remote = mRemote;
+
+        mLock.unlock();
+        Return<Result> ret = enabled
+                ? remote->enableSensor(sensorHandle, samplingPeriodUs, maxBatchReportLatencyUs)
+                : remote->disableSensor(sensorHandle);
+        mLock.lock();
+        ++mRemoteCallCount;
+
+        // A dead service means setImpl() is on its way with a new queue.
+        if (!ret.isOk()) {
+            if (!ret.isDeadObject()) {
+                return Result::UNKNOWN_ERROR;
+            }
+        } else if (static_cast<Result>(ret) != Result::OK) {
+            return ret;
+        }
+    }
+
+    state->enabled = enabled;
+    state->samplingPeriodUs = samplingPeriodUs;
+    state->maxBatchReportLatencyUs = maxBatchReportLatencyUs;
+    return Result::OK;
+}
+
+bool SensorMultiplexer::shouldDeliverLocked(
+        const Event &event, const SensorState &state, Subscriber *subscriber) const {
+    if (!subscriber->subscription->mDecimate ||
+        subscriber->samplingPeriodUs <= state.samplingPeriodUs ||
+        event.sensorType == SensorType::META_DATA ||
+        event.sensorType == SensorType::ADDITIONAL_INFO ||
+        mContinuousSensors.count(event.sensorHandle) == 0) {
+        return true;
+    }
+
+    // Accept samples up to an eighth of a period early to absorb jitter.
+    const int64_t periodNs = static_cast<int64_t>(subscriber->samplingPeriodUs) * 1000;
+    if (subscriber->lastTimestamp != 0 &&
+        event.timestamp - subscriber->lastTimestamp < periodNs - periodNs / 8) {
+        return false;
+    }
+
+    subscriber->lastTimestamp = event.timestamp;
+    return true;
+}
+
+Return<void> SensorMultiplexer::onEvent(const Event &event) {
+    Mutex::Autolock autoLock(mLock);
+
+    auto sensor = mSensors.find(event.sensorHandle);
+    if (sensor == mSensors.end()) {
+        return android::hardware::Void();
+    }
+
+    for (auto &subscriber : sensor->second.subscribers) {
+        if (shouldDeliverLocked(event, sensor->second, &subscriber)) {
+            Return<void> ret = mDeliveries[subscriber.subscription].callback->onEvent(event);
+            (void)ret.isOk();
+        }
+    }
+
+    return android::hardware::Void();
+}
+
+Return<void> SensorMultiplexer::onEvents(const hidl_vec<Event> &events) {
+    Mutex::Autolock autoLock(mLock);
+    deliverLocked(events.data(), events.size());
+    return android::hardware::Void();
+}
+
+Return<void> SensorMultiplexer::onCompressedEvents(const hidl_vec<uint8_t> &data) {
+    Mutex::Autolock autoLock(mLock);
+
+    // Decoded once here, and delivered to the subscribers uncompressed.
+    if (!mDecoder.decode(data.data(), data.size(), &mDecodedEvents)) {
+        LOG(ERROR) << "Dropping malformed compressed sensor events";
+        return android::hardware::Void();
+    }
+
+    deliverLocked(mDecodedEvents.data(), mDecodedEvents.size());
+    return android::hardware::Void();
+}
+
+void SensorMultiplexer::deliverLocked(const Event *events, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        const Event &event = events[i];
+        auto sensor = mSensors.find(event.sensorHandle);
+        if (sensor == mSensors.end()) {
+            continue;
+        }
+
+        for (auto &subscriber : sensor->second.subscribers) {
+            if (shouldDeliverLocked(event, sensor->second, &subscriber)) {
+                mDeliveries[subscriber.subscription].events.push_back(event);
+            }
+        }
+    }
+
+    // The scratch vectors keep their capacity, so steady-state batches do
+    // not allocate.
+    for (auto &entry : mDeliveries) {
+        Delivery &delivery = entry.second;
+        if (delivery.events.empty()) {
+            continue;
+        }
+
+        hidl_vec<Event> batch;
+        batch.setToExternal(delivery.events.data(), delivery.events.size());
+        Return<void> ret = delivery.callback->onEvents(batch);
+        (void)ret.isOk();
+        delivery.events.clear();
+    }
+}
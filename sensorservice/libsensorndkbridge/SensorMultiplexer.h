@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSOR_MULTIPLEXER_H_
+
+#define SENSOR_MULTIPLEXER_H_
+
+#include "SensorEventCodec.h"
+
+#include <android/frameworks/sensorservice/1.0/IEventQueue.h>
+#include <android/frameworks/sensorservice/1.1/IEventQueueCallback.h>
+#include <android-base/macros.h>
+#include <utils/Mutex.h>
+#include <utils/StrongPointer.h>
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Shares one remote IEventQueue between the local queues of a process.
+//
+// Every local queue gets a Subscription, a local IEventQueue that records the
+// rate and batch latency the queue asks for. The multiplexer keeps a single
+// remote subscription per sensor handle at the fastest rate and the shortest
+// latency any subscriber asked for, and fans the events it receives out to
+// the subscribers of their sensor. A subscriber created with decimation only
+// gets events of continuous sensors at roughly the rate it asked for.
+struct SensorMultiplexer
+    : public android::frameworks::sensorservice::V1_1::IEventQueueCallback {
+    using Event = android::hardware::sensors::V1_0::Event;
+    using IEventQueue = android::frameworks::sensorservice::V1_0::IEventQueue;
+    using IEventQueueCallback = android::frameworks::sensorservice::V1_1::IEventQueueCallback;
+    using Result = android::frameworks::sensorservice::V1_0::Result;
+    using SensorInfo = android::hardware::sensors::V1_0::SensorInfo;
+
+    struct Subscription : public IEventQueue {
+        Subscription(const android::sp<SensorMultiplexer> &multiplexer, bool decimate);
+
+        android::hardware::Return<Result> enableSensor(
+                int32_t sensorHandle, int32_t samplingPeriodUs,
+                int64_t maxBatchReportLatencyUs) override;
+        android::hardware::Return<Result> disableSensor(int32_t sensorHandle) override;
+
+    private:
+        friend struct SensorMultiplexer;
+
+        const android::sp<SensorMultiplexer> mMultiplexer;
+        const bool mDecimate;
+
+        DISALLOW_COPY_AND_ASSIGN(Subscription);
+    };
+
+    // |sensors| tells continuous sensors, whose events may be decimated,
+    // from the others.
+    explicit SensorMultiplexer(const android::hardware::hidl_vec<SensorInfo> &sensors);
+
+    // Returns the local queue through which |callback| subscribes to sensors.
+    android::sp<Subscription> subscribe(
+            const android::sp<IEventQueueCallback> &callback, bool decimate);
+
+    // Drops every sensor of |subscription| and stops delivering to it.
+    void unsubscribe(const android::sp<Subscription> &subscription);
+
+    // Attaches the remote queue, enabling every subscribed sensor on it, or
+    // detaches it when |remote| is null.
+    void setImpl(const android::sp<IEventQueue> &remote);
+    bool hasImpl() const;
+
+    // Number of enableSensor/disableSensor calls made on the remote queue.
+    uint64_t getRemoteCallCount() const;
+
+    android::hardware::Return<void> onEvent(const Event &event) override;
+    android::hardware::Return<void> onEvents(
+            const android::hardware::hidl_vec<Event> &events) override;
+    android::hardware::Return<void> onCompressedEvents(
+            const android::hardware::hidl_vec<uint8_t> &data) override;
+
+private:
+    struct Subscriber {
+        Subscription *subscription;
+        int32_t samplingPeriodUs;
+        int64_t maxBatchReportLatencyUs;
+        int64_t lastTimestamp;
+    };
+
+    struct SensorState {
+        std::vector<Subscriber> subscribers;
+
+        // What the remote queue was last asked for.
+        bool enabled = false;
+        int32_t samplingPeriodUs = 0;
+        int64_t maxBatchReportLatencyUs = 0;
+    };
+
+    // Per subscription scratch space for one batch of events.
+    struct Delivery {
+        android::sp<IEventQueueCallback> callback;
+        std::vector<Event> events;
+    };
+
+    Result enableSensor(Subscription *subscription, int32_t sensorHandle,
+                        int32_t samplingPeriodUs, int64_t maxBatchReportLatencyUs);
+    Result disableSensor(Subscription *subscription, int32_t sensorHandle);
+
+    // Brings the remote subscription of |sensorHandle| in line with its
+    // subscribers. Called with mConfigLock and mLock held; mLock is dropped
+    // around the remote call, so that delivery to other subscribers goes on.
+    Result updateRemoteLocked(int32_t sensorHandle, SensorState *state);
+
+    bool shouldDeliverLocked(
+            const Event &event, const SensorState &state, Subscriber *subscriber) const;
+
+    void deliverLocked(const Event *events, size_t count);
+
+    // Serializes changes to the subscribers and to the remote queue, and is
+    // taken before mLock. Sensors are only added to or removed from mSensors
+    // with it held, so their state outlives the remote calls.
+    android::Mutex mConfigLock;
+
+    // Events are fanned out with mLock held, so a subscription cannot go
+    // away while it is being delivered to.
+    mutable android::Mutex mLock;
+    android::sp<IEventQueue> mRemote;
+    std::unordered_set<int32_t> mContinuousSensors;
+    std::unordered_map<int32_t, SensorState> mSensors;
+    std::unordered_map<Subscription *, Delivery> mDeliveries;
+    uint64_t mRemoteCallCount;
+
+    SensorEventDecoder mDecoder;
+    std::vector<Event> mDecodedEvents;
+
+    DISALLOW_COPY_AND_ASSIGN(SensorMultiplexer);
+};
+
+#endif  // SENSOR_MULTIPLEXER_H_
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorTrace.h"
+
+#include "Varint.h"
+
+#define LOG_TAG "libsensorndkbridge"
+#include <android-base/file.h>
+#include <android-base/logging.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+using android::BAD_VALUE;
+using android::INVALID_OPERATION;
+using android::OK;
+using android::status_t;
+using android::hardware::sensors::V1_0::SensorType;
+using namespace sensor_trace;
+
+// static
+constexpr size_t SensorTraceWriter::kFlushThreshold;
+
+static void putBytes(std::vector<uint8_t> *out, const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    out->insert(out->end(), bytes, bytes + size);
+}
+
+SensorTraceWriter::SensorTraceWriter(int fd)
+    : mFd(fd),
+      mError(OK),
+      mFinished(false),
+      mOffset(0),
+      mEventCount(0),
+      mPreviousTimestamp(0) {
+    mBuffer.reserve(kFlushThreshold + sizeof(Event) * 2);
+
+    const Header header = {kMagic, kVersion};
+    putBytes(&mBuffer, &header, sizeof(header));
+}
+
+SensorTraceWriter::~SensorTraceWriter() {
+    if (!mFinished) {
+        finish();
+    }
+}
+
+void SensorTraceWriter::append(const Event &event) {
+    if (mFinished || mError != OK) {
+        return;
+    }
+
+    if (mEventCount % kIndexInterval == 0) {
+        mIndex.push_back({event.timestamp, mOffset + mBuffer.size(), mEventCount});
+        mPreviousTimestamp = 0;
+    }
+
+    putVarint(&mBuffer, zigzagEncode(event.timestamp - mPreviousTimestamp));
+    putVarint(&mBuffer, zigzagEncode(event.sensorHandle));
+    putVarint(&mBuffer, static_cast<uint32_t>(event.sensorType));
+
+    const uint8_t *payload = reinterpret_cast<const uint8_t *>(&event.u);
+    size_t length = kPayloadSize;
+    while (length > 0 && payload[length - 1] == 0) {
+        --length;
+    }
+    mBuffer.push_back(static_cast<uint8_t>(length));
+    putBytes(&mBuffer, payload, length);
+
+    mPreviousTimestamp = event.timestamp;
+    ++mEventCount;
+
+    if (mBuffer.size() >= kFlushThreshold) {
+        flush();
+    }
+}
+
+status_t SensorTraceWriter::flush() {
+    if (mError != OK || mBuffer.empty()) {
+        return mError;
+    }
+
+    if (!android::base::WriteFully(mFd, mBuffer.data(), mBuffer.size())) {
+        PLOG(ERROR) << "Unable to write sensor trace";
+        mError = -errno;
+        return mError;
+    }
+
+    mOffset += mBuffer.size();
+    mBuffer.clear();
+    return OK;
+}
+
+status_t SensorTraceWriter::finish() {
+    if (mFinished) {
+        return INVALID_OPERATION;
+    }
+    mFinished = true;
+
+    // Keep the index and footer aligned for readers that map the file.
+    while ((mOffset + mBuffer.size()) % alignof(IndexEntry) != 0) {
+        mBuffer.push_back(0);
+    }
+
+    const Footer footer = {
+        mOffset + mBuffer.size(), mIndex.size(), mEventCount, kMagic, 0 /* reserved */};
+    putBytes(&mBuffer, mIndex.data(), mIndex.size() * sizeof(IndexEntry));
+    putBytes(&mBuffer, &footer, sizeof(footer));
+
+    return flush();
+}
+
+SensorTraceReader::Cursor::Cursor(
+        const uint8_t *position, const uint8_t *end, uint64_t eventIndex, uint64_t eventCount)
+    : mPosition(position),
+      mEnd(end),
+      mEventIndex(eventIndex),
+      mEventCount(eventCount),
+      mPreviousTimestamp(0) {}
+
+bool SensorTraceReader::Cursor::next(Event *event) {
+    if (mEventIndex >= mEventCount) {
+        return false;
+    }
+
+    uint64_t delta;
+    uint64_t sensorHandle;
+    uint64_t sensorType;
+    if (!getVarint(&mPosition, mEnd, &delta) ||
+        !getVarint(&mPosition, mEnd, &sensorHandle) ||
+        !getVarint(&mPosition, mEnd, &sensorType) ||
+        mPosition >= mEnd) {
+        mPosition = mEnd;
+        return false;
+    }
+
+    const size_t length = *mPosition++;
+    if (length > kPayloadSize || length > static_cast<size_t>(mEnd - mPosition)) {
+        LOG(ERROR) << "Corrupt sensor trace record " << mEventIndex;
+        mPosition = mEnd;
+        return false;
+    }
+
+    // Every kIndexInterval-th record restarts the delta encoding.
+    if (mEventIndex % kIndexInterval == 0) {
+        mPreviousTimestamp = 0;
+    }
+
+    event->timestamp = mPreviousTimestamp + zigzagDecode(delta);
+    event->sensorHandle = static_cast<int32_t>(zigzagDecode(sensorHandle));
+    event->sensorType = static_cast<SensorType>(sensorType);
+    memset(&event->u, 0, kPayloadSize);
+    memcpy(&event->u, mPosition, length);
+
+    mPosition += length;
+    mPreviousTimestamp = event->timestamp;
+    ++mEventIndex;
+    return true;
+}
+
+SensorTraceReader::SensorTraceReader()
+    : mAddress(MAP_FAILED), mSize(0), mFooter(nullptr), mIndex(nullptr) {}
+
+SensorTraceReader::~SensorTraceReader() {
+    unmap();
+}
+
+void SensorTraceReader::unmap() {
+    if (mAddress != MAP_FAILED) {
+        munmap(mAddress, mSize);
+    }
+    mAddress = MAP_FAILED;
+    mSize = 0;
+    mFooter = nullptr;
+    mIndex = nullptr;
+}
+
+status_t SensorTraceReader::open(const std::string &path) {
+    android::base::unique_fd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0) {
+        PLOG(ERROR) << "Unable to open sensor trace " << path;
+        return -errno;
+    }
+    return open(fd.get());
+}
+
+status_t SensorTraceReader::open(int fd) {
+    unmap();
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -errno;
+    }
+
+    const size_t size = static_cast<size_t>(st.st_size);
+    if (size < sizeof(Header) + sizeof(Footer) || size % alignof(Footer) != 0) {
+        return BAD_VALUE;
+    }
+
+    void *address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0 /* offset */);
+    if (address == MAP_FAILED) {
+        PLOG(ERROR) << "Unable to map sensor trace";
+        return -errno;
+    }
+    mAddress = address;
+    mSize = size;
+
+    const uint8_t *base = static_cast<const uint8_t *>(mAddress);
+    const Header *header = reinterpret_cast<const Header *>(base);
+    const Footer *footer = reinterpret_cast<const Footer *>(base + size - sizeof(Footer));
+
+    if (header->magic != kMagic || header->version != kVersion || footer->magic != kMagic ||
+        footer->indexOffset < sizeof(Header) ||
+        footer->indexOffset > size - sizeof(Footer) ||
+        footer->indexOffset % alignof(IndexEntry) != 0 ||
+        footer->indexCount > (size - sizeof(Footer) - footer->indexOffset) / sizeof(IndexEntry) ||
+        footer->indexOffset + footer->indexCount * sizeof(IndexEntry) !=
+                size - sizeof(Footer)) {
+        LOG(ERROR) << "Invalid sensor trace";
+        unmap();
+        return BAD_VALUE;
+    }
+
+    mFooter = footer;
+    mIndex = reinterpret_cast<const IndexEntry *>(base + footer->indexOffset);
+    return OK;
+}
+
+uint64_t SensorTraceReader::getEventCount() const {
+    return mFooter != nullptr ? mFooter->eventCount : 0;
+}
+
+SensorTraceReader::Cursor SensorTraceReader::begin() const {
+    if (mFooter == nullptr) {
+        return Cursor(nullptr, nullptr, 0, 0);
+    }
+
+    const uint8_t *base = static_cast<const uint8_t *>(mAddress);
+    return Cursor(base + sizeof(Header), base + mFooter->indexOffset, 0, mFooter->eventCount);
+}
+
+SensorTraceReader::Cursor SensorTraceReader::seek(int64_t timestamp) const {
+    if (mFooter == nullptr || mFooter->indexCount == 0) {
+        return begin();
+    }
+
+    const IndexEntry *end = mIndex + mFooter->indexCount;
+    const IndexEntry *entry = std::upper_bound(
+            mIndex, end, timestamp,
+            [](int64_t t, const IndexEntry &e) { return t < e.timestamp; });
+    if (entry != mIndex) {
+        --entry;
+    }
+
+    if (entry->offset < sizeof(Header) || entry->offset >= mFooter->indexOffset) {
+        LOG(ERROR) << "Corrupt sensor trace index";
+        return begin();
+    }
+
+    const uint8_t *base = static_cast<const uint8_t *>(mAddress);
+    return Cursor(base + entry->offset, base + mFooter->indexOffset, entry->eventIndex,
+                  mFooter->eventCount);
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSOR_TRACE_H_
+
+#define SENSOR_TRACE_H_
+
+#include <android-base/macros.h>
+#include <android-base/unique_fd.h>
+#include <android/hardware/sensors/1.0/types.h>
+#include <utils/Errors.h>
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// A sensor trace is a file of the events a queue received, laid out as
+//
+//   Header | record... | IndexEntry... | Footer
+//
+// Each record is
+//
+//   varint  zigzag(timestamp - previous timestamp)
+//   varint  zigzag(sensorHandle)
+//   varint  sensorType
+//   uint8   payload length n, the payload with trailing zero bytes removed
+//   n bytes payload
+//
+// The previous timestamp is reset to 0 every kIndexInterval records, and
+// each such record gets an index entry, so that a reader can start decoding
+// at any indexed record. The index starts 8-byte aligned, after zero padding.
+// All integers are little-endian.
+namespace sensor_trace {
+
+using Event = android::hardware::sensors::V1_0::Event;
+
+constexpr uint32_t kMagic = 0x52544e53;  // "SNTR"
+constexpr uint32_t kVersion = 1;
+constexpr size_t kIndexInterval = 256;
+constexpr size_t kPayloadSize = sizeof(Event::u);
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct IndexEntry {
+    int64_t timestamp;
+    uint64_t offset;
+    uint64_t eventIndex;
+};
+
+struct Footer {
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    uint64_t eventCount;
+    uint32_t magic;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(Header) == 8, "Header must be packed");
+static_assert(sizeof(IndexEntry) == 24, "IndexEntry must be packed");
+static_assert(sizeof(Footer) == 32, "Footer must be packed");
+
+}  // namespace sensor_trace
+
+// Appends events to a trace file. Records are buffered and written in large
+// chunks, so append() costs no system call most of the time. Not thread-safe.
+struct SensorTraceWriter {
+    using Event = sensor_trace::Event;
+
+    // Writes the trace to |fd|, which must be at the start of an empty file.
+    // The writer does not own |fd|.
+    explicit SensorTraceWriter(int fd);
+    ~SensorTraceWriter();
+
+    void append(const Event &event);
+
+    // Writes the index and footer. Nothing can be appended afterwards.
+    android::status_t finish();
+
+    uint64_t getEventCount() const { return mEventCount; }
+
+private:
+    static constexpr size_t kFlushThreshold = 64 * 1024;
+
+    android::status_t flush();
+
+    int mFd;
+    android::status_t mError;
+    bool mFinished;
+
+    std::vector<uint8_t> mBuffer;
+    uint64_t mOffset;
+    uint64_t mEventCount;
+    int64_t mPreviousTimestamp;
+    std::vector<sensor_trace::IndexEntry> mIndex;
+
+    DISALLOW_COPY_AND_ASSIGN(SensorTraceWriter);
+};
+
+// Decodes a trace file mapped read-only into memory.
+struct SensorTraceReader {
+    using Event = sensor_trace::Event;
+
+    // Sequential decoder. Cursors are independent of each other and only
+    // valid while their reader is.
+    struct Cursor {
+        // Decodes the next event into |event|, returning false at the end of
+        // the trace.
+        bool next(Event *event);
+
+        uint64_t getEventIndex() const { return mEventIndex; }
+
+    private:
+        friend struct SensorTraceReader;
+
+        Cursor(const uint8_t *position, const uint8_t *end, uint64_t eventIndex,
+               uint64_t eventCount);
+
+        const uint8_t *mPosition;
+        const uint8_t *mEnd;
+        uint64_t mEventIndex;
+        uint64_t mEventCount;
+        int64_t mPreviousTimestamp;
+    };
+
+    SensorTraceReader();
+    ~SensorTraceReader();
+
+    android::status_t open(const std::string &path);
+    android::status_t open(int fd);
+
+    uint64_t getEventCount() const;
+
+    // Returns a cursor at the first event.
+    Cursor begin() const;
+
+    // Returns a cursor at an indexed event at or before the first event with
+    // a timestamp of at least |timestamp|, assuming timestamps do not go
+    // backwards across index entries.
+    Cursor seek(int64_t timestamp) const;
+
+private:
+    void unmap();
+
+    void *mAddress;
+    size_t mSize;
+    const sensor_trace::Footer *mFooter;
+    const sensor_trace::IndexEntry *mIndex;
+
+    DISALLOW_COPY_AND_ASSIGN(SensorTraceReader);
+};
+
+#endif  // SENSOR_TRACE_H_
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VARINT_H_
+
+#define VARINT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// LEB128 varints and zigzag encoding of signed values, as used by the sensor
+// trace and compact event formats.
+
+inline uint64_t zigzagEncode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+inline void putVarint(std::vector<uint8_t> *out, uint64_t value) {
+    while (value >= 0x80) {
+        out->push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out->push_back(static_cast<uint8_t>(value));
+}
+
+// Advances |*position| past the varint and returns true, or returns false if
+// the varint does not end before |end|.
+inline bool getVarint(const uint8_t **position, const uint8_t *end, uint64_t *value) {
+    // Most values fit in one byte.
+    if (*position < end && (**position & 0x80) == 0) {
+        *value = *(*position)++;
+        return true;
+    }
+
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64 && *position < end; shift += 7) {
+        const uint8_t byte = *(*position)++;
+        result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif  // VARINT_H_
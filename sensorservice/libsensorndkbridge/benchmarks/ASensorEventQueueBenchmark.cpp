@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ALooper.h"
+#include "ASensorEventQueue.h"
+#include "FakeSensorManager.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using android::sp;
+using android::frameworks::sensorservice::testing::FakeEventQueue;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::Event;
+
+namespace {
+
+constexpr size_t kQueueCapacity = 16384;
+
+// A client queue attached to an in-process fake server, with a batch of
+// accelerometer events ready to be injected.
+struct QueueFixture {
+    explicit QueueFixture(size_t batchSize,
+                          ALooper_callbackFunc callback = nullptr,
+                          void *data = nullptr)
+        : mManager(new FakeSensorManager),
+          mLooper(new ALooper),
+          mQueue(new ASensorEventQueue(mLooper.get(), 0 /* ident */, callback, data, kQueueCapacity)),
+          mBuffer(kQueueCapacity) {
+        mManager->createEventQueue(mQueue, [&](const auto &queueImpl, auto) {
+            mQueue->setImpl(queueImpl);
+        });
+        mServer = mManager->getEventQueues().back();
+
+        const auto &accelerometer = mManager->sensors()[0];
+        mEvents.resize(batchSize);
+        for (size_t i = 0; i < batchSize; ++i) {
+            mEvents[i] = FakeSensorManager::makeEvent(accelerometer, 1000000 * (i + 1));
+        }
+    }
+
+    ~QueueFixture() {
+        mQueue->invalidate();
+        mQueue.clear();
+    }
+
+    void drain() {
+        while (mQueue->getEvents(mBuffer.data(), mBuffer.size()) > 0) {
+        }
+    }
+
+    sp<FakeSensorManager> mManager;
+    sp<ALooper> mLooper;
+    sp<ASensorEventQueue> mQueue;
+    sp<FakeEventQueue> mServer;
+    hidl_vec<Event> mEvents;
+    std::vector<ASensorEvent> mBuffer;
+};
+
+// items_per_second is the event throughput; its inverse is the CPU time spent
+// per event in the bridge.
+void BM_DeliverPerEvent(benchmark::State &state) {
+    QueueFixture fixture(state.range(0));
+    for (auto _ : state) {
+        fixture.mServer->injectEvents(fixture.mEvents);
+        fixture.drain();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DeliverPerEvent)->RangeMultiplier(4)->Range(1, 4096);
+
+void BM_DeliverBatched(benchmark::State &state) {
+    QueueFixture fixture(state.range(0));
+    for (auto _ : state) {
+        fixture.mServer->injectEventBatch(fixture.mEvents);
+        fixture.drain();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DeliverBatched)->RangeMultiplier(4)->Range(1, 4096);
+
+// Only the reads are timed: the cost of getEvents() against how many events
+// are queued.
+void BM_DrainQueueDepth(benchmark::State &state) {
+    QueueFixture fixture(state.range(0));
+    for (auto _ : state) {
+        state.PauseTiming();
+        fixture.mServer->injectEventBatch(fixture.mEvents);
+        state.ResumeTiming();
+
+        fixture.drain();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DrainQueueDepth)->RangeMultiplier(4)->Range(1, 16384);
+
+// Measures the wall time from IEventQueueCallback::onEvent on the binder
+// thread until the client callback has run on a thread in ALooper::pollOnce.
+void BM_OnEventToCallbackLatency(benchmark::State &state) {
+    struct Context {
+        ASensorEventQueue *queue;
+        std::atomic<uint64_t> dispatchCount;
+        ASensorEvent buffer[16];
+    } context;
+    context.dispatchCount = 0;
+
+    auto callback = [](int /* fd */, int /* events */, void *data) -> int {
+        Context *context = static_cast<Context *>(data);
+        while (context->queue->getEvents(context->buffer, 16) > 0) {
+        }
+        context->dispatchCount.fetch_add(1);
+        return 1;
+    };
+
+    QueueFixture fixture(1, callback, &context);
+    context.queue = fixture.mQueue.get();
+
+    std::atomic_bool done(false);
+    std::thread poller([&] {
+        while (!done.load()) {
+            fixture.mLooper->pollOnce(-1 /* timeoutMillis */, nullptr, nullptr, nullptr);
+        }
+    });
+
+    for (auto _ : state) {
+        const uint64_t expected = context.dispatchCount.load() + 1;
+        fixture.mServer->injectEvents(fixture.mEvents);
+        while (context.dispatchCount.load() < expected) {
+        }
+    }
+
+    done = true;
+    fixture.mLooper->wake();
+    poller.join();
+}
+BENCHMARK(BM_OnEventToCallbackLatency)->UseRealTime();
+
+// Measures the wall time from ALooper::wake() until pollOnce() returns on the
+// polling thread, without any sensor queue involved.
+void BM_PollOnceWakeLatency(benchmark::State &state) {
+    sp<ALooper> looper = new ALooper;
+    std::atomic<uint64_t> wakeCount(0);
+    std::atomic_bool done(false);
+
+    std::thread poller([&] {
+        while (!done.load()) {
+            looper->pollOnce(-1 /* timeoutMillis */, nullptr, nullptr, nullptr);
+            wakeCount.fetch_add(1);
+        }
+    });
+
+    for (auto _ : state) {
+        const uint64_t expected = wakeCount.load() + 1;
+        looper->wake();
+        while (wakeCount.load() < expected) {
+        }
+    }
+
+    done = true;
+    looper->wake();
+    poller.join();
+}
+BENCHMARK(BM_PollOnceWakeLatency)->UseRealTime();
+
+}  // namespace
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ALooper.h"
+#include "ASensorManager.h"
+#include "FakeSensorManager.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <memory>
+
+using android::sp;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::SensorInfo;
+using android::hardware::sensors::V1_0::SensorType;
+
+namespace {
+
+// The default list, padded with extra sensors to |count| entries.
+hidl_vec<SensorInfo> makeSensorList(size_t count) {
+    hidl_vec<SensorInfo> defaults = FakeSensorManager::makeDefaultSensorList();
+    hidl_vec<SensorInfo> sensors;
+    sensors.resize(std::max(count, defaults.size()));
+    for (size_t i = 0; i < sensors.size(); ++i) {
+        sensors[i] = i < defaults.size()
+                ? defaults[i]
+                : FakeSensorManager::makeSensorInfo(
+                          static_cast<int32_t>(i + 1), SensorType::ACCELEROMETER, "extra");
+    }
+    return sensors;
+}
+
+// The first call fetches the list from the service and builds the handle and
+// default sensor indices.
+void BM_GetSensorListCold(benchmark::State &state) {
+    sp<FakeSensorManager> fake = new FakeSensorManager(makeSensorList(state.range(0)));
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::unique_ptr<ASensorManager> manager(new ASensorManager(fake));
+        state.ResumeTiming();
+
+        ASensorList list;
+        benchmark::DoNotOptimize(manager->getSensorList(&list));
+
+        state.PauseTiming();
+        manager.reset();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_GetSensorListCold)->RangeMultiplier(4)->Range(8, 512);
+
+void BM_GetSensorListWarm(benchmark::State &state) {
+    sp<FakeSensorManager> fake = new FakeSensorManager(makeSensorList(state.range(0)));
+    ASensorManager manager(fake);
+    ASensorList list;
+    manager.getSensorList(&list);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager.getSensorList(&list));
+    }
+}
+BENCHMARK(BM_GetSensorListWarm)->RangeMultiplier(4)->Range(8, 512);
+
+// One queue created and destroyed per iteration, including the service side
+// dropping its end of the queue.
+void BM_CreateDestroyEventQueue(benchmark::State &state) {
+    sp<FakeSensorManager> fake = new FakeSensorManager;
+    ASensorManager manager(fake);
+    sp<ALooper> looper = new ALooper;
+
+    for (auto _ : state) {
+        ASensorEventQueue *queue =
+                manager.createEventQueue(looper.get(), 0 /* ident */, nullptr, nullptr);
+        manager.destroyEventQueue(queue);
+        fake->clearEventQueues();
+    }
+}
+BENCHMARK(BM_CreateDestroyEventQueue);
+
+void BM_CreateDestroyFmqEventQueue(benchmark::State &state) {
+    sp<FakeSensorManager> fake = new FakeSensorManager;
+    ASensorManager manager(fake);
+    sp<ALooper> looper = new ALooper;
+
+    for (auto _ : state) {
+        ASensorEventQueue *queue =
+                manager.createFmqEventQueue(looper.get(), 0 /* ident */, nullptr, nullptr);
+        manager.destroyEventQueue(queue);
+        fake->clearEventQueues();
+    }
+}
+BENCHMARK(BM_CreateDestroyFmqEventQueue);
+
+}  // namespace
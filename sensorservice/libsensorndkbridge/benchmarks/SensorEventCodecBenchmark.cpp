@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeSensorManager.h"
+#include "SensorEventCodec.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string.h>
+
+#include <vector>
+
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::Event;
+using android::hardware::sensors::V1_0::SensorInfo;
+
+namespace {
+
+// A 400Hz batch of the default motion sensors with slowly varying values.
+std::vector<Event> makeEvents(const hidl_vec<SensorInfo> &sensors, size_t count) {
+    std::vector<Event> events;
+    for (size_t i = 0; i < count; ++i) {
+        const SensorInfo &sensor = sensors[i % 6];
+        Event event = FakeSensorManager::makeEvent(sensor, 2500000 * (i + 1));
+        memset(&event.u, 0, sizeof(event.u));
+        for (int axis = 0; axis < 6; ++axis) {
+            event.u.data[axis] = sensor_event_codec::dequantize(
+                    981 + static_cast<int32_t>(i / 8) * (axis - 2), sensor.resolution);
+        }
+        events.push_back(event);
+    }
+    return events;
+}
+
+void BM_EncodeEvents(benchmark::State &state) {
+    const auto sensors = FakeSensorManager::makeDefaultSensorList();
+    const auto events = makeEvents(sensors, state.range(0));
+    SensorEventEncoder encoder(sensors);
+    std::vector<uint8_t> data;
+
+    for (auto _ : state) {
+        encoder.encode(events.data(), events.size(), &data);
+        benchmark::DoNotOptimize(data.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * events.size());
+    state.counters["bytesPerEvent"] = static_cast<double>(data.size()) / events.size();
+}
+BENCHMARK(BM_EncodeEvents)->RangeMultiplier(4)->Range(16, 1024);
+
+void BM_DecodeEvents(benchmark::State &state) {
+    const auto sensors = FakeSensorManager::makeDefaultSensorList();
+    const auto events = makeEvents(sensors, state.range(0));
+    std::vector<uint8_t> data;
+    SensorEventEncoder(sensors).encode(events.data(), events.size(), &data);
+
+    SensorEventDecoder decoder;
+    std::vector<Event> decoded;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(decoder.decode(data.data(), data.size(), &decoded));
+    }
+
+    state.SetItemsProcessed(state.iterations() * events.size());
+}
+BENCHMARK(BM_DecodeEvents)->RangeMultiplier(4)->Range(16, 1024);
+
+}  // namespace
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeSensorManager.h"
+#include "SensorEventConversion.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::Event;
+using android::hardware::sensors::V1_0::SensorInfo;
+using android::hardware::sensors::V1_0::SensorType;
+using android::hardware::sensors::V1_0::implementation::convertToSensorEvent;
+
+namespace {
+
+// Events converted per iteration, about one hardware FIFO flush.
+constexpr size_t kBatchSize = 256;
+
+const SensorType kSensorTypes[] = {
+    SensorType::ACCELEROMETER,
+    SensorType::MAGNETIC_FIELD,
+    SensorType::ORIENTATION,
+    SensorType::GYROSCOPE,
+    SensorType::LIGHT,
+    SensorType::PRESSURE,
+    SensorType::PROXIMITY,
+    SensorType::GRAVITY,
+    SensorType::LINEAR_ACCELERATION,
+    SensorType::ROTATION_VECTOR,
+    SensorType::RELATIVE_HUMIDITY,
+    SensorType::AMBIENT_TEMPERATURE,
+    SensorType::MAGNETIC_FIELD_UNCALIBRATED,
+    SensorType::GAME_ROTATION_VECTOR,
+    SensorType::GYROSCOPE_UNCALIBRATED,
+    SensorType::SIGNIFICANT_MOTION,
+    SensorType::STEP_DETECTOR,
+    SensorType::STEP_COUNTER,
+    SensorType::GEOMAGNETIC_ROTATION_VECTOR,
+    SensorType::HEART_RATE,
+    SensorType::ACCELEROMETER_UNCALIBRATED,
+};
+
+hidl_vec<Event> makeEvents(SensorType type) {
+    SensorInfo sensor;
+    sensor.sensorHandle = 1;
+    sensor.type = type;
+
+    hidl_vec<Event> events;
+    events.resize(kBatchSize);
+    for (size_t i = 0; i < kBatchSize; ++i) {
+        events[i] = FakeSensorManager::makeEvent(sensor, 1000000 * (i + 1));
+    }
+    return events;
+}
+
+template <void (*Convert)(const Event &, sensors_event_t *)>
+void BM_Convert(benchmark::State &state) {
+    const SensorType type = kSensorTypes[state.range(0)];
+    const hidl_vec<Event> events = makeEvents(type);
+    std::vector<sensors_event_t> out(kBatchSize);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < kBatchSize; ++i) {
+            Convert(events[i], &out[i]);
+        }
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * kBatchSize);
+    state.SetLabel(android::hardware::sensors::V1_0::toString(type));
+}
+
+void BM_ConvertGeneric(benchmark::State &state) {
+    BM_Convert<convertToSensorEvent>(state);
+}
+BENCHMARK(BM_ConvertGeneric)->DenseRange(0, sizeof(kSensorTypes) / sizeof(kSensorTypes[0]) - 1);
+
+void BM_ConvertFastPath(benchmark::State &state) {
+    BM_Convert<convertSensorEvent>(state);
+}
+BENCHMARK(BM_ConvertFastPath)->DenseRange(0, sizeof(kSensorTypes) / sizeof(kSensorTypes[0]) - 1);
+
+}  // namespace
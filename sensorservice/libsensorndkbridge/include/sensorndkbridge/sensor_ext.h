@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Extensions to the NDK sensor API (android/sensor.h) that are only
+ * available to clients of libsensorndkbridge.
+ */
+
+#ifndef SENSORNDKBRIDGE_SENSOR_EXT_H_
+
+#define SENSORNDKBRIDGE_SENSOR_EXT_H_
+
+#include <android/looper.h>
+#include <android/sensor.h>
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+__BEGIN_DECLS
+
+/**
+ * Creates a new sensor event queue whose events are read from a fast message
+ * queue shared with the sensor service instead of being delivered by one
+ * binder transaction each.
+ *
+ * The queue behaves like one created by ASensorManager_createEventQueue and
+ * must be destroyed with ASensorManager_destroyEventQueue. If the sensor
+ * service does not support this transport, a regular event queue is returned.
+ */
+ASensorEventQueue* ASensorManager_createFmqEventQueue(ASensorManager* manager,
+        ALooper* looper, int ident, ALooper_callbackFunc callback, void* data);
+
+/**
+ * Retrieves up to |count| pending events like ASensorEventQueue_getEvents,
+ * but first blocks until at least |minCount| events are queued or
+ * |timeoutNs| nanoseconds have passed, whichever comes first. A negative
+ * |timeoutNs| waits without a time limit, 0 does not wait at all.
+ *
+ * |minCount| is clamped to [1, min(count, queue capacity)]. Returns the number
+ * of events retrieved, which is less than |minCount| on timeout, or a negative
+ * error code. Must not be called concurrently with another read of the same
+ * queue.
+ */
+ssize_t ASensorEventQueue_getEventsBlocking(ASensorEventQueue* queue, ASensorEvent* events,
+        size_t count, int64_t timeoutNs, size_t minCount);
+
+/**
+ * Lets the queue pick the maxBatchReportLatencyUs of every sensor registered
+ * on it, overriding the latency passed to ASensorEventQueue_registerSensor.
+ *
+ * The queue measures how old events are when they are read and how many are
+ * read at once, and adjusts the latency within [minLatencyUs, maxLatencyUs]
+ * to wake the consumer as rarely as possible while still reading every event
+ * within maxLatencyUs of its timestamp. A |maxLatencyUs| of 0 turns adaptive
+ * batching off, keeping the latency last chosen.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int ASensorEventQueue_setAdaptiveBatching(ASensorEventQueue* queue, int64_t minLatencyUs,
+        int64_t maxLatencyUs);
+
+typedef struct ASensorEventQueueBatchingStats {
+    /** Batch latency currently requested for the queue's sensors. */
+    int64_t maxBatchReportLatencyUs;
+    /** Age of the oldest event read during the last evaluation period. */
+    int64_t maxEventAgeUs;
+    /** Most events read at once during the last evaluation period. */
+    size_t peakEventCount;
+    /** Number of times the batch latency was changed. */
+    uint64_t adjustmentCount;
+    /** Number of times the queue woke up its consumer. */
+    uint64_t wakeupCount;
+} ASensorEventQueueBatchingStats;
+
+/**
+ * Fills |stats| with the operating point chosen by adaptive batching. Only
+ * wakeupCount is set if adaptive batching is off.
+ */
+int ASensorEventQueue_getBatchingStats(ASensorEventQueue* queue,
+        ASensorEventQueueBatchingStats* stats);
+
+/** Number of buckets in an {@link ASensorLatencyHistogram}. */
+#define ASENSOR_LATENCY_HISTOGRAM_BUCKETS 24
+
+/**
+ * Latencies in power-of-two microsecond buckets: buckets[0] counts latencies
+ * below 1us, buckets[i] those in [2^(i-1), 2^i) us, and the last bucket all
+ * longer ones.
+ */
+typedef struct ASensorLatencyHistogram {
+    uint64_t count;
+    uint64_t sumUs;
+    int64_t maxNs;
+    uint64_t buckets[ASENSOR_LATENCY_HISTOGRAM_BUCKETS];
+} ASensorLatencyHistogram;
+
+typedef struct ASensorEventQueueStats {
+    /** Events the sensor service delivered to the queue. */
+    uint64_t eventsReceived;
+    /** Events returned by ASensorEventQueue_getEvents. */
+    uint64_t eventsRead;
+    /** Events dropped because the queue was full. */
+    uint64_t eventsDropped;
+    /** Times the queue woke up its looper. */
+    uint64_t wakeups;
+    /** Looper wake-ups that found the queue already empty. */
+    uint64_t spuriousWakeups;
+    /** Sensor timestamp to arrival in the queue. Not recorded for FMQ queues. */
+    ASensorLatencyHistogram deliveryLatency;
+    /** Looper wake-up requested to the looper dispatching the queue. */
+    ASensorLatencyHistogram wakeupLatency;
+    /** Sensor timestamp to ASensorEventQueue_getEvents. */
+    ASensorLatencyHistogram readLatency;
+} ASensorEventQueueStats;
+
+/**
+ * Fills |stats| with the counters of |queue| since it was created. Counters
+ * are maintained without locks and may be read from any thread.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int ASensorEventQueue_getStats(ASensorEventQueue* queue, ASensorEventQueueStats* stats);
+
+enum {
+    /**
+     * Deliver the events of continuous sensors at about the rate the queue
+     * registered them with, even if another queue asked for a faster one.
+     */
+    ASENSOR_SHARED_EVENT_QUEUE_DECIMATE = 1 << 0,
+};
+
+/**
+ * Creates an event queue that shares its connection to the sensor service
+ * with every other shared queue of |manager|. The service sees a single
+ * subscription per sensor, at the fastest rate and shortest batch latency
+ * any of the queues asked for, and each event crosses the process boundary
+ * once however many queues receive it. |flags| is a combination of
+ * ASENSOR_SHARED_EVENT_QUEUE_* values.
+ *
+ * The queue is used and destroyed like one from ASensorManager_createEventQueue.
+ */
+ASensorEventQueue* ASensorManager_createSharedEventQueue(ASensorManager* manager,
+        ALooper* looper, int ident, ALooper_callbackFunc callback, void* data, int flags);
+
+/**
+ * Starts writing every event the sensor service delivers to |queue| to |fd|
+ * as a sensor trace, which can be replayed without sensor hardware. |fd| must
+ * refer to an empty file and is not closed by the queue. Events are buffered;
+ * the trace is complete once ASensorEventQueue_stopRecording returns.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int ASensorEventQueue_startRecording(ASensorEventQueue* queue, int fd);
+
+/**
+ * Flushes the trace started by ASensorEventQueue_startRecording.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int ASensorEventQueue_stopRecording(ASensorEventQueue* queue);
+
+/**
+ * Makes SIGQUIT write the statistics of every event queue of |manager| to
+ * |fd|, or to the log if |fd| is negative. This replaces the default action
+ * of SIGQUIT, which terminates the process, until the manager is destroyed.
+ * Only one manager per process can do this.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int ASensorManager_enableStatsDump(ASensorManager* manager, int fd);
+
+/**
+ * Runs the callbacks of the sensor event queues created on |looper| on
+ * |workerCount| worker threads instead of the thread calling ALooper_pollOnce,
+ * so that a slow callback does not hold up the other queues. A 0 count runs
+ * them on the polling thread again, after waiting for running callbacks.
+ *
+ * Callbacks of one queue still run one at a time, in order; those of
+ * different queues may run concurrently. Idle workers take over queues that
+ * are waiting for a busy one. Queues without a callback are not affected.
+ *
+ * Returns 0 on success, or a negative error code, e.g. if |looper| already
+ * has workers.
+ */
+int ALooper_setSensorDispatchWorkers(ALooper* looper, size_t workerCount);
+
+typedef struct ASensorDispatchPolicy {
+    /** CPUs the callback may run on, bit i for CPU i, or 0 for any. */
+    uint64_t cpuMask;
+    /** SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR. */
+    int32_t schedPolicy;
+    /** Priority for SCHED_FIFO and SCHED_RR, otherwise 0. */
+    int32_t schedPriority;
+} ASensorDispatchPolicy;
+
+/**
+ * Makes the worker running the callback of |queue| move to the CPUs and
+ * scheduling policy in |policy| first. The looper of |queue| must have
+ * dispatch workers (see ALooper_setSensorDispatchWorkers). The process needs
+ * the corresponding privileges; without them the callback runs unchanged.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int ASensorEventQueue_setDispatchPolicy(ASensorEventQueue* queue,
+        const ASensorDispatchPolicy* policy);
+
+/**
+ * {@link ASensorFrameAssembler} groups the events of several sensors into
+ * frames aligned on the timestamps of a reference sensor, e.g. one
+ * accelerometer, gyroscope and magnetometer sample per gyroscope sample.
+ */
+typedef struct ASensorFrameAssembler ASensorFrameAssembler;
+
+enum {
+    /**
+     * Linearly interpolate the samples of non-reference sensors to the frame
+     * timestamp instead of using the nearest one. Only applies to sensors
+     * with a fixed float payload (e.g. ASENSOR_TYPE_ACCELEROMETER).
+     */
+    ASENSOR_FRAME_ASSEMBLER_INTERPOLATE = 1 << 0,
+};
+
+/**
+ * One time-aligned frame. |events| holds one event per sensor, in the order
+ * the sensors were passed to ASensorManager_createFrameAssembler, and is only
+ * valid for the duration of the callback.
+ */
+typedef struct ASensorFrame {
+    int64_t timestamp;
+    size_t count;
+    const ASensorEvent* events;
+} ASensorFrame;
+
+/**
+ * Called on the looper thread for each frame. Returns 0 to stop receiving
+ * frames, like ALooper_callbackFunc.
+ */
+typedef int (*ASensorFrameCallbackFunc)(const ASensorFrame* frame, void* data);
+
+/**
+ * Creates a frame assembler for |count| sensors, the first of which is the
+ * reference sensor. A frame is delivered through |callback| on |looper| once
+ * every other sensor has a sample within |windowNs| of a reference sample;
+ * reference samples that cannot be matched are dropped.
+ *
+ * The sensors are registered on the queue returned by
+ * ASensorFrameAssembler_getEventQueue, e.g. with
+ * ASensorEventQueue_registerSensor. |flags| is a combination of
+ * ASENSOR_FRAME_ASSEMBLER_* values.
+ */
+ASensorFrameAssembler* ASensorManager_createFrameAssembler(ASensorManager* manager,
+        ALooper* looper, ASensor const* const* sensors, size_t count, int64_t windowNs,
+        int flags, ASensorFrameCallbackFunc callback, void* data);
+
+/**
+ * Destroys the assembler and its event queue.
+ */
+void ASensorManager_destroyFrameAssembler(ASensorManager* manager,
+        ASensorFrameAssembler* assembler);
+
+ASensorEventQueue* ASensorFrameAssembler_getEventQueue(ASensorFrameAssembler* assembler);
+
+/**
+ * Returns the number of reference samples dropped because no frame could be
+ * assembled around them.
+ */
+uint64_t ASensorFrameAssembler_getDroppedFrameCount(ASensorFrameAssembler* assembler);
+
+/**
+ * {@link ASensorDirectReportReader} walks the events a sensor direct channel
+ * (see ASensorManager_createSharedMemoryDirectChannel and
+ * ASensorManager_createHardwareBufferDirectChannel) writes into its shared
+ * memory region, using the record layout and atomic counter described by
+ * android.hardware.sensors@1.0::SensorsEventFormatOffset.
+ */
+typedef struct ASensorDirectReportReader ASensorDirectReportReader;
+
+/**
+ * Creates a reader for a direct channel region that the caller has mapped at
+ * |buffer| with length |size|. The mapping must outlive the reader. For a
+ * channel created with ASensorManager_createHardwareBufferDirectChannel, the
+ * region is the address AHardwareBuffer_lock returns for CPU reads.
+ */
+ASensorDirectReportReader* ASensorDirectReportReader_create(const void* buffer, size_t size);
+
+void ASensorDirectReportReader_destroy(ASensorDirectReportReader* reader);
+
+/**
+ * Stores pointers to up to |count| events written since the previous call in
+ * |events| and returns the number stored, or a negative error code.
+ *
+ * Events are not copied: each pointer refers to the record inside the shared
+ * region, whose reserved0 field holds the record's atomic counter. A record
+ * is rewritten once the writer wraps around the region; a consumer that may
+ * fall that far behind should compare reserved0 before and after using it.
+ * Must not be called concurrently on the same reader.
+ */
+ssize_t ASensorDirectReportReader_getEvents(ASensorDirectReportReader* reader,
+        ASensorEvent const** events, size_t count);
+
+/**
+ * Returns the number of events the writer overwrote before they were read.
+ */
+uint64_t ASensorDirectReportReader_getLostEventCount(ASensorDirectReportReader* reader);
+
+__END_DECLS
+
+#endif  // SENSORNDKBRIDGE_SENSOR_EXT_H_
@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeSensorManager.h"
+
+#include "SensorEventCodec.h"
+
+#define LOG_TAG "FakeSensorManager"
+#include <android-base/logging.h>
+#include <sensors/convert.h>
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+namespace android {
+namespace frameworks {
+namespace sensorservice {
+namespace testing {
+
+using ::android::hardware::EventFlag;
+using ::android::hardware::Void;
+using ::android::frameworks::sensorservice::V1_1::EventQueueFlagBits;
+using ::android::hardware::sensors::V1_0::SensorFlagBits;
+using ::android::hardware::sensors::V1_0::SensorStatus;
+
+FakeEventQueue::FakeEventQueue(const sp<V1_0::IEventQueueCallback> &callback)
+    : mCallback(callback), mEventFlag(nullptr) {
+    auto batchCallback = V1_1::IEventQueueCallback::castFrom(callback);
+    if (batchCallback.isOk()) {
+        mBatchCallback = batchCallback;
+    }
+}
+
+FakeEventQueue::FakeEventQueue(size_t capacity)
+    : mFmq(new EventMessageQueue(capacity, true /* configureEventFlagWord */)),
+      mEventFlag(nullptr) {
+    CHECK(mFmq->isValid());
+    CHECK_EQ(EventFlag::createEventFlag(mFmq->getEventFlagWord(), &mEventFlag), ::android::OK);
+}
+
+FakeEventQueue::~FakeEventQueue() {
+    if (mEventFlag != nullptr) {
+        EventFlag::deleteEventFlag(&mEventFlag);
+    }
+}
+
+Return<Result> FakeEventQueue::enableSensor(
+        int32_t sensorHandle, int32_t samplingPeriodUs, int64_t maxBatchReportLatencyUs) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mEnabledSensors[sensorHandle] = {samplingPeriodUs, maxBatchReportLatencyUs};
+    return Result::OK;
+}
+
+Return<Result> FakeEventQueue::disableSensor(int32_t sensorHandle) {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mEnabledSensors.erase(sensorHandle) > 0 ? Result::OK : Result::BAD_VALUE;
+}
+
+void FakeEventQueue::injectEvents(const hidl_vec<Event> &events) {
+    if (mFmq != nullptr) {
+        static constexpr int64_t kWriteTimeoutNs = 1000000000;
+        for (size_t offset = 0; offset < events.size();) {
+            const size_t count = std::min(events.size() - offset, mFmq->getQuantumCount());
+            CHECK(mFmq->writeBlocking(&events[offset], count,
+                                      static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
+                                      static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS),
+                                      kWriteTimeoutNs, mEventFlag));
+            offset += count;
+        }
+        return;
+    }
+
+    for (const auto &event : events) {
+        mCallback->onEvent(event).assertOk();
+    }
+}
+
+void FakeEventQueue::injectEventBatch(const hidl_vec<Event> &events) {
+    if (mFmq != nullptr || mBatchCallback == nullptr) {
+        injectEvents(events);
+        return;
+    }
+    mBatchCallback->onEvents(events).assertOk();
+}
+
+size_t FakeEventQueue::injectCompressedEvents(
+        const hidl_vec<Event> &events, const hidl_vec<SensorInfo> &sensors) {
+    if (mFmq != nullptr || mBatchCallback == nullptr) {
+        injectEvents(events);
+        return 0;
+    }
+
+    std::vector<uint8_t> data;
+    SensorEventEncoder(sensors).encode(events.data(), events.size(), &data);
+
+    hidl_vec<uint8_t> batch;
+    batch.setToExternal(data.data(), data.size());
+    mBatchCallback->onCompressedEvents(batch).assertOk();
+    return data.size();
+}
+
+bool FakeEventQueue::getSensorConfig(int32_t sensorHandle, SensorConfig *config) const {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mEnabledSensors.find(sensorHandle);
+    if (it == mEnabledSensors.end()) {
+        return false;
+    }
+    if (config != nullptr) {
+        *config = it->second;
+    }
+    return true;
+}
+
+FakeDirectReportChannel::FakeDirectReportChannel(const native_handle_t *handle, uint64_t size)
+    : mBuffer(nullptr),
+      mSize(size),
+      mRecordCount(size / sizeof(sensors_event_t)),
+      mCounter(0),
+      mNextToken(1) {
+    if (handle == nullptr || handle->numFds < 1 || mRecordCount == 0) {
+        return;
+    }
+
+    void *buffer = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, handle->data[0],
+                        0 /* offset */);
+    if (buffer == MAP_FAILED) {
+        PLOG(ERROR) << "Unable to map direct channel";
+        return;
+    }
+    mBuffer = static_cast<uint8_t *>(buffer);
+}
+
+FakeDirectReportChannel::~FakeDirectReportChannel() {
+    if (mBuffer != nullptr) {
+        munmap(mBuffer, mSize);
+    }
+}
+
+Return<void> FakeDirectReportChannel::configure(
+        int32_t sensorHandle, RateLevel rate, configure_cb _hidl_cb) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (rate == RateLevel::STOP) {
+        if (sensorHandle == -1) {
+            mTokens.clear();
+        } else {
+            mTokens.erase(sensorHandle);
+        }
+        _hidl_cb(0 /* token */, Result::OK);
+        return Void();
+    }
+
+    auto it = mTokens.find(sensorHandle);
+    if (it == mTokens.end()) {
+        it = mTokens.emplace(sensorHandle, mNextToken++).first;
+    }
+    _hidl_cb(it->second, Result::OK);
+    return Void();
+}
+
+bool FakeDirectReportChannel::writeEvent(const Event &event) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    auto it = mTokens.find(event.sensorHandle);
+    if (mBuffer == nullptr || it == mTokens.end()) {
+        return false;
+    }
+
+    sensors_event_t record;
+    ::android::hardware::sensors::V1_0::implementation::convertToSensorEvent(event, &record);
+    record.version = sizeof(sensors_event_t);
+    record.sensor = it->second;
+
+    // Publish the payload before the counter, like the HAL.
+    sensors_event_t *slot =
+            reinterpret_cast<sensors_event_t *>(mBuffer) + (mCounter % mRecordCount);
+    record.reserved0 = slot->reserved0;
+    memcpy(slot, &record, sizeof(record));
+    __atomic_store_n(&slot->reserved0, static_cast<int32_t>(++mCounter), __ATOMIC_RELEASE);
+    return true;
+}
+
+FakeSensorManager::FakeSensorManager(const hidl_vec<SensorInfo> &sensors)
+    : mSensors(sensors), mDeathCookie(0) {}
+
+// static
+hidl_vec<SensorInfo> FakeSensorManager::makeDefaultSensorList() {
+    struct Desc {
+        SensorType type;
+        const char *name;
+        uint32_t flags;
+    };
+    static const Desc kSensors[] = {
+        {SensorType::ACCELEROMETER, "Fake Accelerometer", 0},
+        {SensorType::GYROSCOPE, "Fake Gyroscope", 0},
+        {SensorType::MAGNETIC_FIELD, "Fake Magnetometer", 0},
+        {SensorType::ACCELEROMETER_UNCALIBRATED, "Fake Uncalibrated Accelerometer", 0},
+        {SensorType::GYROSCOPE_UNCALIBRATED, "Fake Uncalibrated Gyroscope", 0},
+        {SensorType::MAGNETIC_FIELD_UNCALIBRATED, "Fake Uncalibrated Magnetometer", 0},
+        {SensorType::PROXIMITY, "Fake Proximity",
+         static_cast<uint32_t>(SensorFlagBits::WAKE_UP) |
+                 static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE)},
+    };
+
+    hidl_vec<SensorInfo> list;
+    list.resize(sizeof(kSensors) / sizeof(kSensors[0]));
+    for (size_t i = 0; i < list.size(); ++i) {
+        list[i] = makeSensorInfo(static_cast<int32_t>(i + 1), kSensors[i].type, kSensors[i].name,
+                                 kSensors[i].flags);
+    }
+    return list;
+}
+
+// static
+SensorInfo FakeSensorManager::makeSensorInfo(
+        int32_t sensorHandle, SensorType type, const char *name, uint32_t flags) {
+    SensorInfo info;
+    info.sensorHandle = sensorHandle;
+    info.name = name;
+    info.vendor = "AOSP";
+    info.version = 1;
+    info.type = type;
+    info.typeAsString = "";
+    info.maxRange = 100.0f;
+    info.resolution = 0.01f;
+    info.power = 0.1f;
+    info.minDelay = 2500;
+    info.fifoReservedEventCount = 0;
+    info.fifoMaxEventCount = 3000;
+    info.requiredPermission = "";
+    info.maxDelay = 1000000;
+    info.flags = flags;
+    return info;
+}
+
+// static
+Event FakeSensorManager::makeEvent(const SensorInfo &sensor, int64_t timestamp) {
+    Event event;
+    memset(&event.u, 0, sizeof(event.u));
+    event.timestamp = timestamp;
+    event.sensorHandle = sensor.sensorHandle;
+    event.sensorType = sensor.type;
+    for (size_t i = 0; i < 16; ++i) {
+        event.u.data[i] = static_cast<float>(timestamp % 1000) + i;
+    }
+    if (sensor.type == SensorType::ACCELEROMETER || sensor.type == SensorType::GYROSCOPE ||
+        sensor.type == SensorType::MAGNETIC_FIELD) {
+        event.u.vec3.status = SensorStatus::ACCURACY_HIGH;
+    }
+    return event;
+}
+
+hidl_vec<Event> FakeSensorManager::makeEvents(size_t count, int64_t firstTimestamp) const {
+    hidl_vec<Event> events;
+    events.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        events[i] = makeEvent(mSensors[0], firstTimestamp + i);
+    }
+    return events;
+}
+
+Return<void> FakeSensorManager::getSensorList(getSensorList_cb _hidl_cb) {
+    _hidl_cb(mSensors, Result::OK);
+    return Void();
+}
+
+Return<void> FakeSensorManager::getDefaultSensor(SensorType type, getDefaultSensor_cb _hidl_cb) {
+    for (const auto &sensor : mSensors) {
+        if (sensor.type == type) {
+            _hidl_cb(sensor, Result::OK);
+            return Void();
+        }
+    }
+    _hidl_cb(SensorInfo(), Result::NOT_EXIST);
+    return Void();
+}
+
+template <typename Callback>
+Return<void> FakeSensorManager::createDirectChannel(
+        const native_handle_t *handle, uint64_t size, const Callback &_hidl_cb) {
+    sp<FakeDirectReportChannel> channel = new FakeDirectReportChannel(handle, size);
+    if (!channel->isValid()) {
+        _hidl_cb(nullptr, Result::BAD_VALUE);
+        return Void();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mDirectChannels.push_back(channel);
+    }
+    _hidl_cb(channel, Result::OK);
+    return Void();
+}
+
+Return<void> FakeSensorManager::createAshmemDirectChannel(
+        const hidl_memory &mem, uint64_t size, createAshmemDirectChannel_cb _hidl_cb) {
+    return createDirectChannel(mem.handle(), size, _hidl_cb);
+}
+
+Return<void> FakeSensorManager::createGrallocDirectChannel(
+        const hidl_handle &buffer, uint64_t size, createGrallocDirectChannel_cb _hidl_cb) {
+    return createDirectChannel(buffer.getNativeHandle(), size, _hidl_cb);
+}
+
+Return<void> FakeSensorManager::createEventQueue(
+        const sp<V1_0::IEventQueueCallback> &callback, createEventQueue_cb _hidl_cb) {
+    if (callback == nullptr) {
+        _hidl_cb(nullptr, Result::BAD_VALUE);
+        return Void();
+    }
+
+    sp<FakeEventQueue> queue = new FakeEventQueue(callback);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEventQueues.push_back(queue);
+    }
+    _hidl_cb(queue, Result::OK);
+    return Void();
+}
+
+Return<void> FakeSensorManager::createEventQueueFmq(createEventQueueFmq_cb _hidl_cb) {
+    sp<FakeEventQueue> queue = new FakeEventQueue(kFmqCapacity);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEventQueues.push_back(queue);
+    }
+    _hidl_cb(queue, *queue->getFmq()->getDesc(), Result::OK);
+    return Void();
+}
+
+Return<bool> FakeSensorManager::linkToDeath(
+        const sp<::android::hardware::hidl_death_recipient> &recipient, uint64_t cookie) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mDeathRecipient = recipient;
+    mDeathCookie = cookie;
+    return recipient != nullptr;
+}
+
+Return<bool> FakeSensorManager::unlinkToDeath(
+        const sp<::android::hardware::hidl_death_recipient> &recipient) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (recipient == nullptr || recipient != mDeathRecipient) {
+        return false;
+    }
+    mDeathRecipient.clear();
+    return true;
+}
+
+void FakeSensorManager::kill() {
+    sp<::android::hardware::hidl_death_recipient> recipient;
+    uint64_t cookie;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mEventQueues.clear();
+        recipient = mDeathRecipient;
+        cookie = mDeathCookie;
+        mDeathRecipient.clear();
+    }
+
+    if (recipient != nullptr) {
+        recipient->serviceDied(cookie, this);
+    }
+}
+
+std::vector<sp<FakeEventQueue>> FakeSensorManager::getEventQueues() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mEventQueues;
+}
+
+void FakeSensorManager::clearEventQueues() {
+    std::vector<sp<FakeEventQueue>> queues;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        queues.swap(mEventQueues);
+    }
+}
+
+std::vector<sp<FakeDirectReportChannel>> FakeSensorManager::getDirectChannels() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mDirectChannels;
+}
+
+}  // namespace testing
+}  // namespace sensorservice
+}  // namespace frameworks
+}  // namespace android
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FAKE_SENSOR_MANAGER_H_
+
+#define FAKE_SENSOR_MANAGER_H_
+
+#include <android-base/macros.h>
+#include <android/frameworks/sensorservice/1.0/IDirectReportChannel.h>
+#include <android/frameworks/sensorservice/1.1/IEventQueueCallback.h>
+#include <android/frameworks/sensorservice/1.1/ISensorManager.h>
+#include <fmq/EventFlag.h>
+#include <fmq/MessageQueue.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace android {
+namespace frameworks {
+namespace sensorservice {
+namespace testing {
+
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_memory;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::sensors::V1_0::Event;
+using ::android::hardware::sensors::V1_0::RateLevel;
+using ::android::hardware::sensors::V1_0::SensorInfo;
+using ::android::hardware::sensors::V1_0::SensorType;
+using ::android::frameworks::sensorservice::V1_0::Result;
+
+// In-process stand-in for the server side of an IEventQueue. Events are
+// injected by the test and delivered synchronously on the calling thread, so
+// measurements see the cost of the client bridge without binder.
+struct FakeEventQueue : public V1_0::IEventQueue {
+    using EventMessageQueue =
+            ::android::hardware::MessageQueue<Event, ::android::hardware::kSynchronizedReadWrite>;
+
+    struct SensorConfig {
+        int32_t samplingPeriodUs;
+        int64_t maxBatchReportLatencyUs;
+    };
+
+    // Delivers events through |callback|.
+    explicit FakeEventQueue(const sp<V1_0::IEventQueueCallback> &callback);
+
+    // Delivers events through a fast message queue of |capacity| events.
+    explicit FakeEventQueue(size_t capacity);
+    ~FakeEventQueue();
+
+    const EventMessageQueue *getFmq() const { return mFmq.get(); }
+
+    Return<Result> enableSensor(int32_t sensorHandle, int32_t samplingPeriodUs,
+                                int64_t maxBatchReportLatencyUs) override;
+    Return<Result> disableSensor(int32_t sensorHandle) override;
+
+    // Delivers |events| with one IEventQueueCallback::onEvent call each, or
+    // writes them to the message queue, waiting up to one second for room.
+    void injectEvents(const hidl_vec<Event> &events);
+
+    // Delivers |events| with a single @1.1::IEventQueueCallback::onEvents
+    // call, falling back to injectEvents() for @1.0 callbacks.
+    void injectEventBatch(const hidl_vec<Event> &events);
+
+    // Delivers |events| with a single @1.1::IEventQueueCallback
+    // ::onCompressedEvents call, quantized to the resolutions in |sensors|,
+    // falling back to injectEvents() for @1.0 callbacks. Returns the size of
+    // the encoding.
+    size_t injectCompressedEvents(const hidl_vec<Event> &events,
+                                  const hidl_vec<SensorInfo> &sensors);
+
+    bool getSensorConfig(int32_t sensorHandle, SensorConfig *config) const;
+
+private:
+    sp<V1_0::IEventQueueCallback> mCallback;
+    sp<V1_1::IEventQueueCallback> mBatchCallback;
+
+    std::unique_ptr<EventMessageQueue> mFmq;
+    ::android::hardware::EventFlag *mEventFlag;
+
+    mutable std::mutex mLock;
+    std::map<int32_t, SensorConfig> mEnabledSensors;
+
+    DISALLOW_COPY_AND_ASSIGN(FakeEventQueue);
+};
+
+// In-process stand-in for the server side of a direct channel. The fake maps
+// the file descriptor of the handle the client passed, so a memfd can stand
+// in for both ashmem and gralloc buffers, and writes records into it the way
+// a sensor HAL does.
+struct FakeDirectReportChannel : public V1_0::IDirectReportChannel {
+    FakeDirectReportChannel(const native_handle_t *handle, uint64_t size);
+    ~FakeDirectReportChannel();
+
+    bool isValid() const { return mBuffer != nullptr; }
+
+    Return<void> configure(int32_t sensorHandle, RateLevel rate,
+                           configure_cb _hidl_cb) override;
+
+    // Writes |event| as the next record if its sensor is configured on the
+    // channel, stamped with the sensor's report token.
+    bool writeEvent(const Event &event);
+
+private:
+    std::mutex mLock;
+    uint8_t *mBuffer;
+    size_t mSize;
+    size_t mRecordCount;
+    uint32_t mCounter;
+
+    // Report token of each configured sensor handle.
+    std::map<int32_t, int32_t> mTokens;
+    int32_t mNextToken;
+
+    DISALLOW_COPY_AND_ASSIGN(FakeDirectReportChannel);
+};
+
+// In-process stand-in for ISensorManager serving a fixed sensor list.
+struct FakeSensorManager : public V1_1::ISensorManager {
+    static constexpr size_t kFmqCapacity = 4096;
+
+    explicit FakeSensorManager(const hidl_vec<SensorInfo> &sensors = makeDefaultSensorList());
+
+    // Accelerometer, gyroscope, magnetometer, their uncalibrated variants and
+    // a wake-up proximity sensor, with sensor handles 1..N.
+    static hidl_vec<SensorInfo> makeDefaultSensorList();
+
+    // Returns a sensor description with plausible ranges and delays.
+    static SensorInfo makeSensorInfo(int32_t sensorHandle, SensorType type, const char *name,
+                                     uint32_t flags = 0);
+
+    // Returns an event of the sensor's type with a deterministic payload.
+    static Event makeEvent(const SensorInfo &sensor, int64_t timestamp);
+
+    // Returns |count| events of the first sensor of the list, timestamped
+    // from |firstTimestamp| on, one nanosecond apart.
+    hidl_vec<Event> makeEvents(size_t count, int64_t firstTimestamp) const;
+
+    Return<void> getSensorList(getSensorList_cb _hidl_cb) override;
+    Return<void> getDefaultSensor(SensorType type, getDefaultSensor_cb _hidl_cb) override;
+    Return<void> createAshmemDirectChannel(const hidl_memory &mem, uint64_t size,
+                                           createAshmemDirectChannel_cb _hidl_cb) override;
+    Return<void> createGrallocDirectChannel(const hidl_handle &buffer, uint64_t size,
+                                            createGrallocDirectChannel_cb _hidl_cb) override;
+    Return<void> createEventQueue(const sp<V1_0::IEventQueueCallback> &callback,
+                                  createEventQueue_cb _hidl_cb) override;
+    Return<void> createEventQueueFmq(createEventQueueFmq_cb _hidl_cb) override;
+
+    // Local objects never die on their own, so the fake keeps the recipient
+    // itself and notifies it from kill().
+    Return<bool> linkToDeath(const sp<::android::hardware::hidl_death_recipient> &recipient,
+                             uint64_t cookie) override;
+    Return<bool> unlinkToDeath(
+            const sp<::android::hardware::hidl_death_recipient> &recipient) override;
+
+    // Simulates the service process dying: forgets every event queue and
+    // notifies the linked death recipient on the calling thread.
+    void kill();
+
+    const hidl_vec<SensorInfo> &sensors() const { return mSensors; }
+
+    // Queues created through createEventQueue(), oldest first.
+    std::vector<sp<FakeEventQueue>> getEventQueues() const;
+
+    // Drops the references the fake keeps to the queues it created, like the
+    // service does once the client side of a queue is gone.
+    void clearEventQueues();
+
+    // Channels created through create*DirectChannel(), oldest first.
+    std::vector<sp<FakeDirectReportChannel>> getDirectChannels() const;
+
+private:
+    template <typename Callback>
+    Return<void> createDirectChannel(const native_handle_t *handle, uint64_t size,
+                                     const Callback &_hidl_cb);
+
+    const hidl_vec<SensorInfo> mSensors;
+
+    mutable std::mutex mLock;
+    std::vector<sp<FakeEventQueue>> mEventQueues;
+    std::vector<sp<FakeDirectReportChannel>> mDirectChannels;
+    sp<::android::hardware::hidl_death_recipient> mDeathRecipient;
+    uint64_t mDeathCookie;
+
+    DISALLOW_COPY_AND_ASSIGN(FakeSensorManager);
+};
+
+}  // namespace testing
+}  // namespace sensorservice
+}  // namespace frameworks
+}  // namespace android
+
+#endif  // FAKE_SENSOR_MANAGER_H_
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSOR_EVENT_QUEUE_TEST_H_
+
+#define SENSOR_EVENT_QUEUE_TEST_H_
+
+#include "ALooper.h"
+#include "ASensorEventQueue.h"
+#include "ASensorManager.h"
+#include "FakeSensorManager.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+namespace android {
+namespace frameworks {
+namespace sensorservice {
+namespace testing {
+
+// Fixture of tests of a single event queue of an ASensorManager backed by a
+// FakeSensorManager. |Base| lets parameterized tests share it.
+template <typename Base = ::testing::Test>
+class SensorEventQueueTest : public Base {
+  protected:
+    void SetUp() override {
+        mFakeManager = new FakeSensorManager;
+        mManager.reset(new ASensorManager(mFakeManager));
+        ASSERT_EQ(mManager->initCheck(), android::OK);
+        mLooper = new ALooper;
+
+        mQueue = useFmq()
+                ? ASensorManager_createFmqEventQueue(mManager.get(), mLooper.get(),
+                                                     0 /* ident */, nullptr, nullptr)
+                : ASensorManager_createEventQueue(mManager.get(), mLooper.get(),
+                                                  0 /* ident */, nullptr, nullptr);
+        ASSERT_NE(mQueue, nullptr);
+        mServer = mFakeManager->getEventQueues().back();
+    }
+
+    void TearDown() override {
+        if (mQueue != nullptr) {
+            ASensorManager_destroyEventQueue(mManager.get(), mQueue);
+        }
+        mServer.clear();
+        mManager.reset();
+        mLooper.clear();
+    }
+
+    // Whether SetUp() creates a queue reading from a fast message queue.
+    virtual bool useFmq() const { return false; }
+
+    sp<FakeSensorManager> mFakeManager;
+    std::unique_ptr<ASensorManager> mManager;
+    sp<ALooper> mLooper;
+    ASensorEventQueue *mQueue = nullptr;
+    sp<FakeEventQueue> mServer;
+};
+
+}  // namespace testing
+}  // namespace sensorservice
+}  // namespace frameworks
+}  // namespace android
+
+#endif  // SENSOR_EVENT_QUEUE_TEST_H_
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorTraceReplayer.h"
+
+#include <utils/Timers.h>
+
+#include <errno.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace frameworks {
+namespace sensorservice {
+namespace testing {
+
+SensorTraceReplayer::SensorTraceReplayer(const SensorTraceReader &reader) : mReader(reader) {}
+
+// static
+hidl_vec<SensorInfo> SensorTraceReplayer::makeSensorList(const SensorTraceReader &reader) {
+    std::map<int32_t, SensorType> types;
+
+    Event event;
+    for (auto cursor = reader.begin(); cursor.next(&event);) {
+        if (event.sensorType != SensorType::META_DATA &&
+            event.sensorType != SensorType::ADDITIONAL_INFO) {
+            types.emplace(event.sensorHandle, event.sensorType);
+        }
+    }
+
+    hidl_vec<SensorInfo> list;
+    list.resize(types.size());
+    size_t i = 0;
+    for (const auto &entry : types) {
+        const std::string name = "Trace Sensor " + std::to_string(entry.first);
+        list[i++] = FakeSensorManager::makeSensorInfo(entry.first, entry.second, name.c_str());
+    }
+    return list;
+}
+
+static void sleepUntil(nsecs_t deadline) {
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000;
+    ts.tv_nsec = deadline % 1000000000;
+    while (clock_nanosleep(CLOCK_BOOTTIME, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+size_t SensorTraceReplayer::replay(FakeEventQueue *queue, const Options &options) const {
+    std::vector<Event> batch;
+    batch.reserve(std::max<size_t>(options.maxBatchSize, 1));
+
+    auto flush = [&] {
+        if (batch.empty()) {
+            return;
+        }
+        hidl_vec<Event> events;
+        events.setToExternal(batch.data(), batch.size());
+        if (options.maxBatchSize <= 1) {
+            queue->injectEvents(events);
+        } else {
+            queue->injectEventBatch(events);
+        }
+        batch.clear();
+    };
+
+    const bool paced = options.speed > 0;
+    const nsecs_t startNs = systemTime(SYSTEM_TIME_BOOTTIME);
+    int64_t firstTimestamp = 0;
+    size_t count = 0;
+
+    Event event;
+    for (auto cursor = mReader.begin(); cursor.next(&event); ++count) {
+        if (count == 0) {
+            firstTimestamp = event.timestamp;
+        }
+
+        nsecs_t nowNs = systemTime(SYSTEM_TIME_BOOTTIME);
+        nsecs_t dueNs = nowNs;
+        if (paced) {
+            dueNs = startNs + static_cast<nsecs_t>(
+                    (event.timestamp - firstTimestamp) / options.speed);
+            if (dueNs > nowNs) {
+                flush();
+                sleepUntil(dueNs);
+            }
+        }
+
+        if (options.rebaseTimestamps) {
+            event.timestamp = dueNs;
+        }
+
+        batch.push_back(event);
+        if (batch.size() >= options.maxBatchSize) {
+            flush();
+        }
+    }
+    flush();
+
+    return count;
+}
+
+}  // namespace testing
+}  // namespace sensorservice
+}  // namespace frameworks
+}  // namespace android
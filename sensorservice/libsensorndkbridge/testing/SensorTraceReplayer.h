@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSOR_TRACE_REPLAYER_H_
+
+#define SENSOR_TRACE_REPLAYER_H_
+
+#include "FakeSensorManager.h"
+#include "SensorTrace.h"
+
+#include <android-base/macros.h>
+
+namespace android {
+namespace frameworks {
+namespace sensorservice {
+namespace testing {
+
+// Feeds a recorded sensor trace to a FakeEventQueue, so that production load
+// can be reproduced without sensor hardware. Serve the queue from a
+// FakeSensorManager built with makeSensorList() to give the client the
+// sensors the trace refers to.
+struct SensorTraceReplayer {
+    struct Options {
+        // 1 replays at the recorded rate, 2 twice as fast and so on; 0 or
+        // less injects events as fast as the queue accepts them.
+        double speed = 1.0;
+
+        // Events due at the same time are delivered together, up to this
+        // many per IEventQueueCallback::onEvents call. 1 uses onEvent.
+        size_t maxBatchSize = 1;
+
+        // Moves the timestamps to the time each event is injected, which
+        // keeps the bridge's latency statistics meaningful.
+        bool rebaseTimestamps = true;
+    };
+
+    // |reader| must stay open while the replayer is used.
+    explicit SensorTraceReplayer(const SensorTraceReader &reader);
+
+    // One sensor per handle found in the trace, with the type of its events.
+    static hidl_vec<SensorInfo> makeSensorList(const SensorTraceReader &reader);
+
+    // Replays the whole trace on the calling thread and returns the number
+    // of events injected.
+    size_t replay(FakeEventQueue *queue, const Options &options) const;
+
+private:
+    const SensorTraceReader &mReader;
+
+    DISALLOW_COPY_AND_ASSIGN(SensorTraceReplayer);
+};
+
+}  // namespace testing
+}  // namespace sensorservice
+}  // namespace frameworks
+}  // namespace android
+
+#endif  // SENSOR_TRACE_REPLAYER_H_
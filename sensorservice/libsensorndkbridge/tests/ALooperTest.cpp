@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/unique_fd.h>
+#include <android/looper.h>
+#include <gtest/gtest.h>
+
+#include <sys/eventfd.h>
+
+#include <thread>
+
+using android::base::unique_fd;
+
+namespace {
+
+TEST(ALooperTest, LoopersArePerThread) {
+    ALooper *looper = ALooper_prepare(0 /* opts */);
+    ASSERT_NE(looper, nullptr);
+    EXPECT_EQ(ALooper_forThread(), looper);
+
+    ALooper *otherLooper = nullptr;
+    std::thread([&] { otherLooper = ALooper_prepare(0 /* opts */); }).join();
+    EXPECT_NE(otherLooper, nullptr);
+    EXPECT_NE(otherLooper, looper);
+}
+
+TEST(ALooperTest, ReturnsIdentForFdWithoutCallback) {
+    ALooper *looper = ALooper_prepare(0 /* opts */);
+    unique_fd fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    ASSERT_GE(fd.get(), 0);
+
+    int data = 0;
+    ASSERT_EQ(ALooper_addFd(looper, fd.get(), 7 /* ident */, ALOOPER_EVENT_INPUT,
+                            nullptr /* callback */, &data),
+              1);
+    EXPECT_EQ(ALooper_pollOnce(0 /* timeoutMillis */, nullptr, nullptr, nullptr),
+              ALOOPER_POLL_TIMEOUT);
+
+    eventfd_write(fd.get(), 1);
+    int outFd = -1;
+    int outEvents = 0;
+    void *outData = nullptr;
+    EXPECT_EQ(ALooper_pollOnce(1000 /* timeoutMillis */, &outFd, &outEvents, &outData), 7);
+    EXPECT_EQ(outFd, fd.get());
+    EXPECT_TRUE(outEvents & ALOOPER_EVENT_INPUT);
+    EXPECT_EQ(outData, &data);
+
+    EXPECT_EQ(ALooper_removeFd(looper, fd.get()), 1);
+    EXPECT_EQ(ALooper_removeFd(looper, fd.get()), 0);
+}
+
+TEST(ALooperTest, CallbackReturningZeroUnregisters) {
+    ALooper *looper = ALooper_prepare(0 /* opts */);
+    unique_fd fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    ASSERT_GE(fd.get(), 0);
+
+    int calls = 0;
+    auto callback = [](int /* fd */, int /* events */, void *data) -> int {
+        ++*static_cast<int *>(data);
+        return 0;
+    };
+    ASSERT_EQ(ALooper_addFd(looper, fd.get(), 0 /* ident */, ALOOPER_EVENT_INPUT, callback,
+                            &calls),
+              1);
+
+    eventfd_write(fd.get(), 1);
+    EXPECT_EQ(ALooper_pollOnce(1000 /* timeoutMillis */, nullptr, nullptr, nullptr),
+              ALOOPER_POLL_CALLBACK);
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(ALooper_removeFd(looper, fd.get()), 0);
+}
+
+TEST(ALooperTest, Wake) {
+    ALooper *looper = ALooper_prepare(0 /* opts */);
+    ALooper_wake(looper);
+    EXPECT_EQ(ALooper_pollOnce(1000 /* timeoutMillis */, nullptr, nullptr, nullptr),
+              ALOOPER_POLL_WAKE);
+}
+
+}  // namespace
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+#include <vector>
+
+namespace {
+
+constexpr size_t kRecordCount = 8;
+
+// Writes records the way a sensor HAL writes a direct channel.
+struct DirectChannelWriter {
+    DirectChannelWriter() : mRecords(kRecordCount), mCounter(0) {}
+
+    void write(int64_t timestamp) {
+        ASensorEvent &record = mRecords[mCounter % kRecordCount];
+        record.version = sizeof(ASensorEvent);
+        record.sensor = 1;  // token
+        record.type = ASENSOR_TYPE_ACCELEROMETER;
+        record.timestamp = timestamp;
+        __atomic_store_n(&record.reserved0, static_cast<int32_t>(++mCounter), __ATOMIC_RELEASE);
+    }
+
+    std::vector<ASensorEvent> mRecords;
+    uint32_t mCounter;
+};
+
+class DirectReportReaderTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mReader = ASensorDirectReportReader_create(
+                mWriter.mRecords.data(), kRecordCount * sizeof(ASensorEvent));
+        ASSERT_NE(mReader, nullptr);
+    }
+
+    void TearDown() override { ASensorDirectReportReader_destroy(mReader); }
+
+    DirectChannelWriter mWriter;
+    ASensorDirectReportReader *mReader;
+};
+
+TEST_F(DirectReportReaderTest, EmptyRegion) {
+    const ASensorEvent *events[kRecordCount];
+    EXPECT_EQ(ASensorDirectReportReader_getEvents(mReader, events, kRecordCount), 0);
+}
+
+TEST_F(DirectReportReaderTest, ReturnsRecordsInPlace) {
+    mWriter.write(100);
+    mWriter.write(200);
+
+    const ASensorEvent *events[kRecordCount];
+    ASSERT_EQ(ASensorDirectReportReader_getEvents(mReader, events, kRecordCount), 2);
+    EXPECT_EQ(events[0], &mWriter.mRecords[0]);
+    EXPECT_EQ(events[1]->timestamp, 200);
+    EXPECT_EQ(ASensorDirectReportReader_getEvents(mReader, events, kRecordCount), 0);
+}
+
+TEST_F(DirectReportReaderTest, FollowsWrapAround) {
+    const ASensorEvent *events[kRecordCount];
+    for (int64_t i = 0; i < 3 * static_cast<int64_t>(kRecordCount); ++i) {
+        mWriter.write(i);
+        ASSERT_EQ(ASensorDirectReportReader_getEvents(mReader, events, kRecordCount), 1);
+        EXPECT_EQ(events[0]->timestamp, i);
+    }
+    EXPECT_EQ(ASensorDirectReportReader_getLostEventCount(mReader), 0u);
+}
+
+TEST_F(DirectReportReaderTest, CountsOverwrittenRecords) {
+    const ASensorEvent *events[kRecordCount];
+    mWriter.write(0);
+    ASSERT_EQ(ASensorDirectReportReader_getEvents(mReader, events, kRecordCount), 1);
+
+    // Lap the reader: the record it expects next now holds a later event.
+    for (int64_t i = 1; i <= static_cast<int64_t>(kRecordCount) + 2; ++i) {
+        mWriter.write(i);
+    }
+
+    ssize_t count = ASensorDirectReportReader_getEvents(mReader, events, kRecordCount);
+    ASSERT_GT(count, 0);
+    EXPECT_EQ(events[0]->timestamp, static_cast<int64_t>(kRecordCount) + 1);
+    EXPECT_EQ(ASensorDirectReportReader_getLostEventCount(mReader), kRecordCount);
+}
+
+}  // namespace
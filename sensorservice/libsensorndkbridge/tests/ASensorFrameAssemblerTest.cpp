@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ALooper.h"
+#include "ASensorEventQueue.h"
+#include "ASensorFrameAssembler.h"
+#include "ASensorManager.h"
+#include "FakeSensorManager.h"
+
+#include <gtest/gtest.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+#include <string.h>
+
+#include <vector>
+
+using android::sp;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::Event;
+
+namespace {
+
+constexpr int32_t kGyroscope = 2;
+constexpr int32_t kAccelerometer = 1;
+
+// Both have a three axis payload.
+const ASensorFrameAssembler::FrameSensor kGyroscopeSensor = {kGyroscope, 3};
+const ASensorFrameAssembler::FrameSensor kAccelerometerSensor = {kAccelerometer, 3};
+
+struct RecordedFrame {
+    int64_t timestamp;
+    std::vector<ASensorEvent> events;
+};
+
+int recordFrame(const ASensorFrame *frame, void *data) {
+    auto frames = static_cast<std::vector<RecordedFrame> *>(data);
+    frames->push_back({frame->timestamp,
+                       std::vector<ASensorEvent>(frame->events, frame->events + frame->count)});
+    return 1;
+}
+
+ASensorEvent makeEvent(int32_t sensor, int32_t type, int64_t timestamp, float value) {
+    ASensorEvent event;
+    memset(&event, 0, sizeof(event));
+    event.version = sizeof(event);
+    event.sensor = sensor;
+    event.type = type;
+    event.timestamp = timestamp;
+    event.data[0] = value;
+    event.data[1] = 2 * value;
+    event.data[2] = 3 * value;
+    return event;
+}
+
+ASensorEvent gyro(int64_t timestamp, float value = 0) {
+    return makeEvent(kGyroscope, ASENSOR_TYPE_GYROSCOPE, timestamp, value);
+}
+
+ASensorEvent accel(int64_t timestamp, float value = 0) {
+    return makeEvent(kAccelerometer, ASENSOR_TYPE_ACCELEROMETER, timestamp, value);
+}
+
+TEST(ASensorFrameAssemblerTest, EmitsFramesInReferenceOrder) {
+    std::vector<RecordedFrame> frames;
+    ASensorFrameAssembler assembler({kGyroscopeSensor, kAccelerometerSensor},
+                                    1000 /* windowNs */, 0 /* flags */, recordFrame, &frames);
+
+    assembler.push(gyro(10000));
+    assembler.push(gyro(20000));
+    EXPECT_TRUE(frames.empty());
+
+    assembler.push(accel(10200));
+    assembler.push(accel(19900));
+    EXPECT_EQ(frames.size(), 1u);
+    assembler.push(accel(30000));
+
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0].timestamp, 10000);
+    ASSERT_EQ(frames[0].events.size(), 2u);
+    EXPECT_EQ(frames[0].events[0].sensor, kGyroscope);
+    EXPECT_EQ(frames[0].events[1].sensor, kAccelerometer);
+    EXPECT_EQ(frames[0].events[1].timestamp, 10200);
+    EXPECT_EQ(frames[1].timestamp, 20000);
+    EXPECT_EQ(frames[1].events[1].timestamp, 19900);
+    EXPECT_EQ(assembler.getDroppedFrameCount(), 0u);
+}
+
+TEST(ASensorFrameAssemblerTest, PicksNearestSample) {
+    std::vector<RecordedFrame> frames;
+    ASensorFrameAssembler assembler({kGyroscopeSensor, kAccelerometerSensor},
+                                    5000 /* windowNs */, 0 /* flags */, recordFrame, &frames);
+
+    assembler.push(accel(8000));
+    assembler.push(gyro(10000));
+    assembler.push(accel(11000));
+
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0].events[1].timestamp, 11000);
+}
+
+TEST(ASensorFrameAssemblerTest, DropsFramesOutsideWindow) {
+    std::vector<RecordedFrame> frames;
+    ASensorFrameAssembler assembler({kGyroscopeSensor, kAccelerometerSensor},
+                                    1000 /* windowNs */, 0 /* flags */, recordFrame, &frames);
+
+    assembler.push(gyro(10000));
+    assembler.push(accel(15000));
+    assembler.push(gyro(15500));
+    assembler.push(accel(16000));
+
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0].timestamp, 15500);
+    EXPECT_EQ(frames[0].events[1].timestamp, 15000);
+    EXPECT_EQ(assembler.getDroppedFrameCount(), 1u);
+}
+
+TEST(ASensorFrameAssemblerTest, InterpolatesToReferenceTimestamp) {
+    std::vector<RecordedFrame> frames;
+    ASensorFrameAssembler assembler({kGyroscopeSensor, kAccelerometerSensor},
+                                    5000 /* windowNs */, ASENSOR_FRAME_ASSEMBLER_INTERPOLATE,
+                                    recordFrame, &frames);
+
+    assembler.push(accel(8000, 1.0f));
+    assembler.push(gyro(9000));
+    assembler.push(accel(12000, 5.0f));
+
+    ASSERT_EQ(frames.size(), 1u);
+    const ASensorEvent &sample = frames[0].events[1];
+    EXPECT_EQ(sample.timestamp, 9000);
+    EXPECT_FLOAT_EQ(sample.data[0], 2.0f);
+    EXPECT_FLOAT_EQ(sample.data[1], 4.0f);
+    EXPECT_FLOAT_EQ(sample.data[2], 6.0f);
+}
+
+TEST(ASensorFrameAssemblerTest, StopsWhenCallbackReturnsZero) {
+    int calls = 0;
+    ASensorFrameAssembler assembler(
+            {kGyroscopeSensor}, 0 /* windowNs */, 0 /* flags */,
+            [](const ASensorFrame *, void *data) {
+                ++*static_cast<int *>(data);
+                return 0;
+            },
+            &calls);
+
+    EXPECT_EQ(assembler.push(gyro(1000)), 0);
+    EXPECT_EQ(assembler.push(gyro(2000)), 0);
+    EXPECT_EQ(calls, 1);
+}
+
+TEST(ASensorFrameAssemblerTest, DeliversFramesThroughLooper) {
+    sp<FakeSensorManager> fakeManager = new FakeSensorManager;
+    ASensorManager manager(fakeManager);
+    ASSERT_EQ(manager.initCheck(), android::OK);
+
+    ALooper *looper = ALooper_prepare(0 /* opts */);
+    ASensorRef sensors[] = {
+        manager.getSensorByHandle(kGyroscope),
+        manager.getSensorByHandle(kAccelerometer),
+    };
+
+    std::vector<RecordedFrame> frames;
+    ASensorFrameAssembler *assembler = ASensorManager_createFrameAssembler(
+            &manager, looper, sensors, 2, 1000 /* windowNs */, 0 /* flags */, recordFrame,
+            &frames);
+    ASSERT_NE(assembler, nullptr);
+
+    ASensorEventQueue *queue = ASensorFrameAssembler_getEventQueue(assembler);
+    ASSERT_EQ(ASensorEventQueue_registerSensor(queue, sensors[0], 10000, 0), 0);
+    ASSERT_EQ(ASensorEventQueue_registerSensor(queue, sensors[1], 10000, 0), 0);
+
+    const auto &infos = fakeManager->sensors();
+    hidl_vec<Event> events;
+    events.resize(4);
+    events[0] = FakeSensorManager::makeEvent(infos[kGyroscope - 1], 10000);
+    events[1] = FakeSensorManager::makeEvent(infos[kAccelerometer - 1], 10100);
+    events[2] = FakeSensorManager::makeEvent(infos[kGyroscope - 1], 20000);
+    events[3] = FakeSensorManager::makeEvent(infos[kAccelerometer - 1], 20100);
+    fakeManager->getEventQueues().back()->injectEventBatch(events);
+
+    EXPECT_EQ(ALooper_pollOnce(1000 /* timeoutMillis */, nullptr, nullptr, nullptr),
+              ALOOPER_POLL_CALLBACK);
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0].timestamp, 10000);
+    EXPECT_EQ(frames[1].timestamp, 20000);
+
+    ASensorManager_destroyFrameAssembler(&manager, assembler);
+}
+
+}  // namespace
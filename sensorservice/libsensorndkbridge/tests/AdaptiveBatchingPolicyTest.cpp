@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ALooper.h"
+#include "ASensorEventQueue.h"
+#include "ASensorManager.h"
+#include "AdaptiveBatchingPolicy.h"
+#include "FakeSensorManager.h"
+
+#include <gtest/gtest.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+using android::sp;
+using android::frameworks::sensorservice::testing::FakeEventQueue;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+
+namespace {
+
+constexpr int64_t kPeriodNs = 1000;
+constexpr size_t kCapacity = 1024;
+constexpr int64_t kMinLatencyUs = 0;
+constexpr int64_t kMaxLatencyUs = 80000;
+
+// Reports one drain per evaluation period, each with the given age and size.
+bool drainPeriod(AdaptiveBatchingPolicy *policy, int64_t *nowNs, int64_t ageNs, size_t count) {
+    policy->onDrain(*nowNs, ageNs, count);
+    *nowNs += kPeriodNs;
+    return policy->onDrain(*nowNs, ageNs, count);
+}
+
+TEST(AdaptiveBatchingPolicyTest, GrowsWhileWithinDeadline) {
+    AdaptiveBatchingPolicy policy(kMinLatencyUs, kMaxLatencyUs, kCapacity, kPeriodNs);
+    int64_t nowNs = 0;
+
+    EXPECT_EQ(policy.getLatencyUs(), kMinLatencyUs);
+    for (int i = 0; i < AdaptiveBatchingPolicy::kIncreaseSteps; ++i) {
+        EXPECT_TRUE(drainPeriod(&policy, &nowNs, 1000000 /* ageNs */, 10));
+    }
+    EXPECT_EQ(policy.getLatencyUs(), kMaxLatencyUs);
+
+    EXPECT_FALSE(drainPeriod(&policy, &nowNs, 1000000 /* ageNs */, 10));
+    EXPECT_EQ(policy.getAdjustmentCount(),
+              static_cast<uint64_t>(AdaptiveBatchingPolicy::kIncreaseSteps));
+}
+
+TEST(AdaptiveBatchingPolicyTest, GrowthIsLimitedBySlack) {
+    AdaptiveBatchingPolicy policy(kMinLatencyUs, kMaxLatencyUs, kCapacity, kPeriodNs);
+    int64_t nowNs = 0;
+
+    // 1ms to the deadline is less than one step.
+    EXPECT_TRUE(drainPeriod(&policy, &nowNs, (kMaxLatencyUs - 1000) * 1000, 10));
+    EXPECT_EQ(policy.getLatencyUs(), 1000);
+}
+
+TEST(AdaptiveBatchingPolicyTest, BacksOffPastDeadline) {
+    AdaptiveBatchingPolicy policy(kMinLatencyUs, kMaxLatencyUs, kCapacity, kPeriodNs);
+    int64_t nowNs = 0;
+
+    for (int i = 0; i < AdaptiveBatchingPolicy::kIncreaseSteps; ++i) {
+        drainPeriod(&policy, &nowNs, 0 /* ageNs */, 10);
+    }
+    ASSERT_EQ(policy.getLatencyUs(), kMaxLatencyUs);
+
+    EXPECT_TRUE(drainPeriod(&policy, &nowNs, (kMaxLatencyUs + 1) * 1000, 10));
+    EXPECT_EQ(policy.getLatencyUs(), kMaxLatencyUs / 2);
+    EXPECT_EQ(policy.getMaxEventAgeNs(), (kMaxLatencyUs + 1) * 1000);
+}
+
+TEST(AdaptiveBatchingPolicyTest, BacksOffWhenQueueFillsUp) {
+    AdaptiveBatchingPolicy policy(10000, kMaxLatencyUs, kCapacity, kPeriodNs);
+    int64_t nowNs = 0;
+
+    drainPeriod(&policy, &nowNs, 0 /* ageNs */, 10);
+    ASSERT_GT(policy.getLatencyUs(), 10000);
+
+    EXPECT_TRUE(drainPeriod(&policy, &nowNs, 0 /* ageNs */, kCapacity / 2 + 1));
+    EXPECT_EQ(policy.getLatencyUs(), 10000);
+    EXPECT_EQ(policy.getPeakEventCount(), kCapacity / 2 + 1);
+}
+
+TEST(AdaptiveBatchingPolicyTest, WaitsForEvaluationPeriod) {
+    AdaptiveBatchingPolicy policy(kMinLatencyUs, kMaxLatencyUs, kCapacity, kPeriodNs);
+
+    EXPECT_FALSE(policy.onDrain(0, 0 /* ageNs */, 10));
+    EXPECT_FALSE(policy.onDrain(kPeriodNs - 1, 0 /* ageNs */, 10));
+    EXPECT_TRUE(policy.onDrain(kPeriodNs, 0 /* ageNs */, 10));
+}
+
+TEST(AdaptiveBatchingPolicyTest, QueueAppliesLatencyToRegisteredSensors) {
+    sp<FakeSensorManager> fakeManager = new FakeSensorManager;
+    ASensorManager manager(fakeManager);
+    ASSERT_EQ(manager.initCheck(), android::OK);
+    sp<ALooper> looper = new ALooper;
+
+    ASensorEventQueue *queue = ASensorManager_createEventQueue(
+            &manager, looper.get(), 0 /* ident */, nullptr /* callback */, nullptr /* data */);
+    ASSERT_NE(queue, nullptr);
+    sp<FakeEventQueue> server = fakeManager->getEventQueues().back();
+
+    ASensorRef accelerometer = manager.getSensorByHandle(1);
+    ASSERT_EQ(ASensorEventQueue_registerSensor(queue, accelerometer, 5000, 0), 0);
+
+    EXPECT_LT(ASensorEventQueue_setAdaptiveBatching(queue, 20000, 10000), 0);
+    ASSERT_EQ(ASensorEventQueue_setAdaptiveBatching(queue, 20000, 100000), 0);
+
+    FakeEventQueue::SensorConfig config;
+    ASSERT_TRUE(server->getSensorConfig(1, &config));
+    EXPECT_EQ(config.samplingPeriodUs, 5000);
+    EXPECT_EQ(config.maxBatchReportLatencyUs, 20000);
+
+    // Later registrations use the chosen latency too.
+    ASensorRef gyroscope = manager.getSensorByHandle(2);
+    ASSERT_EQ(ASensorEventQueue_registerSensor(queue, gyroscope, 5000, 0), 0);
+    ASSERT_TRUE(server->getSensorConfig(2, &config));
+    EXPECT_EQ(config.maxBatchReportLatencyUs, 20000);
+
+    ASensorEventQueueBatchingStats stats;
+    ASSERT_EQ(ASensorEventQueue_getBatchingStats(queue, &stats), 0);
+    EXPECT_EQ(stats.maxBatchReportLatencyUs, 20000);
+    EXPECT_EQ(stats.adjustmentCount, 0u);
+
+    EXPECT_EQ(ASensorManager_destroyEventQueue(&manager, queue), android::OK);
+}
+
+}  // namespace
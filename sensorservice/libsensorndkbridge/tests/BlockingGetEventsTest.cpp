@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorEventQueueTest.h"
+
+#include <gtest/gtest.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using android::frameworks::sensorservice::testing::SensorEventQueueTest;
+
+namespace {
+
+constexpr int64_t kLongTimeoutNs = 5000000000;
+
+class BlockingGetEventsTest : public SensorEventQueueTest<::testing::TestWithParam<bool>> {
+  protected:
+    bool useFmq() const override { return GetParam(); }
+};
+
+TEST_P(BlockingGetEventsTest, TimesOutWithoutEvents) {
+    constexpr int64_t kTimeoutNs = 20000000;
+    ASensorEvent event;
+
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(ASensorEventQueue_getEventsBlocking(mQueue, &event, 1, kTimeoutNs, 1), 0);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::nanoseconds(kTimeoutNs));
+}
+
+TEST_P(BlockingGetEventsTest, ZeroTimeoutDoesNotWait) {
+    ASensorEvent event;
+    EXPECT_EQ(ASensorEventQueue_getEventsBlocking(mQueue, &event, 1, 0 /* timeoutNs */, 1), 0);
+
+    mServer->injectEvents(mFakeManager->makeEvents(1, 100));
+    EXPECT_EQ(ASensorEventQueue_getEventsBlocking(mQueue, &event, 1, 0 /* timeoutNs */, 1), 1);
+    EXPECT_EQ(event.timestamp, 100);
+}
+
+TEST_P(BlockingGetEventsTest, WakesOnceMinCountIsQueued) {
+    constexpr size_t kChunks = 8;
+    constexpr size_t kChunkSize = 16;
+
+    std::thread producer([&] {
+        for (size_t i = 0; i < kChunks; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            mServer->injectEvents(mFakeManager->makeEvents(kChunkSize, i * kChunkSize));
+        }
+    });
+
+    std::vector<ASensorEvent> events(kChunks * kChunkSize);
+    const ssize_t count = ASensorEventQueue_getEventsBlocking(
+            mQueue, events.data(), events.size(), kLongTimeoutNs, events.size());
+    producer.join();
+
+    ASSERT_EQ(count, static_cast<ssize_t>(events.size()));
+    for (size_t i = 0; i < events.size(); ++i) {
+        EXPECT_EQ(events[i].timestamp, static_cast<int64_t>(i));
+    }
+}
+
+TEST_P(BlockingGetEventsTest, HasEventsFromAnotherThread) {
+    EXPECT_EQ(ASensorEventQueue_hasEvents(mQueue), 0);
+
+    std::thread producer([&] { mServer->injectEvents(mFakeManager->makeEvents(1, 100)); });
+    producer.join();
+
+    EXPECT_EQ(ASensorEventQueue_hasEvents(mQueue), 1);
+}
+
+INSTANTIATE_TEST_CASE_P(Transports, BlockingGetEventsTest, ::testing::Bool());
+
+}  // namespace
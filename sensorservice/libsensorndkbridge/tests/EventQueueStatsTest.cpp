@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeSensorManager.h"
+#include "LatencyHistogram.h"
+#include "SensorEventQueueTest.h"
+
+#include <gtest/gtest.h>
+#include <sensorndkbridge/sensor_ext.h>
+#include <utils/Timers.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+using android::sp;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::frameworks::sensorservice::testing::SensorEventQueueTest;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::Event;
+
+namespace {
+
+TEST(LatencyHistogramTest, BucketsByPowersOfTwoMicroseconds) {
+    EXPECT_EQ(LatencyHistogram::bucketOf(-5), 0u);
+    EXPECT_EQ(LatencyHistogram::bucketOf(0), 0u);
+    EXPECT_EQ(LatencyHistogram::bucketOf(999), 0u);
+    EXPECT_EQ(LatencyHistogram::bucketOf(1000), 1u);
+    EXPECT_EQ(LatencyHistogram::bucketOf(1999), 1u);
+    EXPECT_EQ(LatencyHistogram::bucketOf(2000), 2u);
+    EXPECT_EQ(LatencyHistogram::bucketOf(3999), 2u);
+    EXPECT_EQ(LatencyHistogram::bucketOf(4000), 3u);
+    EXPECT_EQ(LatencyHistogram::bucketOf(INT64_MAX), LatencyHistogram::kBucketCount - 1);
+}
+
+TEST(LatencyHistogramTest, RecordsCountSumAndMax) {
+    LatencyHistogram histogram;
+    histogram.record(500);
+    histogram.record(3000);
+    histogram.record(3500);
+
+    ASensorLatencyHistogram snapshot;
+    histogram.snapshot(&snapshot);
+    EXPECT_EQ(snapshot.count, 3u);
+    EXPECT_EQ(snapshot.sumUs, 6u);
+    EXPECT_EQ(snapshot.maxNs, 3500);
+    EXPECT_EQ(snapshot.buckets[0], 1u);
+    EXPECT_EQ(snapshot.buckets[2], 2u);
+}
+
+class EventQueueStatsTest : public SensorEventQueueTest<> {
+  protected:
+    // Events timestamped now, so that latencies stay small.
+    hidl_vec<Event> makeEvents(size_t count) {
+        return mFakeManager->makeEvents(count, systemTime(SYSTEM_TIME_BOOTTIME));
+    }
+};
+
+TEST_F(EventQueueStatsTest, RejectsNullArguments) {
+    ASensorEventQueueStats stats;
+    EXPECT_EQ(ASensorEventQueue_getStats(nullptr, &stats), android::BAD_VALUE);
+    EXPECT_EQ(ASensorEventQueue_getStats(mQueue, nullptr), android::BAD_VALUE);
+}
+
+TEST_F(EventQueueStatsTest, CountsReceivedAndReadEvents) {
+    mServer->injectEvents(makeEvents(3));
+    mServer->injectEventBatch(makeEvents(5));
+
+    ASensorEventQueueStats stats;
+    ASSERT_EQ(ASensorEventQueue_getStats(mQueue, &stats), android::OK);
+    EXPECT_EQ(stats.eventsReceived, 8u);
+    EXPECT_EQ(stats.eventsRead, 0u);
+    EXPECT_EQ(stats.eventsDropped, 0u);
+    EXPECT_EQ(stats.deliveryLatency.count, 8u);
+    EXPECT_EQ(stats.readLatency.count, 0u);
+
+    ASensorEvent events[16];
+    ASSERT_EQ(ASensorEventQueue_getEvents(mQueue, events, 16), 8);
+
+    ASSERT_EQ(ASensorEventQueue_getStats(mQueue, &stats), android::OK);
+    EXPECT_EQ(stats.eventsRead, 8u);
+    EXPECT_EQ(stats.readLatency.count, 8u);
+    EXPECT_GE(stats.readLatency.maxNs, stats.deliveryLatency.maxNs);
+}
+
+TEST_F(EventQueueStatsTest, DumpsOnSigquit) {
+    int fds[2];
+    ASSERT_EQ(pipe2(fds, O_CLOEXEC), 0);
+
+    ASSERT_EQ(ASensorManager_enableStatsDump(mManager.get(), fds[1]), android::OK);
+
+    // Only one manager may own the signal handler.
+    sp<FakeSensorManager> otherFake = new FakeSensorManager;
+    ASensorManager other(otherFake);
+    EXPECT_EQ(ASensorManager_enableStatsDump(&other, -1), android::INVALID_OPERATION);
+
+    mServer->injectEvents(makeEvents(2));
+    ASSERT_EQ(raise(SIGQUIT), 0);
+
+    struct pollfd pfd = {fds[0], POLLIN, 0};
+    ASSERT_EQ(poll(&pfd, 1, 5000 /* ms */), 1);
+
+    char buffer[4096];
+    const ssize_t n = read(fds[0], buffer, sizeof(buffer) - 1);
+    ASSERT_GT(n, 0);
+    const std::string dump(buffer, n);
+    EXPECT_NE(dump.find("1 event queue(s)"), std::string::npos) << dump;
+    EXPECT_NE(dump.find("received=2"), std::string::npos) << dump;
+
+    // Destroying the manager restores the previous SIGQUIT disposition.
+    TearDown();
+    mQueue = nullptr;
+
+    struct sigaction action;
+    ASSERT_EQ(sigaction(SIGQUIT, nullptr, &action), 0);
+    EXPECT_EQ(action.sa_handler, SIG_DFL);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+}  // namespace
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FakeSensorManager.h"
+#include "SensorEventQueueTest.h"
+
+#include <gtest/gtest.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+#include <thread>
+#include <vector>
+
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::frameworks::sensorservice::testing::SensorEventQueueTest;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::Event;
+using android::hardware::sensors::V1_0::SensorType;
+
+namespace {
+
+class FmqEventQueueTest : public SensorEventQueueTest<> {
+  protected:
+    bool useFmq() const override { return true; }
+};
+
+TEST_F(FmqEventQueueTest, CreatesFmqBackedQueue) {
+    auto serverQueues = mFakeManager->getEventQueues();
+    ASSERT_EQ(serverQueues.size(), 1u);
+    EXPECT_NE(serverQueues[0]->getFmq(), nullptr);
+}
+
+TEST_F(FmqEventQueueTest, LoopbackPreservesOrder) {
+    const auto &accelerometer = mFakeManager->sensors()[0];
+    ASSERT_EQ(ASensorEventQueue_enableSensor(
+                      mQueue, reinterpret_cast<ASensorRef>(&accelerometer)),
+              android::OK);
+
+    // More events than the FMQ can hold, so the producer has to wait for the
+    // consumer to make room.
+    constexpr size_t kEventCount = 4 * FakeSensorManager::kFmqCapacity;
+    constexpr size_t kChunk = 100;
+    std::thread producer([&] {
+        for (size_t sent = 0; sent < kEventCount; sent += kChunk) {
+            mServer->injectEvents(
+                    mFakeManager->makeEvents(std::min(kChunk, kEventCount - sent), sent));
+        }
+    });
+
+    std::vector<ASensorEvent> buffer(256);
+    size_t received = 0;
+    while (received < kEventCount) {
+        if (!ASensorEventQueue_hasEvents(mQueue)) {
+            ASSERT_NE(mLooper->pollOnce(1000 /* timeoutMillis */, nullptr, nullptr, nullptr),
+                      ALOOPER_POLL_TIMEOUT);
+            continue;
+        }
+
+        ssize_t count = ASensorEventQueue_getEvents(mQueue, buffer.data(), buffer.size());
+        ASSERT_GT(count, 0);
+        for (ssize_t i = 0; i < count; ++i) {
+            ASSERT_EQ(buffer[i].timestamp, static_cast<int64_t>(received));
+            ASSERT_EQ(buffer[i].sensor, accelerometer.sensorHandle);
+            ASSERT_EQ(buffer[i].type, ASENSOR_TYPE_ACCELEROMETER);
+            ++received;
+        }
+    }
+    producer.join();
+}
+
+TEST_F(FmqEventQueueTest, CountsOnlyDeliveredEvents) {
+    // Additional info events are filtered out unless requested, and must not
+    // count as received either.
+    hidl_vec<Event> events = mFakeManager->makeEvents(6, 0 /* firstTimestamp */);
+    events[1].sensorType = SensorType::ADDITIONAL_INFO;
+    events[4].sensorType = SensorType::ADDITIONAL_INFO;
+    mServer->injectEvents(events);
+
+    ASensorEvent buffer[16];
+    ASSERT_EQ(ASensorEventQueue_getEvents(mQueue, buffer, 16), 4);
+
+    ASensorEventQueueStats stats;
+    ASSERT_EQ(ASensorEventQueue_getStats(mQueue, &stats), android::OK);
+    EXPECT_EQ(stats.eventsReceived, 4u);
+    EXPECT_EQ(stats.eventsRead, 4u);
+}
+
+}  // namespace
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ASensorManager.h"
+#include "FakeSensorManager.h"
+
+#include <android-base/unique_fd.h>
+#include <android/hardware_buffer.h>
+#include <cutils/native_handle.h>
+#include <gtest/gtest.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <memory>
+
+using android::sp;
+using android::base::unique_fd;
+using android::frameworks::sensorservice::testing::FakeDirectReportChannel;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::hardware::sensors::V1_0::SensorInfo;
+
+namespace {
+
+constexpr size_t kRecordCount = 16;
+constexpr size_t kRegionSize = kRecordCount * sizeof(ASensorEvent);
+
+// Stands in for a gralloc BLOB buffer: the fake service maps the handle's
+// file descriptor, the test maps the same memfd the way a client would map
+// a locked AHardwareBuffer.
+class HardwareBufferDirectChannelTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mFakeManager = new FakeSensorManager;
+        mManager.reset(new ASensorManager(mFakeManager));
+        ASSERT_EQ(mManager->initCheck(), android::OK);
+
+        mAccelerometer = ASensorManager_getDefaultSensor(mManager.get(), ASENSOR_TYPE_ACCELEROMETER);
+        ASSERT_NE(mAccelerometer, nullptr);
+
+        mFd.reset(static_cast<int>(syscall(__NR_memfd_create, "sensor_direct", 0)));
+        ASSERT_GE(mFd.get(), 0);
+        ASSERT_EQ(ftruncate(mFd.get(), kRegionSize), 0);
+
+        mHandle = native_handle_create(1 /* numFds */, 0 /* numInts */);
+        ASSERT_NE(mHandle, nullptr);
+        mHandle->data[0] = mFd.get();
+
+        mRegion = mmap(nullptr, kRegionSize, PROT_READ, MAP_SHARED, mFd.get(), 0 /* offset */);
+        ASSERT_NE(mRegion, MAP_FAILED);
+    }
+
+    void TearDown() override {
+        mManager.reset();
+        if (mHandle != nullptr) {
+            // The descriptor belongs to mFd.
+            native_handle_delete(mHandle);
+        }
+        if (mRegion != MAP_FAILED) {
+            munmap(mRegion, kRegionSize);
+        }
+    }
+
+    sp<FakeDirectReportChannel> server() {
+        auto channels = mFakeManager->getDirectChannels();
+        return channels.size() == 1 ? channels[0] : nullptr;
+    }
+
+    const SensorInfo &accelerometerInfo() const {
+        return *reinterpret_cast<const SensorInfo *>(mAccelerometer);
+    }
+
+    sp<FakeSensorManager> mFakeManager;
+    std::unique_ptr<ASensorManager> mManager;
+    ASensorRef mAccelerometer;
+    unique_fd mFd;
+    native_handle_t *mHandle = nullptr;
+    void *mRegion = MAP_FAILED;
+};
+
+TEST_F(HardwareBufferDirectChannelTest, EventsAreReadInPlace) {
+    const int channelId = mManager->createHardwareBufferDirectChannel(mHandle, kRegionSize);
+    ASSERT_GT(channelId, 0);
+    sp<FakeDirectReportChannel> channel = server();
+    ASSERT_NE(channel, nullptr);
+
+    const int token = ASensorManager_configureDirectReport(
+            mManager.get(), mAccelerometer, channelId, ASENSOR_DIRECT_RATE_NORMAL);
+    ASSERT_GT(token, 0);
+
+    ASensorDirectReportReader *reader = ASensorDirectReportReader_create(mRegion, kRegionSize);
+    ASSERT_NE(reader, nullptr);
+
+    ASSERT_TRUE(channel->writeEvent(FakeSensorManager::makeEvent(accelerometerInfo(), 100)));
+    ASSERT_TRUE(channel->writeEvent(FakeSensorManager::makeEvent(accelerometerInfo(), 200)));
+
+    const ASensorEvent *events[kRecordCount];
+    ASSERT_EQ(ASensorDirectReportReader_getEvents(reader, events, kRecordCount), 2);
+    EXPECT_EQ(events[0], static_cast<const ASensorEvent *>(mRegion));
+    EXPECT_EQ(events[0]->timestamp, 100);
+    EXPECT_EQ(events[1]->timestamp, 200);
+    EXPECT_EQ(events[1]->sensor, token);
+    EXPECT_EQ(events[1]->type, ASENSOR_TYPE_ACCELEROMETER);
+
+    ASensorDirectReportReader_destroy(reader);
+
+    EXPECT_EQ(ASensorManager_configureDirectReport(
+                      mManager.get(), nullptr, channelId, ASENSOR_DIRECT_RATE_STOP),
+              0);
+    EXPECT_FALSE(channel->writeEvent(FakeSensorManager::makeEvent(accelerometerInfo(), 300)));
+
+    ASensorManager_destroyDirectChannel(mManager.get(), channelId);
+}
+
+TEST_F(HardwareBufferDirectChannelTest, SharesPathWithAshmemChannels) {
+    const int bufferChannel = mManager->createHardwareBufferDirectChannel(mHandle, kRegionSize);
+    const int memoryChannel =
+            ASensorManager_createSharedMemoryDirectChannel(mManager.get(), mFd.get(), kRegionSize);
+    ASSERT_GT(bufferChannel, 0);
+    ASSERT_GT(memoryChannel, 0);
+    EXPECT_NE(bufferChannel, memoryChannel);
+    EXPECT_EQ(mFakeManager->getDirectChannels().size(), 2u);
+
+    ASensorManager_destroyDirectChannel(mManager.get(), bufferChannel);
+    ASensorManager_destroyDirectChannel(mManager.get(), memoryChannel);
+    EXPECT_LT(ASensorManager_configureDirectReport(
+                      mManager.get(), mAccelerometer, bufferChannel, ASENSOR_DIRECT_RATE_NORMAL),
+              0);
+}
+
+TEST_F(HardwareBufferDirectChannelTest, RejectsUnmappableBuffer) {
+    native_handle_t *empty = native_handle_create(0 /* numFds */, 0 /* numInts */);
+    EXPECT_LT(mManager->createHardwareBufferDirectChannel(empty, kRegionSize), 0);
+    native_handle_delete(empty);
+
+    EXPECT_TRUE(mFakeManager->getDirectChannels().empty());
+}
+
+// A buffer ASensorManager_createHardwareBufferDirectChannel accepts.
+AHardwareBuffer_Desc makeDirectChannelDesc(size_t size) {
+    AHardwareBuffer_Desc desc = {};
+    desc.width = size;
+    desc.height = 1;
+    desc.layers = 1;
+    desc.format = AHARDWAREBUFFER_FORMAT_BLOB;
+    desc.usage = AHARDWAREBUFFER_USAGE_SENSOR_DIRECT_DATA | AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN;
+    return desc;
+}
+
+TEST(DirectChannelBufferTest, AcceptsSensorDirectDataBlob) {
+    EXPECT_TRUE(ASensorManager::isValidDirectChannelBuffer(
+            makeDirectChannelDesc(kRegionSize), kRegionSize));
+    EXPECT_TRUE(ASensorManager::isValidDirectChannelBuffer(
+            makeDirectChannelDesc(2 * kRegionSize), kRegionSize));
+}
+
+TEST(DirectChannelBufferTest, RejectsNonBlobFormat) {
+    AHardwareBuffer_Desc desc = makeDirectChannelDesc(kRegionSize);
+    desc.format = AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM;
+    EXPECT_FALSE(ASensorManager::isValidDirectChannelBuffer(desc, kRegionSize));
+}
+
+TEST(DirectChannelBufferTest, RejectsBufferWithoutSensorDirectDataUsage) {
+    AHardwareBuffer_Desc desc = makeDirectChannelDesc(kRegionSize);
+    desc.usage = AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN;
+    EXPECT_FALSE(ASensorManager::isValidDirectChannelBuffer(desc, kRegionSize));
+}
+
+TEST(DirectChannelBufferTest, RejectsBufferSmallerThanChannel) {
+    EXPECT_FALSE(ASensorManager::isValidDirectChannelBuffer(
+            makeDirectChannelDesc(kRegionSize - 1), kRegionSize));
+}
+
+}  // namespace
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ALooper.h"
+#include "ASensorEventQueue.h"
+#include "ASensorManager.h"
+#include "FakeSensorManager.h"
+
+#include <gtest/gtest.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+#include <sched.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using android::sp;
+using android::frameworks::sensorservice::testing::FakeEventQueue;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+
+namespace {
+
+constexpr auto kTimeout = std::chrono::seconds(5);
+
+// State shared with a queue callback.
+struct Consumer {
+    ASensorEventQueue *queue = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<int64_t> timestamps;
+    bool blocked = false;
+    bool released = true;
+
+    std::atomic<int> running{0};
+    std::atomic<bool> overlapped{false};
+    std::atomic<int> lastCpu{-1};
+
+    static int callback(int /* fd */, int /* events */, void *data) {
+        Consumer *consumer = static_cast<Consumer *>(data);
+        if (consumer->running.fetch_add(1) != 0) {
+            consumer->overlapped = true;
+        }
+        consumer->lastCpu = sched_getcpu();
+
+        ASensorEvent events[16];
+        ssize_t count;
+        std::unique_lock<std::mutex> lock(consumer->mutex);
+        while ((count = ASensorEventQueue_getEvents(consumer->queue, events, 16)) > 0) {
+            for (ssize_t i = 0; i < count; ++i) {
+                consumer->timestamps.push_back(events[i].timestamp);
+            }
+        }
+        consumer->blocked = true;
+        consumer->changed.notify_all();
+        consumer->changed.wait(lock, [consumer] { return consumer->released; });
+        consumer->blocked = false;
+
+        consumer->running.fetch_sub(1);
+        return 1;
+    }
+
+    bool waitForEvents(size_t count) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return changed.wait_for(lock, kTimeout, [&] { return timestamps.size() >= count; });
+    }
+
+    bool waitUntilBlocked() {
+        std::unique_lock<std::mutex> lock(mutex);
+        return changed.wait_for(lock, kTimeout, [&] { return blocked; });
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex);
+        released = true;
+        changed.notify_all();
+    }
+};
+
+class SensorDispatcherTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mFakeManager = new FakeSensorManager;
+        mManager.reset(new ASensorManager(mFakeManager));
+        ASSERT_EQ(mManager->initCheck(), android::OK);
+        mLooper = new ALooper;
+    }
+
+    void TearDown() override {
+        stopPolling();
+        for (Consumer *consumer : mConsumers) {
+            consumer->release();
+        }
+        ASSERT_EQ(ALooper_setSensorDispatchWorkers(mLooper.get(), 0), 0);
+        for (Consumer *consumer : mConsumers) {
+            ASensorManager_destroyEventQueue(mManager.get(), consumer->queue);
+            delete consumer;
+        }
+        mManager.reset();
+        mLooper.clear();
+    }
+
+    Consumer *createConsumer() {
+        Consumer *consumer = new Consumer;
+        consumer->queue = ASensorManager_createEventQueue(
+                mManager.get(), mLooper.get(), 0 /* ident */, Consumer::callback, consumer);
+        mConsumers.push_back(consumer);
+        return consumer;
+    }
+
+    sp<FakeEventQueue> server(size_t index) { return mFakeManager->getEventQueues()[index]; }
+
+    void startPolling() {
+        mPolling = true;
+        mPoller = std::thread([this] {
+            while (mPolling) {
+                mLooper->pollOnce(10 /* timeoutMillis */, nullptr, nullptr, nullptr);
+            }
+        });
+    }
+
+    void stopPolling() {
+        mPolling = false;
+        if (mPoller.joinable()) {
+            mPoller.join();
+        }
+    }
+
+    sp<FakeSensorManager> mFakeManager;
+    std::unique_ptr<ASensorManager> mManager;
+    sp<ALooper> mLooper;
+    std::vector<Consumer *> mConsumers;
+    std::atomic<bool> mPolling{false};
+    std::thread mPoller;
+};
+
+TEST_F(SensorDispatcherTest, SlowCallbackDoesNotBlockOtherQueues) {
+    ASSERT_EQ(ALooper_setSensorDispatchWorkers(mLooper.get(), 2), 0);
+    Consumer *slow = createConsumer();
+    Consumer *fast = createConsumer();
+    ASSERT_NE(slow->queue, nullptr);
+    ASSERT_NE(fast->queue, nullptr);
+    slow->released = false;
+    startPolling();
+
+    server(0)->injectEvents(mFakeManager->makeEvents(1, 100));
+    ASSERT_TRUE(slow->waitUntilBlocked());
+
+    for (int64_t i = 0; i < 3; ++i) {
+        server(1)->injectEvents(mFakeManager->makeEvents(1, 200 + i));
+        ASSERT_TRUE(fast->waitForEvents(i + 1));
+    }
+
+    // Events for the blocked queue wait for its callback to return.
+    server(0)->injectEvents(mFakeManager->makeEvents(1, 101));
+    slow->release();
+    ASSERT_TRUE(slow->waitForEvents(2));
+    std::lock_guard<std::mutex> lock(slow->mutex);
+    EXPECT_EQ(slow->timestamps, std::vector<int64_t>({100, 101}));
+}
+
+TEST_F(SensorDispatcherTest, CallbacksOfAQueueRunInOrder) {
+    constexpr size_t kEventCount = 2000;
+
+    ASSERT_EQ(ALooper_setSensorDispatchWorkers(mLooper.get(), 4), 0);
+    Consumer *consumer = createConsumer();
+    ASSERT_NE(consumer->queue, nullptr);
+    startPolling();
+
+    for (size_t i = 0; i < kEventCount; ++i) {
+        server(0)->injectEvents(mFakeManager->makeEvents(1, i));
+    }
+    ASSERT_TRUE(consumer->waitForEvents(kEventCount));
+
+    EXPECT_FALSE(consumer->overlapped);
+    std::lock_guard<std::mutex> lock(consumer->mutex);
+    for (size_t i = 0; i < consumer->timestamps.size(); ++i) {
+        ASSERT_EQ(consumer->timestamps[i], static_cast<int64_t>(i));
+    }
+}
+
+TEST_F(SensorDispatcherTest, IdleWorkerStealsQueuedWork) {
+    ASSERT_EQ(ALooper_setSensorDispatchWorkers(mLooper.get(), 2), 0);
+    Consumer *blocked = createConsumer();
+    Consumer *other = createConsumer();
+    Consumer *stolen = createConsumer();
+    ASSERT_NE(blocked->queue, nullptr);
+    ASSERT_NE(other->queue, nullptr);
+    ASSERT_NE(stolen->queue, nullptr);
+    blocked->released = false;
+    EXPECT_EQ(mLooper->getDispatchStealCount(), 0u);
+    startPolling();
+
+    // Queues get their home worker in the order they are first posted, so
+    // |blocked| and |stolen| share one.
+    server(0)->injectEvents(mFakeManager->makeEvents(1, 100));
+    ASSERT_TRUE(blocked->waitUntilBlocked());
+    server(1)->injectEvents(mFakeManager->makeEvents(1, 200));
+    ASSERT_TRUE(other->waitForEvents(1));
+
+    // Either the blocked queue was stolen already, or its home worker is
+    // busy and |stolen| can only run on the other one.
+    server(2)->injectEvents(mFakeManager->makeEvents(1, 300));
+    ASSERT_TRUE(stolen->waitForEvents(1));
+    EXPECT_GT(mLooper->getDispatchStealCount(), 0u);
+}
+
+TEST_F(SensorDispatcherTest, RunsCallbackOnRequestedCpu) {
+    cpu_set_t cpus;
+    ASSERT_EQ(sched_getaffinity(0 /* pid */, sizeof(cpus), &cpus), 0);
+    int cpu = 0;
+    while (cpu < 64 && !CPU_ISSET(cpu, &cpus)) {
+        ++cpu;
+    }
+    ASSERT_LT(cpu, 64);
+
+    Consumer *consumer = createConsumer();
+    ASSERT_NE(consumer->queue, nullptr);
+    const ASensorDispatchPolicy policy = {1ull << cpu, SCHED_OTHER, 0 /* priority */};
+
+    // Only loopers with workers take a policy.
+    EXPECT_LT(ASensorEventQueue_setDispatchPolicy(consumer->queue, &policy), 0);
+
+    ASSERT_EQ(ALooper_setSensorDispatchWorkers(mLooper.get(), 2), 0);
+    EXPECT_LT(ALooper_setSensorDispatchWorkers(mLooper.get(), 3), 0);
+
+    const ASensorDispatchPolicy invalid = {0 /* cpuMask */, SCHED_FIFO, 0 /* priority */};
+    EXPECT_LT(ASensorEventQueue_setDispatchPolicy(consumer->queue, &invalid), 0);
+    ASSERT_EQ(ASensorEventQueue_setDispatchPolicy(consumer->queue, &policy), 0);
+    startPolling();
+
+    for (int64_t i = 0; i < 4; ++i) {
+        server(0)->injectEvents(mFakeManager->makeEvents(1, i));
+        ASSERT_TRUE(consumer->waitForEvents(i + 1));
+        EXPECT_EQ(consumer->lastCpu, cpu);
+    }
+}
+
+TEST_F(SensorDispatcherTest, RemovingWorkersDispatchesOnPollingThread) {
+    ASSERT_EQ(ALooper_setSensorDispatchWorkers(mLooper.get(), 2), 0);
+    ASSERT_EQ(ALooper_setSensorDispatchWorkers(mLooper.get(), 0), 0);
+
+    Consumer *consumer = createConsumer();
+    ASSERT_NE(consumer->queue, nullptr);
+
+    server(0)->injectEvents(mFakeManager->makeEvents(1, 100));
+    EXPECT_EQ(mLooper->pollOnce(1000 /* timeoutMillis */, nullptr, nullptr, nullptr),
+              ALOOPER_POLL_CALLBACK);
+    EXPECT_EQ(consumer->timestamps, std::vector<int64_t>({100}));
+}
+
+}  // namespace
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ALooper.h"
+#include "ASensorEventQueue.h"
+#include "ASensorManager.h"
+#include "FakeSensorManager.h"
+#include "SensorEventCodec.h"
+
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+using android::sp;
+using android::frameworks::sensorservice::testing::FakeEventQueue;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::Event;
+using android::hardware::sensors::V1_0::SensorInfo;
+using android::hardware::sensors::V1_0::SensorStatus;
+using android::hardware::sensors::V1_0::SensorType;
+
+namespace {
+
+void expectSameEvent(const Event &actual, const Event &expected) {
+    EXPECT_EQ(actual.timestamp, expected.timestamp);
+    EXPECT_EQ(actual.sensorHandle, expected.sensorHandle);
+    EXPECT_EQ(actual.sensorType, expected.sensorType);
+    EXPECT_EQ(memcmp(&actual.u, &expected.u, sizeof(actual.u)), 0);
+}
+
+// An event with only the fields its type defines set.
+Event makeEvent(const SensorInfo &sensor, int64_t timestamp, const std::vector<float> &values) {
+    Event event;
+    memset(&event.u, 0, sizeof(event.u));
+    event.timestamp = timestamp;
+    event.sensorHandle = sensor.sensorHandle;
+    event.sensorType = sensor.type;
+    memcpy(event.u.data.data(), values.data(), values.size() * sizeof(float));
+    if (sensor_event_codec::quantizedAxisCount(sensor.type) == 3) {
+        event.u.vec3.status = SensorStatus::ACCURACY_MEDIUM;
+    }
+    return event;
+}
+
+// A slowly varying signal on every default fake sensor, interleaved.
+std::vector<Event> makeEvents(const hidl_vec<SensorInfo> &sensors, size_t count) {
+    std::vector<Event> events;
+    for (size_t i = 0; i < count; ++i) {
+        const SensorInfo &sensor = sensors[i % sensors.size()];
+        std::vector<float> values;
+        for (int axis = 0; axis < 6; ++axis) {
+            const int32_t q = 981 + static_cast<int32_t>(i / 16) * (axis - 2);
+            values.push_back(sensor_event_codec::dequantize(q, sensor.resolution));
+        }
+        events.push_back(makeEvent(sensor, 1000000000 + i * 1250000, values));
+    }
+    return events;
+}
+
+std::vector<uint8_t> encode(const hidl_vec<SensorInfo> &sensors, const std::vector<Event> &events) {
+    std::vector<uint8_t> data;
+    SensorEventEncoder(sensors).encode(events.data(), events.size(), &data);
+    return data;
+}
+
+TEST(SensorEventCodecTest, RoundTripsEvents) {
+    const auto sensors = FakeSensorManager::makeDefaultSensorList();
+    const auto events = makeEvents(sensors, 1000);
+    const auto data = encode(sensors, events);
+
+    // Most axes take a single byte.
+    EXPECT_LT(data.size(), events.size() * sizeof(Event) / 8);
+
+    SensorEventDecoder decoder;
+    std::vector<Event> decoded;
+    ASSERT_TRUE(decoder.decode(data.data(), data.size(), &decoded));
+    ASSERT_EQ(decoded.size(), events.size());
+    for (size_t i = 0; i < events.size(); ++i) {
+        expectSameEvent(decoded[i], events[i]);
+    }
+}
+
+TEST(SensorEventCodecTest, KeepsValuesOffTheResolutionGrid) {
+    const auto sensors = FakeSensorManager::makeDefaultSensorList();
+    const SensorInfo &accelerometer = sensors[0];
+    const SensorInfo &gyroscope = sensors[4];
+    ASSERT_EQ(gyroscope.type, SensorType::GYROSCOPE_UNCALIBRATED);
+
+    const SensorInfo unknown = FakeSensorManager::makeSensorInfo(
+            100 /* sensorHandle */, SensorType::ACCELEROMETER, "unknown");
+
+    const std::vector<Event> events = {
+        makeEvent(accelerometer, 100, {0.123456f, -0.0f, NAN}),
+        makeEvent(accelerometer, 90, {INFINITY, 1e30f, 0.01f}),
+        makeEvent(gyroscope, -5, {1.0f, 2.0f, 3.0f, 1e-7f, -1e-7f, 0.5f}),
+        makeEvent(sensors[6], 200, {5.0f}),
+        makeEvent(unknown, 300, {0.01f, 0.02f, 0.03f}),
+    };
+
+    const auto data = encode(sensors, events);
+    SensorEventDecoder decoder;
+    std::vector<Event> decoded;
+    ASSERT_TRUE(decoder.decode(data.data(), data.size(), &decoded));
+    ASSERT_EQ(decoded.size(), events.size());
+    for (size_t i = 0; i < events.size(); ++i) {
+        expectSameEvent(decoded[i], events[i]);
+    }
+}
+
+TEST(SensorEventCodecTest, RejectsInvalidData) {
+    const auto sensors = FakeSensorManager::makeDefaultSensorList();
+    auto data = encode(sensors, makeEvents(sensors, 20));
+
+    SensorEventDecoder decoder;
+    std::vector<Event> decoded;
+    for (size_t size = 0; size < data.size(); ++size) {
+        EXPECT_FALSE(decoder.decode(data.data(), size, &decoded)) << size;
+        EXPECT_TRUE(decoded.empty());
+    }
+
+    data.push_back(0);
+    EXPECT_FALSE(decoder.decode(data.data(), data.size(), &decoded));
+    data.pop_back();
+
+    data[0] = sensor_event_codec::kVersion + 1;
+    EXPECT_FALSE(decoder.decode(data.data(), data.size(), &decoded));
+}
+
+TEST(SensorEventCodecTest, DeliversCompressedBatches) {
+    sp<FakeSensorManager> fakeManager = new FakeSensorManager;
+    std::unique_ptr<ASensorManager> manager(new ASensorManager(fakeManager));
+    ASSERT_EQ(manager->initCheck(), android::OK);
+    sp<ALooper> looper = new ALooper;
+
+    ASensorEventQueue *queue = ASensorManager_createEventQueue(
+            manager.get(), looper.get(), 0 /* ident */, nullptr, nullptr);
+    ASSERT_NE(queue, nullptr);
+    sp<FakeEventQueue> server = fakeManager->getEventQueues().back();
+
+    const auto events = makeEvents(fakeManager->sensors(), 200);
+    hidl_vec<Event> batch(events);
+    EXPECT_GT(server->injectCompressedEvents(batch, fakeManager->sensors()), 0u);
+
+    std::vector<ASensorEvent> received(events.size() + 1);
+    ASSERT_EQ(ASensorEventQueue_getEvents(queue, received.data(), received.size()),
+              static_cast<ssize_t>(events.size()));
+    for (size_t i = 0; i < events.size(); ++i) {
+        EXPECT_EQ(received[i].timestamp, events[i].timestamp);
+        EXPECT_EQ(received[i].sensor, events[i].sensorHandle);
+        EXPECT_EQ(received[i].data[0], events[i].u.data[0]);
+    }
+
+    ASensorManager_destroyEventQueue(manager.get(), queue);
+}
+
+}  // namespace
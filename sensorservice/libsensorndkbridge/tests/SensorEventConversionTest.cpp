@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorEventConversion.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+using android::hardware::sensors::V1_0::Event;
+using android::hardware::sensors::V1_0::SensorType;
+using android::hardware::sensors::V1_0::implementation::convertToSensorEvent;
+
+namespace {
+
+class SensorEventConversionTest : public ::testing::TestWithParam<SensorType> {};
+
+// Poisons padding and unused payload bytes so that a fast path copying more
+// than the fields it should is caught.
+Event makePoisonedEvent(SensorType type) {
+    Event event;
+    memset(&event, 0xA5, sizeof(event));
+    event.timestamp = 123456789;
+    event.sensorHandle = 7;
+    event.sensorType = type;
+    for (size_t i = 0; i < 16; ++i) {
+        event.u.data[i] = 0.5f * i;
+    }
+    if (fixedLayoutPayloadSize(type) % sizeof(float) != 0) {
+        event.u.vec3.status = android::hardware::sensors::V1_0::SensorStatus::ACCURACY_MEDIUM;
+    }
+    return event;
+}
+
+TEST_P(SensorEventConversionTest, MatchesGenericConverter) {
+    const Event event = makePoisonedEvent(GetParam());
+
+    sensors_event_t expected;
+    sensors_event_t actual;
+    memset(&expected, 0x33, sizeof(expected));
+    memset(&actual, 0xCC, sizeof(actual));
+
+    convertToSensorEvent(event, &expected);
+    convertSensorEvent(event, &actual);
+
+    EXPECT_EQ(memcmp(&expected, &actual, sizeof(sensors_event_t)), 0);
+}
+
+INSTANTIATE_TEST_CASE_P(
+        AllSensorTypes, SensorEventConversionTest,
+        ::testing::Values(
+                SensorType::ACCELEROMETER,
+                SensorType::MAGNETIC_FIELD,
+                SensorType::ORIENTATION,
+                SensorType::GYROSCOPE,
+                SensorType::LIGHT,
+                SensorType::PRESSURE,
+                SensorType::PROXIMITY,
+                SensorType::GRAVITY,
+                SensorType::LINEAR_ACCELERATION,
+                SensorType::ROTATION_VECTOR,
+                SensorType::RELATIVE_HUMIDITY,
+                SensorType::AMBIENT_TEMPERATURE,
+                SensorType::MAGNETIC_FIELD_UNCALIBRATED,
+                SensorType::GAME_ROTATION_VECTOR,
+                SensorType::GYROSCOPE_UNCALIBRATED,
+                SensorType::SIGNIFICANT_MOTION,
+                SensorType::STEP_DETECTOR,
+                SensorType::STEP_COUNTER,
+                SensorType::GEOMAGNETIC_ROTATION_VECTOR,
+                SensorType::HEART_RATE,
+                SensorType::ACCELEROMETER_UNCALIBRATED));
+
+}  // namespace
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorEventRing.h"
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+#include <vector>
+
+namespace {
+
+// Writes events numbered [first, first + count) one at a time and returns how
+// many the ring accepted.
+size_t writeEvents(SensorEventRing *ring, int64_t first, size_t count) {
+    size_t written = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sensors_event_t *event = ring->beginWrite();
+        if (event == nullptr) {
+            continue;
+        }
+        memset(event, 0, sizeof(*event));
+        event->timestamp = first + static_cast<int64_t>(i);
+        ring->endWrite();
+        ++written;
+    }
+    return written;
+}
+
+// Reads up to |count| events and checks they are numbered from |first| on.
+size_t readEvents(SensorEventRing *ring, int64_t first, size_t count) {
+    std::vector<sensors_event_t> events(count);
+    const size_t read = ring->read(events.data(), count);
+    for (size_t i = 0; i < read; ++i) {
+        EXPECT_EQ(first + static_cast<int64_t>(i), events[i].timestamp) << i;
+    }
+    return read;
+}
+
+TEST(SensorEventRingTest, RoundsCapacityUpToPowerOfTwo) {
+    EXPECT_EQ(1u, SensorEventRing(0).capacity());
+    EXPECT_EQ(1u, SensorEventRing(1).capacity());
+    EXPECT_EQ(8u, SensorEventRing(5).capacity());
+    EXPECT_EQ(8u, SensorEventRing(8).capacity());
+    EXPECT_EQ(16u, SensorEventRing(9).capacity());
+}
+
+TEST(SensorEventRingTest, ReadsAcrossWrapAround) {
+    SensorEventRing ring(8);
+
+    // Move the indices to the middle of the buffer, so that the next events
+    // wrap around its end and are drained in two chunks.
+    ASSERT_EQ(5u, writeEvents(&ring, 0, 5));
+    ASSERT_EQ(5u, readEvents(&ring, 0, 5));
+    EXPECT_TRUE(ring.empty());
+
+    ASSERT_EQ(8u, writeEvents(&ring, 100, 8));
+    EXPECT_EQ(8u, ring.size());
+    EXPECT_EQ(8u, readEvents(&ring, 100, 16));
+    EXPECT_TRUE(ring.empty());
+    EXPECT_EQ(0u, ring.overflowCount());
+}
+
+TEST(SensorEventRingTest, DropsNewestWhenFull) {
+    SensorEventRing ring(4);
+
+    EXPECT_EQ(4u, writeEvents(&ring, 0, 7));
+    EXPECT_EQ(3u, ring.overflowCount());
+
+    // The batched producer drops the events it could not reserve as well.
+    EXPECT_EQ(0u, ring.reserve(2));
+    EXPECT_EQ(5u, ring.overflowCount());
+
+    // The oldest events are kept.
+    EXPECT_EQ(4u, readEvents(&ring, 0, 4));
+
+    ASSERT_EQ(3u, ring.reserve(3));
+    for (size_t i = 0; i < 3; ++i) {
+        memset(ring.slotAt(i), 0, sizeof(sensors_event_t));
+        ring.slotAt(i)->timestamp = 10 + static_cast<int64_t>(i);
+    }
+    ring.commit(3);
+    EXPECT_EQ(3u, readEvents(&ring, 10, 4));
+    EXPECT_EQ(5u, ring.overflowCount());
+}
+
+}  // namespace
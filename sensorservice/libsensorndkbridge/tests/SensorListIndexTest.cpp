@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ASensorManager.h"
+#include "FakeSensorManager.h"
+
+#include <android/sensor.h>
+#include <gtest/gtest.h>
+
+using android::sp;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::SensorFlagBits;
+using android::hardware::sensors::V1_0::SensorFlagShift;
+using android::hardware::sensors::V1_0::SensorInfo;
+using android::hardware::sensors::V1_0::SensorType;
+
+namespace {
+
+const SensorInfo *toInfo(ASensorRef sensor) {
+    return reinterpret_cast<const SensorInfo *>(sensor);
+}
+
+TEST(SensorListIndexTest, LooksUpByHandle) {
+    sp<FakeSensorManager> fake = new FakeSensorManager;
+    ASensorManager manager(fake);
+    ASSERT_EQ(manager.initCheck(), android::OK);
+
+    for (const auto &sensor : fake->sensors()) {
+        ASensorRef ref = manager.getSensorByHandle(sensor.sensorHandle);
+        ASSERT_NE(ref, nullptr);
+        EXPECT_EQ(toInfo(ref)->sensorHandle, sensor.sensorHandle);
+        EXPECT_EQ(toInfo(ref)->type, sensor.type);
+    }
+
+    EXPECT_EQ(manager.getSensorByHandle(0), nullptr);
+    EXPECT_EQ(manager.getSensorByHandle(1000), nullptr);
+}
+
+TEST(SensorListIndexTest, PicksDefaultByWakeUpState) {
+    hidl_vec<SensorInfo> sensors = FakeSensorManager::makeDefaultSensorList();
+    const size_t base = sensors.size();
+    sensors.resize(base + 2);
+
+    // A second, wake-up accelerometer must not replace the first one.
+    sensors[base] = sensors[0];
+    sensors[base].sensorHandle = static_cast<int32_t>(base + 1);
+    sensors[base].flags = static_cast<uint32_t>(SensorFlagBits::WAKE_UP);
+
+    // A non-wake-up proximity sensor must not become the default.
+    sensors[base + 1] = sensors[base - 1];
+    sensors[base + 1].sensorHandle = static_cast<int32_t>(base + 2);
+    sensors[base + 1].flags = static_cast<uint32_t>(SensorFlagBits::ON_CHANGE_MODE);
+
+    sp<FakeSensorManager> fake = new FakeSensorManager(sensors);
+    ASensorManager manager(fake);
+    ASSERT_EQ(manager.initCheck(), android::OK);
+
+    ASensorRef accelerometer =
+            manager.getDefaultSensor(static_cast<int>(SensorType::ACCELEROMETER));
+    ASSERT_NE(accelerometer, nullptr);
+    EXPECT_EQ(toInfo(accelerometer)->sensorHandle, sensors[0].sensorHandle);
+
+    ASensorRef proximity = manager.getDefaultSensor(static_cast<int>(SensorType::PROXIMITY));
+    ASSERT_NE(proximity, nullptr);
+    EXPECT_EQ(toInfo(proximity)->sensorHandle, sensors[base - 1].sensorHandle);
+
+    EXPECT_EQ(manager.getDefaultSensor(static_cast<int>(SensorType::LIGHT)), nullptr);
+}
+
+TEST(SensorListIndexTest, PicksDefaultExByWakeUpState) {
+    hidl_vec<SensorInfo> sensors = FakeSensorManager::makeDefaultSensorList();
+    const size_t base = sensors.size();
+    sensors.resize(base + 1);
+
+    sensors[base] = sensors[0];
+    sensors[base].sensorHandle = static_cast<int32_t>(base + 1);
+    sensors[base].flags = static_cast<uint32_t>(SensorFlagBits::WAKE_UP);
+
+    sp<FakeSensorManager> fake = new FakeSensorManager(sensors);
+    ASensorManager manager(fake);
+    ASSERT_EQ(manager.initCheck(), android::OK);
+
+    const int accelerometer = static_cast<int>(SensorType::ACCELEROMETER);
+    ASensorRef nonWakeUp = ASensorManager_getDefaultSensorEx(&manager, accelerometer, false);
+    ASensorRef wakeUp = ASensorManager_getDefaultSensorEx(&manager, accelerometer, true);
+    ASSERT_NE(nonWakeUp, nullptr);
+    ASSERT_NE(wakeUp, nullptr);
+    EXPECT_EQ(toInfo(nonWakeUp)->sensorHandle, sensors[0].sensorHandle);
+    EXPECT_EQ(toInfo(wakeUp)->sensorHandle, sensors[base].sensorHandle);
+
+    // The only proximity sensor is a wake-up one.
+    const int proximity = static_cast<int>(SensorType::PROXIMITY);
+    EXPECT_EQ(ASensorManager_getDefaultSensorEx(&manager, proximity, false), nullptr);
+    EXPECT_NE(ASensorManager_getDefaultSensorEx(&manager, proximity, true), nullptr);
+}
+
+TEST(SensorListIndexTest, DecodesFlags) {
+    SensorInfo info = FakeSensorManager::makeSensorInfo(1, SensorType::ACCELEROMETER, "Test");
+    ASensorRef sensor = reinterpret_cast<ASensorRef>(&info);
+
+    EXPECT_EQ(ASensor_getReportingMode(sensor), AREPORTING_MODE_CONTINUOUS);
+    EXPECT_FALSE(ASensor_isWakeUpSensor(sensor));
+    EXPECT_EQ(ASensor_getHighestDirectReportRateLevel(sensor), ASENSOR_DIRECT_RATE_STOP);
+    EXPECT_FALSE(ASensor_isDirectChannelTypeSupported(
+            sensor, ASENSOR_DIRECT_CHANNEL_TYPE_SHARED_MEMORY));
+
+    const uint32_t directReportShift = static_cast<uint32_t>(SensorFlagShift::DIRECT_REPORT);
+    info.flags = static_cast<uint32_t>(SensorFlagBits::WAKE_UP) |
+                 static_cast<uint32_t>(SensorFlagBits::ONE_SHOT_MODE) |
+                 (ASENSOR_DIRECT_RATE_FAST << directReportShift) |
+                 static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_ASHMEM);
+
+    EXPECT_EQ(ASensor_getReportingMode(sensor), AREPORTING_MODE_ONE_SHOT);
+    EXPECT_TRUE(ASensor_isWakeUpSensor(sensor));
+    EXPECT_EQ(ASensor_getHighestDirectReportRateLevel(sensor), ASENSOR_DIRECT_RATE_FAST);
+    EXPECT_TRUE(ASensor_isDirectChannelTypeSupported(
+            sensor, ASENSOR_DIRECT_CHANNEL_TYPE_SHARED_MEMORY));
+    EXPECT_FALSE(ASensor_isDirectChannelTypeSupported(
+            sensor, ASENSOR_DIRECT_CHANNEL_TYPE_HARDWARE_BUFFER));
+    EXPECT_FALSE(ASensor_isDirectChannelTypeSupported(sensor, 3));
+
+    EXPECT_EQ(ASensor_getReportingMode(nullptr), AREPORTING_MODE_INVALID);
+    EXPECT_FALSE(ASensor_isWakeUpSensor(nullptr));
+}
+
+}  // namespace
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ALooper.h"
+#include "ASensorEventQueue.h"
+#include "ASensorManager.h"
+#include "FakeSensorManager.h"
+#include "SensorTrace.h"
+#include "SensorTraceReplayer.h"
+
+#include <gtest/gtest.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+using android::sp;
+using android::frameworks::sensorservice::testing::FakeEventQueue;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::frameworks::sensorservice::testing::SensorTraceReplayer;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::Event;
+using android::hardware::sensors::V1_0::SensorType;
+
+namespace {
+
+struct FileCloser {
+    void operator()(FILE *file) const { fclose(file); }
+};
+
+using TempFile = std::unique_ptr<FILE, FileCloser>;
+
+void expectSameEvent(const Event &actual, const Event &expected) {
+    EXPECT_EQ(actual.timestamp, expected.timestamp);
+    EXPECT_EQ(actual.sensorHandle, expected.sensorHandle);
+    EXPECT_EQ(actual.sensorType, expected.sensorType);
+    EXPECT_EQ(memcmp(&actual.u, &expected.u, sizeof(actual.u)), 0);
+}
+
+// Events of every default fake sensor, interleaved, 1ms apart.
+std::vector<Event> makeEvents(size_t count, int64_t firstTimestamp) {
+    const auto sensors = FakeSensorManager::makeDefaultSensorList();
+    std::vector<Event> events;
+    for (size_t i = 0; i < count; ++i) {
+        events.push_back(FakeSensorManager::makeEvent(
+                sensors[i % sensors.size()], firstTimestamp + i * 1000000));
+    }
+    return events;
+}
+
+TEST(SensorTraceTest, RoundTripsEvents) {
+    TempFile file(tmpfile());
+    ASSERT_NE(file, nullptr);
+
+    const auto events = makeEvents(1000, 123456789);
+    {
+        SensorTraceWriter writer(fileno(file.get()));
+        for (const auto &event : events) {
+            writer.append(event);
+        }
+        ASSERT_EQ(writer.finish(), android::OK);
+    }
+
+    // Delta-encoded timestamps keep records smaller than the events.
+    EXPECT_LT(lseek(fileno(file.get()), 0, SEEK_CUR),
+              static_cast<off_t>(events.size() * sizeof(Event)));
+
+    SensorTraceReader reader;
+    ASSERT_EQ(reader.open(fileno(file.get())), android::OK);
+    ASSERT_EQ(reader.getEventCount(), events.size());
+
+    Event event;
+    size_t i = 0;
+    for (auto cursor = reader.begin(); cursor.next(&event); ++i) {
+        ASSERT_LT(i, events.size());
+        expectSameEvent(event, events[i]);
+    }
+    EXPECT_EQ(i, events.size());
+}
+
+TEST(SensorTraceTest, SeeksThroughIndex) {
+    TempFile file(tmpfile());
+    ASSERT_NE(file, nullptr);
+
+    const auto events = makeEvents(1000, 0);
+    {
+        SensorTraceWriter writer(fileno(file.get()));
+        for (const auto &event : events) {
+            writer.append(event);
+        }
+    }
+
+    SensorTraceReader reader;
+    ASSERT_EQ(reader.open(fileno(file.get())), android::OK);
+
+    auto cursor = reader.seek(events[700].timestamp);
+    EXPECT_EQ(cursor.getEventIndex(), 512u);
+
+    Event event;
+    while (cursor.getEventIndex() < 700) {
+        ASSERT_TRUE(cursor.next(&event));
+    }
+    ASSERT_TRUE(cursor.next(&event));
+    expectSameEvent(event, events[700]);
+
+    EXPECT_EQ(reader.seek(-1).getEventIndex(), 0u);
+}
+
+TEST(SensorTraceTest, RejectsInvalidTrace) {
+    TempFile file(tmpfile());
+    ASSERT_NE(file, nullptr);
+
+    const char garbage[64] = "not a sensor trace";
+    ASSERT_EQ(fwrite(garbage, sizeof(garbage), 1, file.get()), 1u);
+    fflush(file.get());
+
+    SensorTraceReader reader;
+    EXPECT_EQ(reader.open(fileno(file.get())), android::BAD_VALUE);
+    EXPECT_EQ(reader.getEventCount(), 0u);
+}
+
+class SensorTraceQueueTest : public ::testing::Test {
+  protected:
+    void SetUp() override { mLooper = new ALooper; }
+
+    void TearDown() override {
+        if (mQueue != nullptr) {
+            ASensorManager_destroyEventQueue(mManager.get(), mQueue);
+        }
+        mServer.clear();
+        mManager.reset();
+        mLooper.clear();
+    }
+
+    void connect(const hidl_vec<android::hardware::sensors::V1_0::SensorInfo> &sensors) {
+        mFakeManager = new FakeSensorManager(sensors);
+        mManager.reset(new ASensorManager(mFakeManager));
+        ASSERT_EQ(mManager->initCheck(), android::OK);
+
+        mQueue = ASensorManager_createEventQueue(
+                mManager.get(), mLooper.get(), 0 /* ident */, nullptr, nullptr);
+        ASSERT_NE(mQueue, nullptr);
+        mServer = mFakeManager->getEventQueues().back();
+    }
+
+    sp<FakeSensorManager> mFakeManager;
+    std::unique_ptr<ASensorManager> mManager;
+    sp<ALooper> mLooper;
+    ASensorEventQueue *mQueue = nullptr;
+    sp<FakeEventQueue> mServer;
+};
+
+TEST_F(SensorTraceQueueTest, RecordsDeliveredEvents) {
+    connect(FakeSensorManager::makeDefaultSensorList());
+
+    TempFile file(tmpfile());
+    ASSERT_NE(file, nullptr);
+
+    ASSERT_EQ(ASensorEventQueue_startRecording(mQueue, fileno(file.get())), android::OK);
+    EXPECT_EQ(ASensorEventQueue_startRecording(mQueue, fileno(file.get())),
+              android::INVALID_OPERATION);
+
+    const auto events = makeEvents(300, 1000);
+    hidl_vec<Event> first;
+    first.setToExternal(const_cast<Event *>(events.data()), 100);
+    hidl_vec<Event> rest;
+    rest.setToExternal(const_cast<Event *>(events.data()) + 100, 200);
+    mServer->injectEvents(first);
+    mServer->injectEventBatch(rest);
+
+    ASSERT_EQ(ASensorEventQueue_stopRecording(mQueue), android::OK);
+    EXPECT_EQ(ASensorEventQueue_stopRecording(mQueue), android::INVALID_OPERATION);
+
+    SensorTraceReader reader;
+    ASSERT_EQ(reader.open(fileno(file.get())), android::OK);
+    ASSERT_EQ(reader.getEventCount(), events.size());
+
+    Event event;
+    size_t i = 0;
+    for (auto cursor = reader.begin(); cursor.next(&event); ++i) {
+        expectSameEvent(event, events[i]);
+    }
+}
+
+TEST_F(SensorTraceQueueTest, ReplaysTrace) {
+    TempFile file(tmpfile());
+    ASSERT_NE(file, nullptr);
+
+    const auto events = makeEvents(200, 1000);
+    {
+        SensorTraceWriter writer(fileno(file.get()));
+        for (const auto &event : events) {
+            writer.append(event);
+        }
+    }
+
+    SensorTraceReader reader;
+    ASSERT_EQ(reader.open(fileno(file.get())), android::OK);
+
+    const auto sensors = SensorTraceReplayer::makeSensorList(reader);
+    EXPECT_EQ(sensors.size(), FakeSensorManager::makeDefaultSensorList().size());
+    connect(sensors);
+
+    SensorTraceReplayer::Options options;
+    options.speed = 20.0;
+    options.maxBatchSize = 16;
+    SensorTraceReplayer replayer(reader);
+    ASSERT_EQ(replayer.replay(mServer.get(), options), events.size());
+
+    std::vector<ASensorEvent> received(events.size() + 1);
+    ASSERT_EQ(ASensorEventQueue_getEvents(mQueue, received.data(), received.size()),
+              static_cast<ssize_t>(events.size()));
+
+    // Rebased timestamps keep their order.
+    for (size_t i = 0; i < events.size(); ++i) {
+        EXPECT_EQ(received[i].sensor, events[i].sensorHandle);
+        if (i > 0) {
+            EXPECT_GE(received[i].timestamp, received[i - 1].timestamp);
+        }
+    }
+}
+
+}  // namespace
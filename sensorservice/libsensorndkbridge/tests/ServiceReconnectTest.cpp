@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ALooper.h"
+#include "ASensorEventQueue.h"
+#include "ASensorManager.h"
+#include "FakeSensorManager.h"
+
+#include <gtest/gtest.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+using android::sp;
+using android::frameworks::sensorservice::testing::FakeEventQueue;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::frameworks::sensorservice::V1_0::ISensorManager;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::Event;
+using android::hardware::sensors::V1_0::SensorInfo;
+
+namespace {
+
+constexpr std::chrono::seconds kReconnectTimeout{5};
+
+// Kills a fake sensor service under a live ASensorManager and restarts it
+// through the manager's service provider.
+class ServiceReconnectTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mFakeManager = new FakeSensorManager;
+        mManager.reset(new ASensorManager(mFakeManager, [this] {
+            std::lock_guard<std::mutex> lock(mLock);
+            return sp<ISensorManager>(mRestartedManager);
+        }));
+        ASSERT_EQ(mManager->initCheck(), android::OK);
+        mLooper = new ALooper;
+
+        mAccelerometer = ASensorManager_getDefaultSensor(mManager.get(), ASENSOR_TYPE_ACCELEROMETER);
+        mGyroscope = ASensorManager_getDefaultSensor(mManager.get(), ASENSOR_TYPE_GYROSCOPE);
+        ASSERT_NE(mAccelerometer, nullptr);
+        ASSERT_NE(mGyroscope, nullptr);
+    }
+
+    void TearDown() override {
+        mManager.reset();
+        mLooper.clear();
+    }
+
+    void restartService() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mRestartedManager = new FakeSensorManager;
+    }
+
+    // Waits until the restarted service has a queue with every sensor of
+    // |handles| enabled, and returns it.
+    sp<FakeEventQueue> waitForRestoredQueue(std::initializer_list<int32_t> handles) {
+        sp<FakeSensorManager> manager;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            manager = mRestartedManager;
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + kReconnectTimeout;
+        while (std::chrono::steady_clock::now() < deadline) {
+            for (const auto &queue : manager->getEventQueues()) {
+                bool restored = true;
+                for (int32_t handle : handles) {
+                    restored = restored && queue->getSensorConfig(handle, nullptr);
+                }
+                if (restored) {
+                    return queue;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return nullptr;
+    }
+
+    static int32_t handleOf(ASensorRef sensor) {
+        return reinterpret_cast<const SensorInfo *>(sensor)->sensorHandle;
+    }
+
+    void runReconnect(ASensorEventQueue *queue) {
+        ASSERT_NE(queue, nullptr);
+        ASSERT_EQ(ASensorEventQueue_registerSensor(queue, mAccelerometer, 5000, 100000), 0);
+
+        mFakeManager->kill();
+        const auto killed = std::chrono::steady_clock::now();
+
+        // The queue stays usable while the service is away.
+        EXPECT_EQ(ASensorEventQueue_registerSensor(queue, mGyroscope, 10000, 0), 0);
+        ASensorEvent event;
+        EXPECT_EQ(ASensorEventQueue_getEvents(queue, &event, 1), 0);
+
+        restartService();
+
+        sp<FakeEventQueue> serverQueue =
+                waitForRestoredQueue({handleOf(mAccelerometer), handleOf(mGyroscope)});
+        ASSERT_NE(serverQueue, nullptr);
+
+        FakeEventQueue::SensorConfig config;
+        ASSERT_TRUE(serverQueue->getSensorConfig(handleOf(mAccelerometer), &config));
+        EXPECT_EQ(config.samplingPeriodUs, 5000);
+        EXPECT_EQ(config.maxBatchReportLatencyUs, 100000);
+        ASSERT_TRUE(serverQueue->getSensorConfig(handleOf(mGyroscope), &config));
+        EXPECT_EQ(config.samplingPeriodUs, 10000);
+        EXPECT_EQ(config.maxBatchReportLatencyUs, 0);
+
+        const SensorInfo &accelerometer = *reinterpret_cast<const SensorInfo *>(mAccelerometer);
+        hidl_vec<Event> events;
+        events.resize(1);
+        events[0] = FakeSensorManager::makeEvent(accelerometer, 42 /* timestamp */);
+        serverQueue->injectEvents(events);
+
+        ASSERT_EQ(ASensorEventQueue_getEvents(queue, &event, 1), 1);
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - killed);
+
+        EXPECT_EQ(event.timestamp, 42);
+        EXPECT_EQ(event.sensor, handleOf(mAccelerometer));
+        RecordProperty("time_to_first_event_us", static_cast<int>(elapsed.count()));
+
+        EXPECT_EQ(ASensorManager_destroyEventQueue(mManager.get(), queue), android::OK);
+    }
+
+    std::mutex mLock;
+    sp<FakeSensorManager> mRestartedManager;
+
+    sp<FakeSensorManager> mFakeManager;
+    std::unique_ptr<ASensorManager> mManager;
+    sp<ALooper> mLooper;
+    ASensorRef mAccelerometer;
+    ASensorRef mGyroscope;
+};
+
+TEST_F(ServiceReconnectTest, RestoresCallbackQueue) {
+    runReconnect(ASensorManager_createEventQueue(
+            mManager.get(), mLooper.get(), 0 /* ident */, nullptr /* callback */, nullptr /* data */));
+}
+
+TEST_F(ServiceReconnectTest, RestoresFmqQueue) {
+    runReconnect(ASensorManager_createFmqEventQueue(
+            mManager.get(), mLooper.get(), 0 /* ident */, nullptr /* callback */, nullptr /* data */));
+}
+
+TEST_F(ServiceReconnectTest, RestoresSharedQueue) {
+    runReconnect(ASensorManager_createSharedEventQueue(
+            mManager.get(), mLooper.get(), 0 /* ident */, nullptr /* callback */, nullptr /* data */,
+            0 /* flags */));
+}
+
+TEST_F(ServiceReconnectTest, DoesNotRestoreDestroyedQueues) {
+    ASensorEventQueue *queue = ASensorManager_createEventQueue(
+            mManager.get(), mLooper.get(), 0 /* ident */, nullptr /* callback */, nullptr /* data */);
+    ASSERT_NE(queue, nullptr);
+    ASSERT_EQ(ASensorManager_destroyEventQueue(mManager.get(), queue), android::OK);
+
+    mFakeManager->kill();
+    restartService();
+
+    const auto deadline = std::chrono::steady_clock::now() + kReconnectTimeout;
+    while (mManager->initCheck() != android::OK && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(mManager->initCheck(), android::OK);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    EXPECT_TRUE(mRestartedManager->getEventQueues().empty());
+}
+
+}  // namespace
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ALooper.h"
+#include "ASensorEventQueue.h"
+#include "ASensorManager.h"
+#include "FakeSensorManager.h"
+
+#include <gtest/gtest.h>
+#include <sensorndkbridge/sensor_ext.h>
+
+#include <algorithm>
+#include <vector>
+
+using android::sp;
+using android::frameworks::sensorservice::testing::FakeEventQueue;
+using android::frameworks::sensorservice::testing::FakeSensorManager;
+using android::hardware::hidl_vec;
+using android::hardware::sensors::V1_0::Event;
+using android::hardware::sensors::V1_0::SensorInfo;
+
+namespace {
+
+class SharedEventQueueTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mFakeManager = new FakeSensorManager;
+        mManager.reset(new ASensorManager(mFakeManager));
+        ASSERT_EQ(mManager->initCheck(), android::OK);
+        mLooper = new ALooper;
+
+        mAccelerometer = ASensorManager_getDefaultSensor(mManager.get(), ASENSOR_TYPE_ACCELEROMETER);
+        mProximity = ASensorManager_getDefaultSensor(mManager.get(), ASENSOR_TYPE_PROXIMITY);
+        ASSERT_NE(mAccelerometer, nullptr);
+        ASSERT_NE(mProximity, nullptr);
+    }
+
+    void TearDown() override {
+        for (ASensorEventQueue *queue : mQueues) {
+            ASensorManager_destroyEventQueue(mManager.get(), queue);
+        }
+        mManager.reset();
+        mLooper.clear();
+    }
+
+    ASensorEventQueue *createQueue(int flags) {
+        ASensorEventQueue *queue = ASensorManager_createSharedEventQueue(
+                mManager.get(), mLooper.get(), 0 /* ident */, nullptr, nullptr, flags);
+        if (queue != nullptr) {
+            mQueues.push_back(queue);
+        }
+        return queue;
+    }
+
+    void destroyQueue(ASensorEventQueue *queue) {
+        mQueues.erase(std::find(mQueues.begin(), mQueues.end(), queue));
+        ASSERT_EQ(ASensorManager_destroyEventQueue(mManager.get(), queue), android::OK);
+    }
+
+    sp<FakeEventQueue> server() {
+        auto queues = mFakeManager->getEventQueues();
+        return queues.size() == 1 ? queues[0] : nullptr;
+    }
+
+    // |count| events of |sensor|, |periodNs| apart.
+    static hidl_vec<Event> makeEvents(ASensorRef sensor, size_t count, int64_t periodNs) {
+        const SensorInfo &info = *reinterpret_cast<const SensorInfo *>(sensor);
+        hidl_vec<Event> events;
+        events.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            events[i] = FakeSensorManager::makeEvent(info, 1000000000 + i * periodNs);
+        }
+        return events;
+    }
+
+    static int32_t handleOf(ASensorRef sensor) {
+        return reinterpret_cast<const SensorInfo *>(sensor)->sensorHandle;
+    }
+
+    sp<FakeSensorManager> mFakeManager;
+    std::unique_ptr<ASensorManager> mManager;
+    sp<ALooper> mLooper;
+    ASensorRef mAccelerometer;
+    ASensorRef mProximity;
+    std::vector<ASensorEventQueue *> mQueues;
+};
+
+TEST_F(SharedEventQueueTest, SharesOneServerSubscription) {
+    ASensorEventQueue *fast = createQueue(0);
+    ASensorEventQueue *slow = createQueue(0);
+    ASSERT_NE(fast, nullptr);
+    ASSERT_NE(slow, nullptr);
+
+    ASSERT_EQ(ASensorEventQueue_registerSensor(slow, mAccelerometer, 20000, 200000), 0);
+    ASSERT_EQ(ASensorEventQueue_registerSensor(fast, mAccelerometer, 10000, 500000), 0);
+
+    sp<FakeEventQueue> serverQueue = server();
+    ASSERT_NE(serverQueue, nullptr);
+
+    // Fastest rate, shortest latency.
+    FakeEventQueue::SensorConfig config;
+    ASSERT_TRUE(serverQueue->getSensorConfig(handleOf(mAccelerometer), &config));
+    EXPECT_EQ(config.samplingPeriodUs, 10000);
+    EXPECT_EQ(config.maxBatchReportLatencyUs, 200000);
+
+    serverQueue->injectEventBatch(makeEvents(mAccelerometer, 10, 10000000));
+
+    ASensorEvent events[16];
+    EXPECT_EQ(ASensorEventQueue_getEvents(fast, events, 16), 10);
+    EXPECT_EQ(ASensorEventQueue_getEvents(slow, events, 16), 10);
+
+    // The remaining subscriber's configuration takes over.
+    ASSERT_EQ(ASensorEventQueue_disableSensor(fast, mAccelerometer), 0);
+    ASSERT_TRUE(serverQueue->getSensorConfig(handleOf(mAccelerometer), &config));
+    EXPECT_EQ(config.samplingPeriodUs, 20000);
+    EXPECT_EQ(config.maxBatchReportLatencyUs, 200000);
+
+    serverQueue->injectEvents(makeEvents(mAccelerometer, 3, 20000000));
+    EXPECT_EQ(ASensorEventQueue_getEvents(fast, events, 16), 0);
+    EXPECT_EQ(ASensorEventQueue_getEvents(slow, events, 16), 3);
+
+    destroyQueue(slow);
+    EXPECT_FALSE(serverQueue->getSensorConfig(handleOf(mAccelerometer), nullptr));
+}
+
+TEST_F(SharedEventQueueTest, DecimatesContinuousSensors) {
+    ASensorEventQueue *fast = createQueue(ASENSOR_SHARED_EVENT_QUEUE_DECIMATE);
+    ASensorEventQueue *slow = createQueue(ASENSOR_SHARED_EVENT_QUEUE_DECIMATE);
+    ASSERT_NE(fast, nullptr);
+    ASSERT_NE(slow, nullptr);
+
+    ASSERT_EQ(ASensorEventQueue_registerSensor(fast, mAccelerometer, 10000, 0), 0);
+    ASSERT_EQ(ASensorEventQueue_registerSensor(slow, mAccelerometer, 40000, 0), 0);
+    ASSERT_EQ(ASensorEventQueue_registerSensor(fast, mProximity, 10000, 0), 0);
+    ASSERT_EQ(ASensorEventQueue_registerSensor(slow, mProximity, 40000, 0), 0);
+
+    sp<FakeEventQueue> serverQueue = server();
+    ASSERT_NE(serverQueue, nullptr);
+    serverQueue->injectEventBatch(makeEvents(mAccelerometer, 40, 10000000));
+
+    ASensorEvent events[64];
+    EXPECT_EQ(ASensorEventQueue_getEvents(fast, events, 64), 40);
+
+    const ssize_t count = ASensorEventQueue_getEvents(slow, events, 64);
+    EXPECT_EQ(count, 10);
+    for (ssize_t i = 1; i < count; ++i) {
+        EXPECT_GE(events[i].timestamp - events[i - 1].timestamp, 35000000);
+    }
+
+    // On-change sensors are never decimated.
+    serverQueue->injectEventBatch(makeEvents(mProximity, 5, 10000000));
+    EXPECT_EQ(ASensorEventQueue_getEvents(fast, events, 64), 5);
+    EXPECT_EQ(ASensorEventQueue_getEvents(slow, events, 64), 5);
+}
+
+TEST_F(SharedEventQueueTest, CutsServerCalls) {
+    constexpr size_t kQueueCount = 3;
+    for (size_t i = 0; i < kQueueCount; ++i) {
+        ASensorEventQueue *queue = createQueue(0);
+        ASSERT_NE(queue, nullptr);
+        ASSERT_EQ(ASensorEventQueue_registerSensor(queue, mAccelerometer, 10000, 0), 0);
+    }
+
+    // One server-side queue serves all of them.
+    ASSERT_EQ(mFakeManager->getEventQueues().size(), 1u);
+    sp<FakeEventQueue> serverQueue = server();
+
+    serverQueue->injectEvents(makeEvents(mAccelerometer, 4, 10000000));
+    for (ASensorEventQueue *queue : mQueues) {
+        ASensorEvent events[8];
+        EXPECT_EQ(ASensorEventQueue_getEvents(queue, events, 8), 4);
+    }
+}
+
+}  // namespace